@@ -39,6 +39,8 @@ public:
          const cv::Mat& image2_
    ) override;
 
+   virtual Kernel get_kernel(int type_) const override;
+
    virtual cv::String get_name() const override
    {return "Hamming";};
 };
@@ -18,6 +18,9 @@
 #ifndef _MATCHCOST_HPP_
 #define _MATCHCOST_HPP_
 
+#include <algorithm>
+#include <cfloat>
+#include <vector>
 #include <opencv2/core.hpp>
 
 enum MatchCostType
@@ -25,6 +28,7 @@ enum MatchCostType
    E_COST_TYPE_SSD            = 0, //!< sum of squared distances
    E_COST_TYPE_SAD            = 1, //!< sum of absolute distances
    E_COST_TYPE_HAMMING        = 2, //!< hamming distances
+   E_COST_TYPE_PACKED_HAMMING = 3, //!< hamming distances of bit-packed descriptors
 };
 
 /**
@@ -32,6 +36,65 @@ enum MatchCostType
  */
 class MatchCost
 {
+public:
+   /**
+    * Low-level cost kernel working on raw data.
+    *
+    * It does no allocation and no checking. The two patches must have the same size
+    * and the same type as the one passed to get_kernel().
+    *
+    * @param p1_     [in] First pixel of the patch in the first frame
+    * @param step1_  [in] Row stride of the first frame in bytes
+    * @param p2_     [in] First pixel of the patch in the second frame
+    * @param step2_  [in] Row stride of the second frame in bytes
+    * @param width_  [in] Patch width in pixels
+    * @param height_ [in] Patch height in pixels
+    * @param cn_     [in] Number of channels, i.e., descriptor length.
+    *                     Kernels specialized for a fixed descriptor length ignore it.
+    * @param bound_  [in] Non-negative upper bound of interest, e.g., the best cost so far.
+    *                     The kernel may stop accumulating after a row once the cost
+    *                     can no longer be less than bound_. DBL_MAX disables it.
+    *
+    * @return Matching cost between the two patches, normalized
+    *         in the same way as compute_cost(). It is exact if it is less than bound_,
+    *         otherwise it is only guaranteed to be at least bound_.
+    */
+   typedef double (*Kernel)(
+         const uchar* p1_,
+         size_t step1_,
+         const uchar* p2_,
+         size_t step2_,
+         int width_,
+         int height_,
+         int cn_,
+         double bound_
+   );
+
+   /**
+    * Low-level kernel for the bilinearly interpolated cost of a 2x2 neighborhood.
+    *
+    * The four target patches start at p2_, p2_ plus one pixel, p2_ plus one row
+    * and p2_ plus one row and one pixel. The first patch is loaded only once for all of them.
+    *
+    * @param wx_  [in] Weight of the right targets, in [0, 1]
+    * @param wy_  [in] Weight of the bottom targets, in [0, 1]
+    *
+    * @return (1-wx_)*(1-wy_)*c00 + wx_*(1-wy_)*c10 + (1-wx_)*wy_*c01 + wx_*wy_*c11,
+    *         where cij are the costs of Kernel for the four targets.
+    *         It is always exact.
+    */
+   typedef double (*BilinearKernel)(
+         const uchar* p1_,
+         size_t step1_,
+         const uchar* p2_,
+         size_t step2_,
+         int width_,
+         int height_,
+         int cn_,
+         float wx_,
+         float wy_
+   );
+
 public:
    virtual ~MatchCost() {}
 
@@ -68,6 +131,142 @@ public:
          const cv::Mat& image2_
    ) = 0;
 
+   /**
+    * Get the low-level kernel for the given image type.
+    *
+    * The kernel is looked up once and can then be called for
+    * every candidate without any virtual dispatch.
+    *
+    * @param type_ Image type, e.g., CV_8UC(128) for SIFT descriptors
+    * @return The kernel for the given type
+    */
+   virtual Kernel get_kernel(int type_) const = 0;
+
+   /**
+    * Get the fused bilinear kernel for the given image type.
+    *
+    * @param type_ Image type
+    * @return The kernel, or nullptr if the type has none. compute_patch_cost_bilinear()
+    *         then interpolates the costs of get_kernel().
+    */
+   virtual BilinearKernel get_bilinear_kernel(int type_) const
+   {(void)type_; return nullptr;}
+
+   /**
+    * Compute the match cost between two patches with a low-level kernel.
+    *
+    * It gives the same result as compute_cost() but does not check its inputs:
+    * (x1_, y1_) must be inside image1_, (x2_, y2_) must be inside image2_,
+    * and the two images must have the same type.
+    *
+    * Patches at the borders are cropped to the image and
+    * aligned at their top left corners, as in compute_cost().
+    *
+    * @param kernel_  Kernel returned by get_kernel() for the type of the images
+    * @param bound_   Stop accumulating once the cost cannot be less than bound_, see Kernel.
+    *                 The default value always computes the exact cost.
+    * @return Matching cost between the two patches. If it is not less than bound_,
+    *         it may be a lower bound of the exact cost.
+    */
+   static double compute_patch_cost(
+         Kernel kernel_,
+         const cv::Mat& image1_,
+         const cv::Mat& image2_,
+         int x1_,
+         int y1_,
+         int x2_,
+         int y2_,
+         int half_patch_size_,
+         double bound_ = DBL_MAX
+   );
+
+   /**
+    * Compute the match cost between a patch and a non-integer position in the second frame
+    * by bilinear interpolation of the costs of the 2x2 neighboring pixels.
+    *
+    * (x2_, y2_) must be in [0, cols-1] x [0, rows-1] of image2_. A neighbor with
+    * a weight of 0 on the last column or row is replaced by its left or top neighbor.
+    *
+    * @param kernel_          [in] Kernel returned by get_kernel() for the type of the images
+    * @param bilinear_kernel_ [in] Kernel returned by get_bilinear_kernel(), may be nullptr.
+    *                              It is used if all the patches are inside the images,
+    *                              otherwise the four cropped costs of kernel_ are interpolated.
+    * @param x2_              [in] x coordinate in image2_
+    * @param y2_              [in] y coordinate in image2_
+    *
+    * @return The interpolated matching cost.
+    */
+   static double compute_patch_cost_bilinear(
+         Kernel kernel_,
+         BilinearKernel bilinear_kernel_,
+         const cv::Mat& image1_,
+         const cv::Mat& image2_,
+         int x1_,
+         int y1_,
+         float x2_,
+         float y2_,
+         int half_patch_size_
+   );
+
+   /**
+    * Compute the match costs of several candidates for one pixel of the first frame.
+    *
+    * The reference patch is located once; candidates whose patches
+    * lie completely inside the image are passed to the kernel directly.
+    * The costs are the same as the ones of compute_patch_cost().
+    *
+    * @param kernel_      [in]  Kernel returned by get_kernel() for the type of the images
+    * @param image1_      [in]  The first frame
+    * @param image2_      [in]  The second frame
+    * @param x1_          [in]  x coordinate of the pixel in image1_, must be inside
+    * @param y1_          [in]  y coordinate of the pixel in image1_, must be inside
+    * @param candidates_  [in]  Candidate pixels in image2_
+    * @param num_candidates_  [in] Number of candidates
+    * @param costs_       [out] Cost of every evaluated candidate.
+    *                           Candidates outside of image2_ have a cost of FLT_MAX.
+    * @param half_patch_size_  [in] Half patch size
+    * @param bound_       [in]  Stop after the first candidate whose cost is less than bound_.
+    *                           The default value never stops early.
+    * @param cost_bound_  [in]  Passed to the kernel for every candidate, see Kernel.
+    *                           Costs that are not less than it may be inexact.
+    *
+    * @return Number of evaluated candidates; costs_ of the remaining ones are not written.
+    */
+   static int compute_cost_batch(
+         Kernel kernel_,
+         const cv::Mat& image1_,
+         const cv::Mat& image2_,
+         int x1_,
+         int y1_,
+         const cv::Point* candidates_,
+         int num_candidates_,
+         float* costs_,
+         int half_patch_size_,
+         float bound_ = -1,
+         double cost_bound_ = DBL_MAX
+   );
+
+   /**
+    * Compute the match costs of several candidates for one pixel of the first frame.
+    *
+    * It looks up the kernel and calls the static version.
+    *
+    * @param pixel1_      [in]  Pixel in the first frame
+    * @param candidates_  [in]  Candidate pixels in the second frame
+    * @param costs_       [out] Cost of every evaluated candidate
+    *
+    * @return Number of evaluated candidates
+    */
+   int compute_cost_batch(
+         const cv::Mat& image1_,
+         const cv::Mat& image2_,
+         const cv::Point& pixel1_,
+         const std::vector<cv::Point>& candidates_,
+         std::vector<float>& costs_,
+         int half_patch_size_,
+         float bound_ = -1
+   ) const;
+
    /**
     * Get the name of the cost.
     * @return  Name of the cost.
@@ -96,4 +295,156 @@ public:
  */
 std::string match_cost_type_to_string(MatchCostType type_);
 
+inline double
+MatchCost::compute_patch_cost(
+      Kernel kernel_,
+      const cv::Mat& image1_,
+      const cv::Mat& image2_,
+      int x1_,
+      int y1_,
+      int x2_,
+      int y2_,
+      int half_patch_size_,
+      double bound_
+)
+{
+   size_t elem_size = image1_.elemSize();
+   int cn = image1_.channels();
+
+   if (half_patch_size_ == 0)
+   {
+      return kernel_(image1_.ptr<uchar>(y1_) + x1_*elem_size, image1_.step,
+                     image2_.ptr<uchar>(y2_) + x2_*elem_size, image2_.step,
+                     1, 1, cn, bound_);
+   }
+
+   int r = half_patch_size_;
+
+   int left1   = std::max(x1_ - r, 0);
+   int top1    = std::max(y1_ - r, 0);
+   int right1  = std::min(x1_ + r + 1, image1_.cols);
+   int bottom1 = std::min(y1_ + r + 1, image1_.rows);
+
+   int left2   = std::max(x2_ - r, 0);
+   int top2    = std::max(y2_ - r, 0);
+   int right2  = std::min(x2_ + r + 1, image2_.cols);
+   int bottom2 = std::min(y2_ + r + 1, image2_.rows);
+
+   int width  = std::min(right1 - left1, right2 - left2);
+   int height = std::min(bottom1 - top1, bottom2 - top2);
+
+   return kernel_(image1_.ptr<uchar>(top1) + left1*elem_size, image1_.step,
+                  image2_.ptr<uchar>(top2) + left2*elem_size, image2_.step,
+                  width, height, cn, bound_);
+}
+
+inline double
+MatchCost::compute_patch_cost_bilinear(
+      Kernel kernel_,
+      BilinearKernel bilinear_kernel_,
+      const cv::Mat& image1_,
+      const cv::Mat& image2_,
+      int x1_,
+      int y1_,
+      float x2_,
+      float y2_,
+      int half_patch_size_
+)
+{
+   int x_left = cvFloor(x2_);
+   int y_top = cvFloor(y2_);
+   float wx = x2_ - (float)x_left;
+   float wy = y2_ - (float)y_top;
+
+   int r = half_patch_size_;
+   int size = 2*r + 1;
+
+   if (bilinear_kernel_ &&
+       (x1_ - r >= 0) && (x1_ + r < image1_.cols) && (y1_ - r >= 0) && (y1_ + r < image1_.rows) &&
+       (x_left - r >= 0) && (x_left + 1 + r < image2_.cols) && (y_top - r >= 0) && (y_top + 1 + r < image2_.rows))
+   {
+      size_t elem_size = image1_.elemSize();
+      return bilinear_kernel_(image1_.ptr<uchar>(y1_ - r) + (x1_ - r)*elem_size, image1_.step,
+                              image2_.ptr<uchar>(y_top - r) + (x_left - r)*elem_size, image2_.step,
+                              size, size, image1_.channels(), wx, wy);
+   }
+
+   // the weight of a neighbor outside of the image is 0
+   int x_right = std::min(x_left + 1, image2_.cols - 1);
+   int y_bottom = std::min(y_top + 1, image2_.rows - 1);
+
+   double c00 = compute_patch_cost(kernel_, image1_, image2_, x1_, y1_, x_left, y_top, half_patch_size_);
+   double c10 = compute_patch_cost(kernel_, image1_, image2_, x1_, y1_, x_right, y_top, half_patch_size_);
+   double c01 = compute_patch_cost(kernel_, image1_, image2_, x1_, y1_, x_left, y_bottom, half_patch_size_);
+   double c11 = compute_patch_cost(kernel_, image1_, image2_, x1_, y1_, x_right, y_bottom, half_patch_size_);
+
+   return (1 - wx)*(1 - wy)*c00 + wx*(1 - wy)*c10 + (1 - wx)*wy*c01 + wx*wy*c11;
+}
+
+inline int
+MatchCost::compute_cost_batch(
+      Kernel kernel_,
+      const cv::Mat& image1_,
+      const cv::Mat& image2_,
+      int x1_,
+      int y1_,
+      const cv::Point* candidates_,
+      int num_candidates_,
+      float* costs_,
+      int half_patch_size_,
+      float bound_,
+      double cost_bound_
+)
+{
+   size_t elem_size = image1_.elemSize();
+   int cn = image1_.channels();
+   int r = half_patch_size_;
+   int size = 2*r + 1;
+
+   bool is_reference_inside = (x1_ - r >= 0) && (x1_ + r < image1_.cols) &&
+                              (y1_ - r >= 0) && (y1_ + r < image1_.rows);
+
+   const uchar* p1 = nullptr;
+   if (is_reference_inside)
+   {
+      p1 = image1_.ptr<uchar>(y1_ - r) + (x1_ - r)*elem_size;
+   }
+
+   int nx = image2_.cols;
+   int ny = image2_.rows;
+
+   int i = 0;
+   while (i < num_candidates_)
+   {
+      int x2 = candidates_[i].x;
+      int y2 = candidates_[i].y;
+
+      float cost;
+      if ((x2 < 0) || (x2 >= nx) || (y2 < 0) || (y2 >= ny))
+      {
+         cost = FLT_MAX;
+      }
+      else if (is_reference_inside &&
+               (x2 - r >= 0) && (x2 + r < nx) &&
+               (y2 - r >= 0) && (y2 + r < ny))
+      {
+         cost = (float)kernel_(p1, image1_.step,
+                               image2_.ptr<uchar>(y2 - r) + (x2 - r)*elem_size, image2_.step,
+                               size, size, cn, cost_bound_);
+      }
+      else
+      {
+         cost = (float)compute_patch_cost(kernel_, image1_, image2_,
+                                          x1_, y1_, x2, y2, half_patch_size_, cost_bound_);
+      }
+
+      costs_[i] = cost;
+      i++;
+
+      if (cost < bound_) break;
+   }
+
+   return i;
+}
+
 #endif //_MATCHCOST_HPP_
@@ -0,0 +1,162 @@
+/*  ---------------------------------------------------------------------
+    Copyright 2017 Fangjun Kuang
+    email: csukuangfj at gmail dot com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a COPYING file of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>
+    -----------------------------------------------------------------  */
+#ifndef _MATCHCOSTSIMD_HPP_
+#define _MATCHCOSTSIMD_HPP_
+
+#include <stdint.h>
+#include <opencv2/core.hpp>
+
+/**
+ * Instruction sets for the vectorized uint8 and int8 row kernels.
+ */
+enum MatchCostSimd
+{
+   E_SIMD_NONE       = 0, //!< plain C++
+   E_SIMD_SSE2       = 1, //!< 16 bytes per instruction
+   E_SIMD_AVX2       = 2, //!< 32 bytes per instruction
+   E_SIMD_AVX512     = 3, //!< 64 bytes per instruction, requires AVX-512F and AVX-512BW
+};
+
+/**
+ * Instruction sets for the popcount row kernels.
+ */
+enum MatchCostPopcount
+{
+   E_POPCOUNT_NONE   = 0, //!< plain C++
+   E_POPCOUNT_POPCNT = 1, //!< popcnt on 64 bits
+   E_POPCOUNT_AVX512 = 2, //!< AVX-512 VPOPCNTDQ on 512 bits
+};
+
+/**
+ * Get the best instruction set supported by the CPU at runtime.
+ *
+ * It respects cv::setUseOptimized(false), which forces E_SIMD_NONE.
+ *
+ * @return The best supported instruction set.
+ */
+MatchCostSimd get_match_cost_simd();
+
+/**
+ * Check whether the CPU supports the given instruction set.
+ *
+ * @param simd_ Instruction set.
+ * @return true if the row kernels of simd_ can be called.
+ */
+bool is_match_cost_simd_supported(MatchCostSimd simd_);
+
+/**
+ * Get the best popcount instruction set supported by the CPU at runtime.
+ *
+ * It respects cv::setUseOptimized(false), which forces E_POPCOUNT_NONE.
+ *
+ * @return The best supported instruction set.
+ */
+MatchCostPopcount get_match_cost_popcount();
+
+/**
+ * Check whether the CPU supports the given popcount instruction set.
+ *
+ * @param popcount_ Instruction set.
+ * @return true if the hamming_32u_xxx kernel of popcount_ can be called.
+ */
+bool is_match_cost_popcount_supported(MatchCostPopcount popcount_);
+
+/**
+ * Row kernels for uint8 descriptors.
+ *
+ * sad_8u_xxx returns the sum of absolute differences and
+ * ssd_8u_xxx returns the sum of squared differences
+ * of len_ bytes. The result is identical for all instruction sets.
+ *
+ * The result has to fit into 32 bits, i.e., len_ must be less than 66051
+ * for the sum of squared differences.
+ *
+ * @param a_    [in] First row
+ * @param b_    [in] Second row
+ * @param len_  [in] Number of bytes
+ */
+unsigned sad_8u_scalar(const uchar* a_, const uchar* b_, int len_);
+unsigned sad_8u_sse2(const uchar* a_, const uchar* b_, int len_);
+unsigned sad_8u_avx2(const uchar* a_, const uchar* b_, int len_);
+unsigned sad_8u_avx512(const uchar* a_, const uchar* b_, int len_);
+
+unsigned ssd_8u_scalar(const uchar* a_, const uchar* b_, int len_);
+unsigned ssd_8u_sse2(const uchar* a_, const uchar* b_, int len_);
+unsigned ssd_8u_avx2(const uchar* a_, const uchar* b_, int len_);
+unsigned ssd_8u_avx512(const uchar* a_, const uchar* b_, int len_);
+
+/**
+ * Row kernels for int8 descriptors, e.g., the quantized
+ * principal components of SIFT, see SiftDescriptor::project_sift_descriptor().
+ *
+ * They are identical to the uint8 row kernels otherwise.
+ *
+ * @param a_    [in] First row
+ * @param b_    [in] Second row
+ * @param len_  [in] Number of bytes
+ */
+unsigned sad_8s_scalar(const schar* a_, const schar* b_, int len_);
+unsigned sad_8s_sse2(const schar* a_, const schar* b_, int len_);
+unsigned sad_8s_avx2(const schar* a_, const schar* b_, int len_);
+unsigned sad_8s_avx512(const schar* a_, const schar* b_, int len_);
+
+unsigned ssd_8s_scalar(const schar* a_, const schar* b_, int len_);
+unsigned ssd_8s_sse2(const schar* a_, const schar* b_, int len_);
+unsigned ssd_8s_avx2(const schar* a_, const schar* b_, int len_);
+unsigned ssd_8s_avx512(const schar* a_, const schar* b_, int len_);
+
+/**
+ * Fused row kernels for a 2x2 neighborhood of uint8 descriptors.
+ *
+ * They compare the row a_ with the rows of the four targets at
+ * b_, b_ + shift_, b_ + step_ and b_ + step_ + shift_, i.e., the top left,
+ * top right, bottom left and bottom right neighbors, loading a_ only once.
+ * sums_[k] is identical to sad_8u_xxx or ssd_8u_xxx of the k-th target.
+ *
+ * @param a_      [in]  First row
+ * @param b_      [in]  Row of the top left target
+ * @param step_   [in]  Offset of the bottom targets in bytes, i.e., the row stride of the second frame
+ * @param shift_  [in]  Offset of the right targets in bytes, i.e., the size of a descriptor
+ * @param len_    [in]  Number of bytes
+ * @param sums_   [out] Sum of every target
+ */
+void sad4_8u_scalar(const uchar* a_, const uchar* b_, size_t step_, size_t shift_, int len_, unsigned sums_[4]);
+void sad4_8u_sse2(const uchar* a_, const uchar* b_, size_t step_, size_t shift_, int len_, unsigned sums_[4]);
+void sad4_8u_avx2(const uchar* a_, const uchar* b_, size_t step_, size_t shift_, int len_, unsigned sums_[4]);
+void sad4_8u_avx512(const uchar* a_, const uchar* b_, size_t step_, size_t shift_, int len_, unsigned sums_[4]);
+
+void ssd4_8u_scalar(const uchar* a_, const uchar* b_, size_t step_, size_t shift_, int len_, unsigned sums_[4]);
+void ssd4_8u_sse2(const uchar* a_, const uchar* b_, size_t step_, size_t shift_, int len_, unsigned sums_[4]);
+void ssd4_8u_avx2(const uchar* a_, const uchar* b_, size_t step_, size_t shift_, int len_, unsigned sums_[4]);
+void ssd4_8u_avx512(const uchar* a_, const uchar* b_, size_t step_, size_t shift_, int len_, unsigned sums_[4]);
+
+/**
+ * Row kernels for bit-packed descriptors.
+ *
+ * They return the number of different bits of len_ 32-bit words.
+ * The result is identical for all instruction sets.
+ *
+ * @param a_    [in] First row
+ * @param b_    [in] Second row
+ * @param len_  [in] Number of words
+ */
+unsigned hamming_32u_scalar(const uint32_t* a_, const uint32_t* b_, int len_);
+unsigned hamming_32u_popcnt(const uint32_t* a_, const uint32_t* b_, int len_);
+unsigned hamming_32u_avx512(const uint32_t* a_, const uint32_t* b_, int len_);
+
+#endif //_MATCHCOSTSIMD_HPP_
@@ -41,6 +41,10 @@ public:
          const cv::Mat& image2_
    ) override;
 
+   virtual Kernel get_kernel(int type_) const override;
+
+   virtual BilinearKernel get_bilinear_kernel(int type_) const override;
+
    virtual cv::String get_name() const override
    {return "SSD";}
 };
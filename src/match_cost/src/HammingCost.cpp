@@ -17,6 +17,63 @@
     -----------------------------------------------------------------  */
 #include "HammingCost.hpp"
 
+/**
+ * Number of bits set in a byte.
+ */
+static inline int
+popcount_8u(uchar v_)
+{
+   int v = v_;
+   v = v - ((v >> 1) & 0x55);
+   v = (v & 0x33) + ((v >> 2) & 0x33);
+   return (v + (v >> 4)) & 0x0f;
+}
+
+/**
+ * Average hamming distance of two patches of uint8 descriptors.
+ *
+ * @tparam CN    Number of channels. 0 if it is known only at runtime.
+ */
+template<int CN>
+static double
+hamming_kernel(
+      const uchar* p1_,
+      size_t step1_,
+      const uchar* p2_,
+      size_t step2_,
+      int width_,
+      int height_,
+      int cn_,
+      double bound_
+)
+{
+   int cn = (CN > 0) ? CN : cn_;
+   int len = width_ * cn;
+
+   double num = (double)((size_t)len * (size_t)height_);
+   double limit = bound_ * num;
+
+   int sum = 0;
+   for (int y = 0; y < height_; y++)
+   {
+      const uchar* a = p1_ + y*step1_;
+      const uchar* b = p2_ + y*step2_;
+      for (int i = 0; i < len; i++)
+      {
+         sum += popcount_8u((uchar)(a[i] ^ b[i]));
+      }
+
+      // stop once the partial cost cannot be less than the bound
+      if ((double)sum >= limit)
+      {
+         double partial = (double)sum / num;
+         if (partial >= bound_) return partial;
+      }
+   }
+
+   return (double)sum / num;
+}
+
 double
 HammingCost::compute_cost(
       const cv::Mat& image1_,
@@ -28,6 +85,7 @@ HammingCost::compute_cost(
 {
    CV_Assert(image1_.depth() == CV_8U);
    CV_Assert(image2_.depth() == CV_8U);
+   CV_Assert(image1_.type() == image2_.type());
 
    cv::Rect r1(cv::Point(0,0), image1_.size());
    cv::Rect r2(cv::Point(0,0), image2_.size());
@@ -35,27 +93,26 @@ HammingCost::compute_cost(
    CV_Assert(r1.contains(pixel1_));
    CV_Assert(r2.contains(pixel2_));
 
-   // assume that the patch size is square and has an odd side length
-   cv::Rect s1(pixel1_.x - half_patch_size_, pixel1_.y - half_patch_size_, 2*half_patch_size_+1, 2*half_patch_size_+1);
-   cv::Rect s2(pixel2_.x - half_patch_size_, pixel2_.y - half_patch_size_, 2*half_patch_size_+1, 2*half_patch_size_+1);
-
-   s1 &= r1;
-   s2 &= r2;
-
-   cv::Mat m1 = image1_(s1);
-   cv::Mat m2 = image2_(s2);
-
-   cv::Rect s11(cv::Point(0,0), m1.size());
-   cv::Rect s22(cv::Point(0,0), m2.size());
-
-   cv::Rect s3 = s11 & s22;
-
-   cv::Mat m11 = m1(s3);
-   cv::Mat m22 = m2(s3);
-
-   double res = cv::norm(m11.reshape(1), m22.reshape(1), cv::NORM_HAMMING);
-   res /= m11.total() * (size_t)m11.channels();
+   return compute_patch_cost(get_kernel(image1_.type()), image1_, image2_,
+                             pixel1_.x, pixel1_.y, pixel2_.x, pixel2_.y, half_patch_size_);
+}
 
+MatchCost::Kernel
+HammingCost::get_kernel(int type_) const
+{
+   CV_Assert(CV_MAT_DEPTH(type_) == CV_8U);
+
+   Kernel res = nullptr;
+   switch (CV_MAT_CN(type_))
+   {
+      case 1:   res = hamming_kernel<1>;   break; // rank transform, census transform 3x3
+      case 3:   res = hamming_kernel<3>;   break; // census transform 5x5
+      case 9:   res = hamming_kernel<9>;   break; // census transform 5x5, color
+      case 25:  res = hamming_kernel<25>;  break; // complete rank transform 5x5
+      case 75:  res = hamming_kernel<75>;  break; // complete census transform 5x5
+      case 128: res = hamming_kernel<128>; break; // SIFT
+      default:  res = hamming_kernel<0>;   break;
+   }
    return res;
 }
 
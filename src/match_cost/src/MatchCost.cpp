@@ -19,6 +19,7 @@
 #include "SsdCost.hpp"
 #include "SadCost.hpp"
 #include "HammingCost.hpp"
+#include "PackedHammingCost.hpp"
 
 std::string
 match_cost_type_to_string(MatchCostType type_)
@@ -35,6 +36,9 @@ match_cost_type_to_string(MatchCostType type_)
       case E_COST_TYPE_HAMMING:
          res = "Hamming";
          break;
+      case E_COST_TYPE_PACKED_HAMMING:
+         res = "Packed Hamming";
+         break;
       default:
          res = "Unknown";
          break;
@@ -59,6 +63,10 @@ MatchCost::create(const cv::String& name_)
    {
       res = cv::makePtr<HammingCost>();
    }
+   else if ((name == "packed_hamming") || (name == "popcount"))
+   {
+      res = cv::makePtr<PackedHammingCost>();
+   }
 
    return res;
 }
@@ -78,6 +86,9 @@ MatchCost::create(MatchCostType type_)
       case E_COST_TYPE_HAMMING:
          res = cv::makePtr<HammingCost>();
          break;
+      case E_COST_TYPE_PACKED_HAMMING:
+         res = cv::makePtr<PackedHammingCost>();
+         break;
       default:
          CV_Assert(false); // unreachable code
          break;
@@ -86,3 +97,27 @@ MatchCost::create(MatchCostType type_)
 
    return res;
 }
+
+int
+MatchCost::compute_cost_batch(
+      const cv::Mat& image1_,
+      const cv::Mat& image2_,
+      const cv::Point& pixel1_,
+      const std::vector<cv::Point>& candidates_,
+      std::vector<float>& costs_,
+      int half_patch_size_,
+      float bound_
+) const
+{
+   CV_Assert(image1_.type() == image2_.type());
+
+   cv::Rect r1(cv::Point(0,0), image1_.size());
+   CV_Assert(r1.contains(pixel1_));
+
+   costs_.resize(candidates_.size());
+   if (candidates_.empty()) return 0;
+
+   return compute_cost_batch(get_kernel(image1_.type()), image1_, image2_, pixel1_.x, pixel1_.y,
+                             candidates_.data(), (int)candidates_.size(), costs_.data(),
+                             half_patch_size_, bound_);
+}
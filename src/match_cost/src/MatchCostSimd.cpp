@@ -0,0 +1,795 @@
+/*  ---------------------------------------------------------------------
+    Copyright 2017 Fangjun Kuang
+    email: csukuangfj at gmail dot com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a COPYING file of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>
+    -----------------------------------------------------------------  */
+#include <stdint.h>
+#include <cstring>
+
+#include "MatchCostSimd.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#  define KFJ_MATCH_COST_X86 1
+#  include <immintrin.h>
+#  define KFJ_TARGET(isa) __attribute__((target(isa)))
+#else
+#  define KFJ_MATCH_COST_X86 0
+#endif
+
+bool
+is_match_cost_simd_supported(MatchCostSimd simd_)
+{
+   bool res = false;
+   switch (simd_)
+   {
+      case E_SIMD_NONE:
+         res = true;
+         break;
+      case E_SIMD_SSE2:
+         res = KFJ_MATCH_COST_X86 && cv::checkHardwareSupport(CV_CPU_SSE2);
+         break;
+      case E_SIMD_AVX2:
+         res = KFJ_MATCH_COST_X86 && cv::checkHardwareSupport(CV_CPU_AVX2);
+         break;
+      case E_SIMD_AVX512:
+         res = KFJ_MATCH_COST_X86 && cv::checkHardwareSupport(CV_CPU_AVX_512F)
+                                  && cv::checkHardwareSupport(CV_CPU_AVX_512BW);
+         break;
+      default:
+         break;
+   }
+   return res;
+}
+
+MatchCostSimd
+get_match_cost_simd()
+{
+   MatchCostSimd res = E_SIMD_NONE;
+   if (!cv::useOptimized())
+   {
+      res = E_SIMD_NONE;
+   }
+   else if (is_match_cost_simd_supported(E_SIMD_AVX512))
+   {
+      res = E_SIMD_AVX512;
+   }
+   else if (is_match_cost_simd_supported(E_SIMD_AVX2))
+   {
+      res = E_SIMD_AVX2;
+   }
+   else if (is_match_cost_simd_supported(E_SIMD_SSE2))
+   {
+      res = E_SIMD_SSE2;
+   }
+   return res;
+}
+
+bool
+is_match_cost_popcount_supported(MatchCostPopcount popcount_)
+{
+   bool res = false;
+   switch (popcount_)
+   {
+      case E_POPCOUNT_NONE:
+         res = true;
+         break;
+      case E_POPCOUNT_POPCNT:
+         res = KFJ_MATCH_COST_X86 && cv::checkHardwareSupport(CV_CPU_POPCNT);
+         break;
+      case E_POPCOUNT_AVX512:
+         // OpenCV before 3.4 cannot detect VPOPCNTDQ, POPCNT is used instead
+#ifdef CV_CPU_AVX_512VPOPCNTDQ
+         res = KFJ_MATCH_COST_X86 && cv::checkHardwareSupport(CV_CPU_AVX_512F)
+                                  && cv::checkHardwareSupport(CV_CPU_AVX_512VPOPCNTDQ);
+#endif
+         break;
+      default:
+         break;
+   }
+   return res;
+}
+
+MatchCostPopcount
+get_match_cost_popcount()
+{
+   MatchCostPopcount res = E_POPCOUNT_NONE;
+   if (!cv::useOptimized())
+   {
+      res = E_POPCOUNT_NONE;
+   }
+   else if (is_match_cost_popcount_supported(E_POPCOUNT_AVX512))
+   {
+      res = E_POPCOUNT_AVX512;
+   }
+   else if (is_match_cost_popcount_supported(E_POPCOUNT_POPCNT))
+   {
+      res = E_POPCOUNT_POPCNT;
+   }
+   return res;
+}
+
+//========================================
+//    plain C++
+//----------------------------------------
+unsigned
+sad_8u_scalar(const uchar* a_, const uchar* b_, int len_)
+{
+   unsigned sum = 0;
+   for (int i = 0; i < len_; i++)
+   {
+      int d = (int)a_[i] - (int)b_[i];
+      sum += (unsigned)((d >= 0) ? d : -d);
+   }
+   return sum;
+}
+
+unsigned
+ssd_8u_scalar(const uchar* a_, const uchar* b_, int len_)
+{
+   unsigned sum = 0;
+   for (int i = 0; i < len_; i++)
+   {
+      int d = (int)a_[i] - (int)b_[i];
+      sum += (unsigned)(d*d);
+   }
+   return sum;
+}
+
+void
+sad4_8u_scalar(const uchar* a_, const uchar* b_, size_t step_, size_t shift_, int len_, unsigned sums_[4])
+{
+   const uchar* b[4] = {b_, b_ + shift_, b_ + step_, b_ + step_ + shift_};
+   unsigned sum[4] = {0, 0, 0, 0};
+   for (int i = 0; i < len_; i++)
+   {
+      int a = a_[i]; // loaded once for the four targets
+      for (int k = 0; k < 4; k++)
+      {
+         int d = a - (int)b[k][i];
+         sum[k] += (unsigned)((d >= 0) ? d : -d);
+      }
+   }
+   for (int k = 0; k < 4; k++) sums_[k] = sum[k];
+}
+
+void
+ssd4_8u_scalar(const uchar* a_, const uchar* b_, size_t step_, size_t shift_, int len_, unsigned sums_[4])
+{
+   const uchar* b[4] = {b_, b_ + shift_, b_ + step_, b_ + step_ + shift_};
+   unsigned sum[4] = {0, 0, 0, 0};
+   for (int i = 0; i < len_; i++)
+   {
+      int a = a_[i];
+      for (int k = 0; k < 4; k++)
+      {
+         int d = a - (int)b[k][i];
+         sum[k] += (unsigned)(d*d);
+      }
+   }
+   for (int k = 0; k < 4; k++) sums_[k] = sum[k];
+}
+
+unsigned
+sad_8s_scalar(const schar* a_, const schar* b_, int len_)
+{
+   unsigned sum = 0;
+   for (int i = 0; i < len_; i++)
+   {
+      int d = (int)a_[i] - (int)b_[i];
+      sum += (unsigned)((d >= 0) ? d : -d);
+   }
+   return sum;
+}
+
+unsigned
+ssd_8s_scalar(const schar* a_, const schar* b_, int len_)
+{
+   unsigned sum = 0;
+   for (int i = 0; i < len_; i++)
+   {
+      int d = (int)a_[i] - (int)b_[i];
+      sum += (unsigned)(d*d);
+   }
+   return sum;
+}
+
+unsigned
+hamming_32u_scalar(const uint32_t* a_, const uint32_t* b_, int len_)
+{
+   unsigned sum = 0;
+   for (int i = 0; i < len_; i++)
+   {
+      uint32_t v = a_[i] ^ b_[i];
+      v = v - ((v >> 1) & 0x55555555u);
+      v = (v & 0x33333333u) + ((v >> 2) & 0x33333333u);
+      v = (v + (v >> 4)) & 0x0f0f0f0fu;
+      sum += (v * 0x01010101u) >> 24;
+   }
+   return sum;
+}
+
+#if KFJ_MATCH_COST_X86
+
+//========================================
+//    SSE2
+//----------------------------------------
+KFJ_TARGET("sse2") unsigned
+sad_8u_sse2(const uchar* a_, const uchar* b_, int len_)
+{
+   int i = 0;
+   __m128i acc = _mm_setzero_si128();
+   for (; i <= len_ - 16; i += 16)
+   {
+      __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a_ + i));
+      __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b_ + i));
+      acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb)); // two partial sums in the lower 32 bits of each 64-bit lane
+   }
+
+   unsigned sum = (unsigned)_mm_cvtsi128_si32(acc) + (unsigned)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+   return sum + sad_8u_scalar(a_ + i, b_ + i, len_ - i);
+}
+
+KFJ_TARGET("sse2") unsigned
+ssd_8u_sse2(const uchar* a_, const uchar* b_, int len_)
+{
+   int i = 0;
+   __m128i zero = _mm_setzero_si128();
+   __m128i acc = _mm_setzero_si128();
+   for (; i <= len_ - 16; i += 16)
+   {
+      __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a_ + i));
+      __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b_ + i));
+
+      // differences in 16 bits, squares and pairwise sums in 32 bits
+      __m128i d_lo = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+      __m128i d_hi = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(d_lo, d_lo));
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(d_hi, d_hi));
+   }
+
+   acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 8));
+   acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 4));
+   unsigned sum = (unsigned)_mm_cvtsi128_si32(acc);
+   return sum + ssd_8u_scalar(a_ + i, b_ + i, len_ - i);
+}
+
+KFJ_TARGET("sse2") void
+sad4_8u_sse2(const uchar* a_, const uchar* b_, size_t step_, size_t shift_, int len_, unsigned sums_[4])
+{
+   const uchar* b[4] = {b_, b_ + shift_, b_ + step_, b_ + step_ + shift_};
+   __m128i acc[4] = {_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128()};
+
+   int i = 0;
+   for (; i <= len_ - 16; i += 16)
+   {
+      __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a_ + i));
+      for (int k = 0; k < 4; k++)
+      {
+         __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b[k] + i));
+         acc[k] = _mm_add_epi64(acc[k], _mm_sad_epu8(va, vb));
+      }
+   }
+
+   sad4_8u_scalar(a_ + i, b_ + i, step_, shift_, len_ - i, sums_);
+   for (int k = 0; k < 4; k++)
+   {
+      sums_[k] += (unsigned)_mm_cvtsi128_si32(acc[k]) + (unsigned)_mm_cvtsi128_si32(_mm_srli_si128(acc[k], 8));
+   }
+}
+
+KFJ_TARGET("sse2") void
+ssd4_8u_sse2(const uchar* a_, const uchar* b_, size_t step_, size_t shift_, int len_, unsigned sums_[4])
+{
+   const uchar* b[4] = {b_, b_ + shift_, b_ + step_, b_ + step_ + shift_};
+   __m128i zero = _mm_setzero_si128();
+   __m128i acc[4] = {zero, zero, zero, zero};
+
+   int i = 0;
+   for (; i <= len_ - 16; i += 16)
+   {
+      // the first row is widened once for the four targets
+      __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a_ + i));
+      __m128i a_lo = _mm_unpacklo_epi8(va, zero);
+      __m128i a_hi = _mm_unpackhi_epi8(va, zero);
+      for (int k = 0; k < 4; k++)
+      {
+         __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b[k] + i));
+         __m128i d_lo = _mm_sub_epi16(a_lo, _mm_unpacklo_epi8(vb, zero));
+         __m128i d_hi = _mm_sub_epi16(a_hi, _mm_unpackhi_epi8(vb, zero));
+         acc[k] = _mm_add_epi32(acc[k], _mm_madd_epi16(d_lo, d_lo));
+         acc[k] = _mm_add_epi32(acc[k], _mm_madd_epi16(d_hi, d_hi));
+      }
+   }
+
+   ssd4_8u_scalar(a_ + i, b_ + i, step_, shift_, len_ - i, sums_);
+   for (int k = 0; k < 4; k++)
+   {
+      __m128i v = _mm_add_epi32(acc[k], _mm_srli_si128(acc[k], 8));
+      v = _mm_add_epi32(v, _mm_srli_si128(v, 4));
+      sums_[k] += (unsigned)_mm_cvtsi128_si32(v);
+   }
+}
+
+// flipping the sign bits maps int8 in [-128, 127] onto uint8 in [0, 255]
+// and keeps the differences, so the int8 kernels reuse the uint8 instructions
+KFJ_TARGET("sse2") unsigned
+sad_8s_sse2(const schar* a_, const schar* b_, int len_)
+{
+   int i = 0;
+   __m128i bias = _mm_set1_epi8((char)0x80);
+   __m128i acc = _mm_setzero_si128();
+   for (; i <= len_ - 16; i += 16)
+   {
+      __m128i va = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a_ + i)), bias);
+      __m128i vb = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b_ + i)), bias);
+      acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+   }
+
+   unsigned sum = (unsigned)_mm_cvtsi128_si32(acc) + (unsigned)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+   return sum + sad_8s_scalar(a_ + i, b_ + i, len_ - i);
+}
+
+KFJ_TARGET("sse2") unsigned
+ssd_8s_sse2(const schar* a_, const schar* b_, int len_)
+{
+   int i = 0;
+   __m128i bias = _mm_set1_epi8((char)0x80);
+   __m128i zero = _mm_setzero_si128();
+   __m128i acc = _mm_setzero_si128();
+   for (; i <= len_ - 16; i += 16)
+   {
+      __m128i va = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a_ + i)), bias);
+      __m128i vb = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b_ + i)), bias);
+
+      __m128i d_lo = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+      __m128i d_hi = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(d_lo, d_lo));
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(d_hi, d_hi));
+   }
+
+   acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 8));
+   acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 4));
+   unsigned sum = (unsigned)_mm_cvtsi128_si32(acc);
+   return sum + ssd_8s_scalar(a_ + i, b_ + i, len_ - i);
+}
+
+//========================================
+//    AVX2
+//----------------------------------------
+KFJ_TARGET("avx2") unsigned
+sad_8u_avx2(const uchar* a_, const uchar* b_, int len_)
+{
+   int i = 0;
+   __m256i acc = _mm256_setzero_si256();
+   for (; i <= len_ - 32; i += 32)
+   {
+      __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a_ + i));
+      __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b_ + i));
+      acc = _mm256_add_epi64(acc, _mm256_sad_epu8(va, vb));
+   }
+
+   __m128i acc128 = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+   unsigned sum = (unsigned)_mm_cvtsi128_si32(acc128) + (unsigned)_mm_cvtsi128_si32(_mm_srli_si128(acc128, 8));
+   return sum + sad_8u_sse2(a_ + i, b_ + i, len_ - i);
+}
+
+KFJ_TARGET("avx2") unsigned
+ssd_8u_avx2(const uchar* a_, const uchar* b_, int len_)
+{
+   int i = 0;
+   __m256i zero = _mm256_setzero_si256();
+   __m256i acc = _mm256_setzero_si256();
+   for (; i <= len_ - 32; i += 32)
+   {
+      __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a_ + i));
+      __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b_ + i));
+
+      // unpacking works within 128-bit lanes, which does not matter for a sum
+      __m256i d_lo = _mm256_sub_epi16(_mm256_unpacklo_epi8(va, zero), _mm256_unpacklo_epi8(vb, zero));
+      __m256i d_hi = _mm256_sub_epi16(_mm256_unpackhi_epi8(va, zero), _mm256_unpackhi_epi8(vb, zero));
+      acc = _mm256_add_epi32(acc, _mm256_madd_epi16(d_lo, d_lo));
+      acc = _mm256_add_epi32(acc, _mm256_madd_epi16(d_hi, d_hi));
+   }
+
+   __m128i acc128 = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+   acc128 = _mm_add_epi32(acc128, _mm_srli_si128(acc128, 8));
+   acc128 = _mm_add_epi32(acc128, _mm_srli_si128(acc128, 4));
+   unsigned sum = (unsigned)_mm_cvtsi128_si32(acc128);
+   return sum + ssd_8u_sse2(a_ + i, b_ + i, len_ - i);
+}
+
+KFJ_TARGET("avx2") void
+sad4_8u_avx2(const uchar* a_, const uchar* b_, size_t step_, size_t shift_, int len_, unsigned sums_[4])
+{
+   const uchar* b[4] = {b_, b_ + shift_, b_ + step_, b_ + step_ + shift_};
+   __m256i zero = _mm256_setzero_si256();
+   __m256i acc[4] = {zero, zero, zero, zero};
+
+   int i = 0;
+   for (; i <= len_ - 32; i += 32)
+   {
+      __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a_ + i));
+      for (int k = 0; k < 4; k++)
+      {
+         __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b[k] + i));
+         acc[k] = _mm256_add_epi64(acc[k], _mm256_sad_epu8(va, vb));
+      }
+   }
+
+   sad4_8u_sse2(a_ + i, b_ + i, step_, shift_, len_ - i, sums_);
+   for (int k = 0; k < 4; k++)
+   {
+      __m128i v = _mm_add_epi64(_mm256_castsi256_si128(acc[k]), _mm256_extracti128_si256(acc[k], 1));
+      sums_[k] += (unsigned)_mm_cvtsi128_si32(v) + (unsigned)_mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+   }
+}
+
+KFJ_TARGET("avx2") void
+ssd4_8u_avx2(const uchar* a_, const uchar* b_, size_t step_, size_t shift_, int len_, unsigned sums_[4])
+{
+   const uchar* b[4] = {b_, b_ + shift_, b_ + step_, b_ + step_ + shift_};
+   __m256i zero = _mm256_setzero_si256();
+   __m256i acc[4] = {zero, zero, zero, zero};
+
+   int i = 0;
+   for (; i <= len_ - 32; i += 32)
+   {
+      __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a_ + i));
+      __m256i a_lo = _mm256_unpacklo_epi8(va, zero);
+      __m256i a_hi = _mm256_unpackhi_epi8(va, zero);
+      for (int k = 0; k < 4; k++)
+      {
+         __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b[k] + i));
+         __m256i d_lo = _mm256_sub_epi16(a_lo, _mm256_unpacklo_epi8(vb, zero));
+         __m256i d_hi = _mm256_sub_epi16(a_hi, _mm256_unpackhi_epi8(vb, zero));
+         acc[k] = _mm256_add_epi32(acc[k], _mm256_madd_epi16(d_lo, d_lo));
+         acc[k] = _mm256_add_epi32(acc[k], _mm256_madd_epi16(d_hi, d_hi));
+      }
+   }
+
+   ssd4_8u_sse2(a_ + i, b_ + i, step_, shift_, len_ - i, sums_);
+   for (int k = 0; k < 4; k++)
+   {
+      __m128i v = _mm_add_epi32(_mm256_castsi256_si128(acc[k]), _mm256_extracti128_si256(acc[k], 1));
+      v = _mm_add_epi32(v, _mm_srli_si128(v, 8));
+      v = _mm_add_epi32(v, _mm_srli_si128(v, 4));
+      sums_[k] += (unsigned)_mm_cvtsi128_si32(v);
+   }
+}
+
+KFJ_TARGET("avx2") unsigned
+sad_8s_avx2(const schar* a_, const schar* b_, int len_)
+{
+   int i = 0;
+   __m256i bias = _mm256_set1_epi8((char)0x80);
+   __m256i acc = _mm256_setzero_si256();
+   for (; i <= len_ - 32; i += 32)
+   {
+      __m256i va = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a_ + i)), bias);
+      __m256i vb = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b_ + i)), bias);
+      acc = _mm256_add_epi64(acc, _mm256_sad_epu8(va, vb));
+   }
+
+   __m128i acc128 = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+   unsigned sum = (unsigned)_mm_cvtsi128_si32(acc128) + (unsigned)_mm_cvtsi128_si32(_mm_srli_si128(acc128, 8));
+   return sum + sad_8s_sse2(a_ + i, b_ + i, len_ - i);
+}
+
+KFJ_TARGET("avx2") unsigned
+ssd_8s_avx2(const schar* a_, const schar* b_, int len_)
+{
+   int i = 0;
+   __m256i bias = _mm256_set1_epi8((char)0x80);
+   __m256i zero = _mm256_setzero_si256();
+   __m256i acc = _mm256_setzero_si256();
+   for (; i <= len_ - 32; i += 32)
+   {
+      __m256i va = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a_ + i)), bias);
+      __m256i vb = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b_ + i)), bias);
+
+      __m256i d_lo = _mm256_sub_epi16(_mm256_unpacklo_epi8(va, zero), _mm256_unpacklo_epi8(vb, zero));
+      __m256i d_hi = _mm256_sub_epi16(_mm256_unpackhi_epi8(va, zero), _mm256_unpackhi_epi8(vb, zero));
+      acc = _mm256_add_epi32(acc, _mm256_madd_epi16(d_lo, d_lo));
+      acc = _mm256_add_epi32(acc, _mm256_madd_epi16(d_hi, d_hi));
+   }
+
+   __m128i acc128 = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+   acc128 = _mm_add_epi32(acc128, _mm_srli_si128(acc128, 8));
+   acc128 = _mm_add_epi32(acc128, _mm_srli_si128(acc128, 4));
+   unsigned sum = (unsigned)_mm_cvtsi128_si32(acc128);
+   return sum + ssd_8s_sse2(a_ + i, b_ + i, len_ - i);
+}
+
+//========================================
+//    AVX-512
+//----------------------------------------
+
+/**
+ * Mask for loading the remaining n_ bytes, 0 < n_ < 64
+ */
+KFJ_TARGET("avx512f,avx512bw") static inline __mmask64
+tail_mask_64(int n_)
+{
+   return (__mmask64)((1ULL << n_) - 1);
+}
+
+KFJ_TARGET("avx512f,avx512bw") unsigned
+sad_8u_avx512(const uchar* a_, const uchar* b_, int len_)
+{
+   int i = 0;
+   __m512i acc = _mm512_setzero_si512();
+   for (; i <= len_ - 64; i += 64)
+   {
+      __m512i va = _mm512_loadu_si512(a_ + i);
+      __m512i vb = _mm512_loadu_si512(b_ + i);
+      acc = _mm512_add_epi64(acc, _mm512_sad_epu8(va, vb));
+   }
+
+   if (i < len_)
+   {
+      // masked out bytes are zero in both rows and do not contribute
+      __mmask64 m = tail_mask_64(len_ - i);
+      __m512i va = _mm512_maskz_loadu_epi8(m, a_ + i);
+      __m512i vb = _mm512_maskz_loadu_epi8(m, b_ + i);
+      acc = _mm512_add_epi64(acc, _mm512_sad_epu8(va, vb));
+   }
+
+   alignas(64) uint64_t lanes[8];
+   _mm512_store_si512(lanes, acc);
+
+   uint64_t sum = 0;
+   for (int k = 0; k < 8; k++) sum += lanes[k];
+   return (unsigned)sum;
+}
+
+KFJ_TARGET("avx512f,avx512bw") unsigned
+ssd_8u_avx512(const uchar* a_, const uchar* b_, int len_)
+{
+   int i = 0;
+   __m512i zero = _mm512_setzero_si512();
+   __m512i acc = _mm512_setzero_si512();
+   for (; i < len_; i += 64)
+   {
+      __m512i va, vb;
+      if (i <= len_ - 64)
+      {
+         va = _mm512_loadu_si512(a_ + i);
+         vb = _mm512_loadu_si512(b_ + i);
+      }
+      else
+      {
+         __mmask64 m = tail_mask_64(len_ - i);
+         va = _mm512_maskz_loadu_epi8(m, a_ + i);
+         vb = _mm512_maskz_loadu_epi8(m, b_ + i);
+      }
+
+      __m512i d_lo = _mm512_sub_epi16(_mm512_unpacklo_epi8(va, zero), _mm512_unpacklo_epi8(vb, zero));
+      __m512i d_hi = _mm512_sub_epi16(_mm512_unpackhi_epi8(va, zero), _mm512_unpackhi_epi8(vb, zero));
+      acc = _mm512_add_epi32(acc, _mm512_madd_epi16(d_lo, d_lo));
+      acc = _mm512_add_epi32(acc, _mm512_madd_epi16(d_hi, d_hi));
+   }
+
+   alignas(64) uint32_t lanes[16];
+   _mm512_store_si512(lanes, acc);
+
+   unsigned sum = 0;
+   for (int k = 0; k < 16; k++) sum += lanes[k];
+   return sum;
+}
+
+KFJ_TARGET("avx512f,avx512bw") void
+sad4_8u_avx512(const uchar* a_, const uchar* b_, size_t step_, size_t shift_, int len_, unsigned sums_[4])
+{
+   const uchar* b[4] = {b_, b_ + shift_, b_ + step_, b_ + step_ + shift_};
+   __m512i zero = _mm512_setzero_si512();
+   __m512i acc[4] = {zero, zero, zero, zero};
+
+   for (int i = 0; i < len_; i += 64)
+   {
+      __mmask64 m = (i <= len_ - 64) ? ~(__mmask64)0 : tail_mask_64(len_ - i);
+      __m512i va = _mm512_maskz_loadu_epi8(m, a_ + i);
+      for (int k = 0; k < 4; k++)
+      {
+         __m512i vb = _mm512_maskz_loadu_epi8(m, b[k] + i);
+         acc[k] = _mm512_add_epi64(acc[k], _mm512_sad_epu8(va, vb));
+      }
+   }
+
+   for (int k = 0; k < 4; k++)
+   {
+      alignas(64) uint64_t lanes[8];
+      _mm512_store_si512(lanes, acc[k]);
+
+      uint64_t sum = 0;
+      for (int j = 0; j < 8; j++) sum += lanes[j];
+      sums_[k] = (unsigned)sum;
+   }
+}
+
+KFJ_TARGET("avx512f,avx512bw") void
+ssd4_8u_avx512(const uchar* a_, const uchar* b_, size_t step_, size_t shift_, int len_, unsigned sums_[4])
+{
+   const uchar* b[4] = {b_, b_ + shift_, b_ + step_, b_ + step_ + shift_};
+   __m512i zero = _mm512_setzero_si512();
+   __m512i acc[4] = {zero, zero, zero, zero};
+
+   for (int i = 0; i < len_; i += 64)
+   {
+      __mmask64 m = (i <= len_ - 64) ? ~(__mmask64)0 : tail_mask_64(len_ - i);
+      __m512i va = _mm512_maskz_loadu_epi8(m, a_ + i);
+      __m512i a_lo = _mm512_unpacklo_epi8(va, zero);
+      __m512i a_hi = _mm512_unpackhi_epi8(va, zero);
+      for (int k = 0; k < 4; k++)
+      {
+         __m512i vb = _mm512_maskz_loadu_epi8(m, b[k] + i);
+         __m512i d_lo = _mm512_sub_epi16(a_lo, _mm512_unpacklo_epi8(vb, zero));
+         __m512i d_hi = _mm512_sub_epi16(a_hi, _mm512_unpackhi_epi8(vb, zero));
+         acc[k] = _mm512_add_epi32(acc[k], _mm512_madd_epi16(d_lo, d_lo));
+         acc[k] = _mm512_add_epi32(acc[k], _mm512_madd_epi16(d_hi, d_hi));
+      }
+   }
+
+   for (int k = 0; k < 4; k++)
+   {
+      alignas(64) uint32_t lanes[16];
+      _mm512_store_si512(lanes, acc[k]);
+
+      unsigned sum = 0;
+      for (int j = 0; j < 16; j++) sum += lanes[j];
+      sums_[k] = sum;
+   }
+}
+
+//========================================
+//    popcnt
+//----------------------------------------
+KFJ_TARGET("popcnt") unsigned
+hamming_32u_popcnt(const uint32_t* a_, const uint32_t* b_, int len_)
+{
+   int i = 0;
+   unsigned sum = 0;
+   for (; i <= len_ - 2; i += 2)
+   {
+      uint64_t a, b;
+      memcpy(&a, a_ + i, sizeof(a));
+      memcpy(&b, b_ + i, sizeof(b));
+      sum += (unsigned)__builtin_popcountll(a ^ b);
+   }
+
+   if (i < len_)
+   {
+      sum += (unsigned)__builtin_popcount(a_[i] ^ b_[i]);
+   }
+   return sum;
+}
+
+//========================================
+//    AVX-512 VPOPCNTDQ
+//----------------------------------------
+KFJ_TARGET("avx512f,avx512vpopcntdq") unsigned
+hamming_32u_avx512(const uint32_t* a_, const uint32_t* b_, int len_)
+{
+   int i = 0;
+   __m512i acc = _mm512_setzero_si512();
+   for (; i < len_; i += 16)
+   {
+      __m512i va, vb;
+      if (i <= len_ - 16)
+      {
+         va = _mm512_loadu_si512(a_ + i);
+         vb = _mm512_loadu_si512(b_ + i);
+      }
+      else
+      {
+         __mmask16 m = (__mmask16)((1u << (len_ - i)) - 1);
+         va = _mm512_maskz_loadu_epi32(m, a_ + i);
+         vb = _mm512_maskz_loadu_epi32(m, b_ + i);
+      }
+      acc = _mm512_add_epi32(acc, _mm512_popcnt_epi32(_mm512_xor_si512(va, vb)));
+   }
+
+   alignas(64) uint32_t lanes[16];
+   _mm512_store_si512(lanes, acc);
+
+   unsigned sum = 0;
+   for (int k = 0; k < 16; k++) sum += lanes[k];
+   return sum;
+}
+
+KFJ_TARGET("avx512f,avx512bw") unsigned
+sad_8s_avx512(const schar* a_, const schar* b_, int len_)
+{
+   __m512i bias = _mm512_set1_epi8((char)0x80);
+   __m512i acc = _mm512_setzero_si512();
+   for (int i = 0; i < len_; i += 64)
+   {
+      // masked out bytes are 0x80 in both rows after the flip and do not contribute
+      __mmask64 m = (i <= len_ - 64) ? ~(__mmask64)0 : tail_mask_64(len_ - i);
+      __m512i va = _mm512_xor_si512(_mm512_maskz_loadu_epi8(m, a_ + i), bias);
+      __m512i vb = _mm512_xor_si512(_mm512_maskz_loadu_epi8(m, b_ + i), bias);
+      acc = _mm512_add_epi64(acc, _mm512_sad_epu8(va, vb));
+   }
+
+   alignas(64) uint64_t lanes[8];
+   _mm512_store_si512(lanes, acc);
+
+   uint64_t sum = 0;
+   for (int k = 0; k < 8; k++) sum += lanes[k];
+   return (unsigned)sum;
+}
+
+KFJ_TARGET("avx512f,avx512bw") unsigned
+ssd_8s_avx512(const schar* a_, const schar* b_, int len_)
+{
+   __m512i bias = _mm512_set1_epi8((char)0x80);
+   __m512i zero = _mm512_setzero_si512();
+   __m512i acc = _mm512_setzero_si512();
+   for (int i = 0; i < len_; i += 64)
+   {
+      __mmask64 m = (i <= len_ - 64) ? ~(__mmask64)0 : tail_mask_64(len_ - i);
+      __m512i va = _mm512_xor_si512(_mm512_maskz_loadu_epi8(m, a_ + i), bias);
+      __m512i vb = _mm512_xor_si512(_mm512_maskz_loadu_epi8(m, b_ + i), bias);
+
+      __m512i d_lo = _mm512_sub_epi16(_mm512_unpacklo_epi8(va, zero), _mm512_unpacklo_epi8(vb, zero));
+      __m512i d_hi = _mm512_sub_epi16(_mm512_unpackhi_epi8(va, zero), _mm512_unpackhi_epi8(vb, zero));
+      acc = _mm512_add_epi32(acc, _mm512_madd_epi16(d_lo, d_lo));
+      acc = _mm512_add_epi32(acc, _mm512_madd_epi16(d_hi, d_hi));
+   }
+
+   alignas(64) uint32_t lanes[16];
+   _mm512_store_si512(lanes, acc);
+
+   unsigned sum = 0;
+   for (int k = 0; k < 16; k++) sum += lanes[k];
+   return sum;
+}
+
+#else // KFJ_MATCH_COST_X86
+
+// the vectorized kernels are never selected on other architectures
+unsigned sad_8u_sse2(const uchar* a_, const uchar* b_, int len_)   {return sad_8u_scalar(a_, b_, len_);}
+unsigned sad_8u_avx2(const uchar* a_, const uchar* b_, int len_)   {return sad_8u_scalar(a_, b_, len_);}
+unsigned sad_8u_avx512(const uchar* a_, const uchar* b_, int len_) {return sad_8u_scalar(a_, b_, len_);}
+
+unsigned ssd_8u_sse2(const uchar* a_, const uchar* b_, int len_)   {return ssd_8u_scalar(a_, b_, len_);}
+unsigned ssd_8u_avx2(const uchar* a_, const uchar* b_, int len_)   {return ssd_8u_scalar(a_, b_, len_);}
+unsigned ssd_8u_avx512(const uchar* a_, const uchar* b_, int len_) {return ssd_8u_scalar(a_, b_, len_);}
+
+unsigned sad_8s_sse2(const schar* a_, const schar* b_, int len_)   {return sad_8s_scalar(a_, b_, len_);}
+unsigned sad_8s_avx2(const schar* a_, const schar* b_, int len_)   {return sad_8s_scalar(a_, b_, len_);}
+unsigned sad_8s_avx512(const schar* a_, const schar* b_, int len_) {return sad_8s_scalar(a_, b_, len_);}
+
+unsigned ssd_8s_sse2(const schar* a_, const schar* b_, int len_)   {return ssd_8s_scalar(a_, b_, len_);}
+unsigned ssd_8s_avx2(const schar* a_, const schar* b_, int len_)   {return ssd_8s_scalar(a_, b_, len_);}
+unsigned ssd_8s_avx512(const schar* a_, const schar* b_, int len_) {return ssd_8s_scalar(a_, b_, len_);}
+
+void sad4_8u_sse2(const uchar* a_, const uchar* b_, size_t step_, size_t shift_, int len_, unsigned sums_[4])
+{sad4_8u_scalar(a_, b_, step_, shift_, len_, sums_);}
+void sad4_8u_avx2(const uchar* a_, const uchar* b_, size_t step_, size_t shift_, int len_, unsigned sums_[4])
+{sad4_8u_scalar(a_, b_, step_, shift_, len_, sums_);}
+void sad4_8u_avx512(const uchar* a_, const uchar* b_, size_t step_, size_t shift_, int len_, unsigned sums_[4])
+{sad4_8u_scalar(a_, b_, step_, shift_, len_, sums_);}
+
+void ssd4_8u_sse2(const uchar* a_, const uchar* b_, size_t step_, size_t shift_, int len_, unsigned sums_[4])
+{ssd4_8u_scalar(a_, b_, step_, shift_, len_, sums_);}
+void ssd4_8u_avx2(const uchar* a_, const uchar* b_, size_t step_, size_t shift_, int len_, unsigned sums_[4])
+{ssd4_8u_scalar(a_, b_, step_, shift_, len_, sums_);}
+void ssd4_8u_avx512(const uchar* a_, const uchar* b_, size_t step_, size_t shift_, int len_, unsigned sums_[4])
+{ssd4_8u_scalar(a_, b_, step_, shift_, len_, sums_);}
+
+unsigned hamming_32u_popcnt(const uint32_t* a_, const uint32_t* b_, int len_) {return hamming_32u_scalar(a_, b_, len_);}
+unsigned hamming_32u_avx512(const uint32_t* a_, const uint32_t* b_, int len_) {return hamming_32u_scalar(a_, b_, len_);}
+
+#endif // KFJ_MATCH_COST_X86
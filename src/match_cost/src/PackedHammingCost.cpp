@@ -0,0 +1,121 @@
+/*  ---------------------------------------------------------------------
+    Copyright 2017 Fangjun Kuang
+    email: csukuangfj at gmail dot com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a COPYING file of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>
+    -----------------------------------------------------------------  */
+#include <cstdint>
+
+#include "PackedHammingCost.hpp"
+#include "MatchCostSimd.hpp"
+
+/**
+ * Average hamming distance of two patches of bit-packed descriptors.
+ *
+ * It is normalized by the number of bytes, as in HammingCost.
+ *
+ * @tparam ROW  hamming_32u_scalar, hamming_32u_popcnt or hamming_32u_avx512
+ */
+template<unsigned (*ROW)(const uint32_t*, const uint32_t*, int)>
+static double
+packed_hamming_kernel(
+      const uchar* p1_,
+      size_t step1_,
+      const uchar* p2_,
+      size_t step2_,
+      int width_,
+      int height_,
+      int cn_,
+      double bound_
+)
+{
+   int len = width_ * cn_;
+
+   double num = (double)((size_t)len * (size_t)height_ * sizeof(uint32_t));
+   double limit = bound_ * num;
+
+   uint64_t sum = 0;
+   for (int y = 0; y < height_; y++)
+   {
+      const uint32_t* a = reinterpret_cast<const uint32_t*>(p1_ + y*step1_);
+      const uint32_t* b = reinterpret_cast<const uint32_t*>(p2_ + y*step2_);
+      sum += ROW(a, b, len);
+
+      // stop once the partial cost cannot be less than the bound
+      if ((double)sum >= limit)
+      {
+         double partial = (double)sum / num;
+         if (partial >= bound_) return partial;
+      }
+   }
+
+   return (double)sum / num;
+}
+
+double
+PackedHammingCost::compute_cost(
+      const cv::Mat& image1_,
+      const cv::Mat& image2_,
+      const cv::Point& pixel1_,
+      const cv::Point& pixel2_,
+      int half_patch_size_
+)
+{
+   CV_Assert(image1_.depth() == CV_32S);
+   CV_Assert(image1_.type() == image2_.type());
+
+   cv::Rect r1(cv::Point(0,0), image1_.size());
+   cv::Rect r2(cv::Point(0,0), image2_.size());
+
+   CV_Assert(r1.contains(pixel1_));
+   CV_Assert(r2.contains(pixel2_));
+
+   return compute_patch_cost(get_kernel(image1_.type()), image1_, image2_,
+                             pixel1_.x, pixel1_.y, pixel2_.x, pixel2_.y, half_patch_size_);
+}
+
+MatchCost::Kernel
+PackedHammingCost::get_kernel(int type_) const
+{
+   CV_Assert(CV_MAT_DEPTH(type_) == CV_32S);
+
+   Kernel res = nullptr;
+   switch (get_match_cost_popcount())
+   {
+      case E_POPCOUNT_AVX512: res = packed_hamming_kernel<hamming_32u_avx512>; break;
+      case E_POPCOUNT_POPCNT: res = packed_hamming_kernel<hamming_32u_popcnt>; break;
+      case E_POPCOUNT_NONE:   res = packed_hamming_kernel<hamming_32u_scalar>; break;
+      default:                res = packed_hamming_kernel<hamming_32u_scalar>; break;
+   }
+   return res;
+}
+
+double
+PackedHammingCost::compute_cost(
+      const cv::Mat &image1_,
+      const cv::Mat &image2_)
+{
+   CV_Assert(image1_.size() == image2_.size());
+   CV_Assert(image1_.type() == image2_.type());
+   CV_Assert(image1_.depth() == CV_32S);
+
+   // cv::norm() supports the hamming distance only for bytes
+   size_t row_bytes = image1_.cols * image1_.elemSize();
+   cv::Mat m1(image1_.rows, (int)row_bytes, CV_8UC1, const_cast<uchar*>(image1_.data), image1_.step);
+   cv::Mat m2(image2_.rows, (int)row_bytes, CV_8UC1, const_cast<uchar*>(image2_.data), image2_.step);
+
+   double res = cv::norm(m1, m2, cv::NORM_HAMMING);
+   res /= row_bytes * (size_t)image1_.rows;
+   return res;
+}
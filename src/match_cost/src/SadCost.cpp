@@ -15,8 +15,244 @@
     You should have received a COPYING file of the GNU General Public License
     along with this program. If not, see <http://www.gnu.org/licenses/>
     -----------------------------------------------------------------  */
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
+
 #include "SadCost.hpp"
+#include "MatchCostSimd.hpp"
+
+/**
+ * Average sum of absolute differences of two patches.
+ *
+ * The accumulator type follows cv::norm: integers are accumulated
+ * exactly and floating points are accumulated in double.
+ *
+ * @tparam T     Element type
+ * @tparam AccT  Accumulator type
+ * @tparam CN    Number of channels. 0 if it is known only at runtime.
+ */
+template<typename T, typename AccT, int CN>
+static double
+sad_kernel(
+      const uchar* p1_,
+      size_t step1_,
+      const uchar* p2_,
+      size_t step2_,
+      int width_,
+      int height_,
+      int cn_,
+      double bound_
+)
+{
+   int cn = (CN > 0) ? CN : cn_;
+   int len = width_ * cn;
+
+   double num = (double)((size_t)len * (size_t)height_);
+   double limit = bound_ * num;
+
+   AccT sum = 0;
+   for (int y = 0; y < height_; y++)
+   {
+      const T* a = reinterpret_cast<const T*>(p1_ + y*step1_);
+      const T* b = reinterpret_cast<const T*>(p2_ + y*step2_);
+      for (int i = 0; i < len; i++)
+      {
+         AccT d = (AccT)(a[i] - b[i]);
+         sum += (d >= 0) ? d : -d;
+      }
+
+      // stop once the partial cost cannot be less than the bound
+      if ((double)sum >= limit)
+      {
+         double partial = (double)sum / num;
+         if (partial >= bound_) return partial;
+      }
+   }
+
+   return (double)sum / num;
+}
+
+/**
+ * Average sum of absolute differences of two uint8 or int8 patches using a vectorized row kernel.
+ *
+ * Rows are processed in chunks of 64 KB so that the 32-bit
+ * row sums cannot overflow.
+ *
+ * @tparam T    uchar or schar
+ * @tparam ROW  sad_8u_xxx for uchar or sad_8s_xxx for schar
+ */
+template<typename T, unsigned (*ROW)(const T*, const T*, int)>
+static double
+sad_kernel_simd(
+      const uchar* p1_,
+      size_t step1_,
+      const uchar* p2_,
+      size_t step2_,
+      int width_,
+      int height_,
+      int cn_,
+      double bound_
+)
+{
+   const int chunk = 1 << 16;
+   int len = width_ * cn_;
+
+   double num = (double)((size_t)len * (size_t)height_);
+   double limit = bound_ * num;
+
+   uint64_t sum = 0;
+   for (int y = 0; y < height_; y++)
+   {
+      const T* a = reinterpret_cast<const T*>(p1_ + y*step1_);
+      const T* b = reinterpret_cast<const T*>(p2_ + y*step2_);
+      for (int i = 0; i < len; i += chunk)
+      {
+         sum += ROW(a + i, b + i, std::min(chunk, len - i));
+      }
+
+      // stop once the partial cost cannot be less than the bound
+      if ((double)sum >= limit)
+      {
+         double partial = (double)sum / num;
+         if (partial >= bound_) return partial;
+      }
+   }
+
+   return (double)sum / num;
+}
+
+/**
+ * Bilinearly interpolated average sum of absolute differences of a uint8 patch and
+ * a 2x2 neighborhood of patches, see MatchCost::BilinearKernel.
+ *
+ * Rows are processed in chunks of 64 KB so that the 32-bit
+ * row sums cannot overflow.
+ *
+ * @tparam ROW4  sad4_8u_scalar, sad4_8u_sse2, sad4_8u_avx2 or sad4_8u_avx512
+ */
+template<void (*ROW4)(const uchar*, const uchar*, size_t, size_t, int, unsigned*)>
+static double
+sad_bilinear_kernel(
+      const uchar* p1_,
+      size_t step1_,
+      const uchar* p2_,
+      size_t step2_,
+      int width_,
+      int height_,
+      int cn_,
+      float wx_,
+      float wy_
+)
+{
+   const int chunk = 1 << 16;
+   int len = width_ * cn_;
+
+   uint64_t sum[4] = {0, 0, 0, 0};
+   for (int y = 0; y < height_; y++)
+   {
+      const uchar* a = p1_ + y*step1_;
+      const uchar* b = p2_ + y*step2_;
+      for (int i = 0; i < len; i += chunk)
+      {
+         unsigned row_sums[4];
+         ROW4(a + i, b + i, step2_, (size_t)cn_, std::min(chunk, len - i), row_sums);
+         for (int k = 0; k < 4; k++) sum[k] += row_sums[k];
+      }
+   }
+
+   double w[4] = {(1.0 - wx_)*(1.0 - wy_), wx_*(1.0 - wy_), (1.0 - wx_)*wy_, (double)wx_*wy_};
+   double res = 0;
+   for (int k = 0; k < 4; k++)
+   {
+      res += w[k] * (double)sum[k];
+   }
+
+   double num = (double)((size_t)len * (size_t)height_);
+   return res / num;
+}
+
+/**
+ * Kernels for uint8 descriptors. The descriptor lengths produced by
+ * SiftDescriptor and MyImageProcessing are known at compile time.
+ *
+ * Descriptors with at least 9 channels use the vectorized kernels
+ * of the best instruction set available at runtime; rows of 1 and 3 channels
+ * are too short to benefit from them.
+ */
+static MatchCost::Kernel
+get_sad_kernel_8u(int cn_)
+{
+   if (cn_ >= 9)
+   {
+      switch (get_match_cost_simd())
+      {
+         case E_SIMD_AVX512: return sad_kernel_simd<uchar, sad_8u_avx512>;
+         case E_SIMD_AVX2:   return sad_kernel_simd<uchar, sad_8u_avx2>;
+         case E_SIMD_SSE2:   return sad_kernel_simd<uchar, sad_8u_sse2>;
+         case E_SIMD_NONE:   break;
+         default:            break;
+      }
+   }
+
+   switch (cn_)
+   {
+      case 1:   return sad_kernel<uchar, int, 1>;   // rank transform, census transform 3x3
+      case 3:   return sad_kernel<uchar, int, 3>;   // census transform 5x5
+      case 9:   return sad_kernel<uchar, int, 9>;   // census transform 5x5, color
+      case 25:  return sad_kernel<uchar, int, 25>;  // complete rank transform 5x5
+      case 75:  return sad_kernel<uchar, int, 75>;  // complete census transform 5x5
+      case 128: return sad_kernel<uchar, int, 128>; // SIFT
+      default:  return sad_kernel<uchar, int, 0>;
+   }
+}
+
+/**
+ * Kernels for int8 descriptors, i.e., the principal components of SIFT.
+ *
+ * Descriptors with at least 9 channels use the vectorized kernels
+ * of the best instruction set available at runtime.
+ */
+static MatchCost::Kernel
+get_sad_kernel_8s(int cn_)
+{
+   if (cn_ >= 9)
+   {
+      switch (get_match_cost_simd())
+      {
+         case E_SIMD_AVX512: return sad_kernel_simd<schar, sad_8s_avx512>;
+         case E_SIMD_AVX2:   return sad_kernel_simd<schar, sad_8s_avx2>;
+         case E_SIMD_SSE2:   return sad_kernel_simd<schar, sad_8s_sse2>;
+         case E_SIMD_NONE:   break;
+         default:            break;
+      }
+   }
+
+   switch (cn_)
+   {
+      case 16:  return sad_kernel<schar, int, 16>; // PCA-SIFT
+      case 32:  return sad_kernel<schar, int, 32>; // PCA-SIFT
+      default:  return sad_kernel<schar, int, 0>;
+   }
+}
+
+/**
+ * Fused bilinear kernels for uint8 descriptors
+ * of the best instruction set available at runtime.
+ */
+static MatchCost::BilinearKernel
+get_sad_bilinear_kernel_8u()
+{
+   switch (get_match_cost_simd())
+   {
+      case E_SIMD_AVX512: return sad_bilinear_kernel<sad4_8u_avx512>;
+      case E_SIMD_AVX2:   return sad_bilinear_kernel<sad4_8u_avx2>;
+      case E_SIMD_SSE2:   return sad_bilinear_kernel<sad4_8u_sse2>;
+      case E_SIMD_NONE:   break;
+      default:            break;
+   }
+   return sad_bilinear_kernel<sad4_8u_scalar>;
+}
 
 double
 SadCost::compute_cost(
@@ -27,32 +263,52 @@ SadCost::compute_cost(
       int half_patch_size_
 )
 {
+   CV_Assert(image1_.type() == image2_.type());
+
    cv::Rect r1(cv::Point(0,0), image1_.size());
    cv::Rect r2(cv::Point(0,0), image2_.size());
 
    CV_Assert(r1.contains(pixel1_));
    CV_Assert(r2.contains(pixel2_));
 
-   // assume that the patch size is square and has an odd side length
-   cv::Rect s1(pixel1_.x - half_patch_size_, pixel1_.y - half_patch_size_, 2*half_patch_size_+1, 2*half_patch_size_+1);
-   cv::Rect s2(pixel2_.x - half_patch_size_, pixel2_.y - half_patch_size_, 2*half_patch_size_+1, 2*half_patch_size_+1);
-
-   s1 &= r1;
-   s2 &= r2;
-
-   cv::Mat m1 = image1_(s1);
-   cv::Mat m2 = image2_(s2);
-
-   cv::Rect s11(cv::Point(0,0), m1.size());
-   cv::Rect s22(cv::Point(0,0), m2.size());
-
-   cv::Rect s3 = s11 & s22;
-
-   cv::Mat m11 = m1(s3);
-   cv::Mat m22 = m2(s3);
+   return compute_patch_cost(get_kernel(image1_.type()), image1_, image2_,
+                             pixel1_.x, pixel1_.y, pixel2_.x, pixel2_.y, half_patch_size_);
+}
 
-   double res = cv::norm(m11, m22, cv::NORM_L1);
-   res /= m11.total() * (size_t)m11.channels();
+MatchCost::Kernel
+SadCost::get_kernel(int type_) const
+{
+   Kernel res = nullptr;
+   int cn = CV_MAT_CN(type_);
+   switch (CV_MAT_DEPTH(type_))
+   {
+      case CV_8U:
+         res = get_sad_kernel_8u(cn);
+         break;
+      case CV_8S:
+         res = get_sad_kernel_8s(cn);
+         break;
+      case CV_16U:
+         res = sad_kernel<ushort, int, 0>;
+         break;
+      case CV_16S:
+         res = sad_kernel<short, int, 0>;
+         break;
+      case CV_32S:
+         res = sad_kernel<int, double, 0>;
+         break;
+      case CV_32F:
+         if (cn == 1)      res = sad_kernel<float, double, 1>;
+         else if (cn == 3) res = sad_kernel<float, double, 3>;
+         else              res = sad_kernel<float, double, 0>;
+         break;
+      case CV_64F:
+         res = sad_kernel<double, double, 0>;
+         break;
+      default:
+         CV_Assert(false); // unsupported type
+         break;
+   }
    return res;
 }
 
@@ -69,3 +325,10 @@ SadCost::compute_cost(
    res /= image1_.total() * (size_t)image2_.channels();
    return res;
 }
+
+MatchCost::BilinearKernel
+SadCost::get_bilinear_kernel(int type_) const
+{
+   // other types interpolate the costs of get_kernel()
+   return (CV_MAT_DEPTH(type_) == CV_8U) ? get_sad_bilinear_kernel_8u() : nullptr;
+}
@@ -0,0 +1,144 @@
+/*  ---------------------------------------------------------------------
+    Copyright 2017 Fangjun Kuang
+    email: csukuangfj at gmail dot com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a COPYING file of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>
+    -----------------------------------------------------------------  */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#include <opencv2/imgcodecs.hpp>
+
+#include "MyTimer.hpp"
+#include "ppm_benchmark.hpp"
+
+#include "common.hpp"
+
+std::vector<BenchmarkSequence>
+load_benchmark_sequences()
+{
+   std::vector<cv::String> names{"Hydrangea", "RubberWhale", "Venus"};
+
+   std::vector<BenchmarkSequence> sequences;
+   for (const cv::String& name : names)
+   {
+      cv::String dir = cv::String(KFJ_DATA_PATH) + "/middlebury_flow/" + name;
+
+      BenchmarkSequence sequence;
+      sequence.m_name = name;
+      sequence.m_f1 = cv::imread(dir + "/frame10.png", cv::IMREAD_COLOR);
+      sequence.m_f2 = cv::imread(dir + "/frame11.png", cv::IMREAD_COLOR);
+      if (sequence.m_f1.empty() || sequence.m_f2.empty())
+      {
+         std::cerr << "Cannot read the frames in '" << dir << "'" << std::endl;
+         continue;
+      }
+
+      sequence.m_of.read_ground_truth_from_file(dir + "/flow10.flo");
+      sequences.push_back(sequence);
+   }
+
+   return sequences;
+}
+
+int
+get_benchmark_num_runs(int argc_, char* argv_[], int default_runs_)
+{
+   int num_runs = default_runs_;
+   if (argc_ == 2) num_runs = atoi(argv_[1]);
+   return std::max(num_runs, 1);
+}
+
+CpmConfig
+get_benchmark_config()
+{
+   CpmConfig config;
+   config.set_grid_space(1);
+   config.set_pyramid_ratio(0.75);
+   config.set_number_of_pyramid_levels(4);
+   config.set_number_of_iterations(8);
+   config.set_max_displacement(400);
+   config.set_half_patch_size(0);
+   config.set_minimum_image_width(15);
+   config.set_verbose(0);
+   config.set_pm_property_type(CpmConfig::PmPropertyType::E_PROPERTY_FLOW);
+   return config;
+}
+
+double
+get_best_time_ms(
+      int num_runs_,
+      const std::function<void()>& prepare_,
+      const std::function<void()>& run_
+)
+{
+   double best_ms = 0;
+   for (int r = 0; r < num_runs_; r++)
+   {
+      prepare_();
+
+      MyTimer timer;
+      timer.start();
+      run_();
+      timer.stop();
+
+      if ((r == 0) || (timer.get_ms() < best_ms)) best_ms = timer.get_ms();
+   }
+   return best_ms;
+}
+
+void
+run_flow_benchmark(
+      const BenchmarkSequence& sequence_,
+      const CpmConfig& config_,
+      const char* cost_,
+      int num_runs_,
+      double& best_ms_,
+      double& aee_
+)
+{
+   Cpm cpm;
+   best_ms_ = get_best_time_ms(num_runs_,
+         [&]() {cpm.init(sequence_.m_f1, sequence_.m_f2, config_, MatchCost::create(cost_));},
+         [&]() {cpm.compute_optical_flow();});
+
+   OpticalFlowKfj of = sequence_.m_of;
+   of.set_estimated_flow(cpm.get_u(), cpm.get_v());
+   aee_ = of.get_estimated_flow_error().get_AEE();
+}
+
+void
+print_benchmark_header(const char* axis1_, const char* axis2_, bool has_aee_)
+{
+   printf("%d thread(s)\n", cv::getNumThreads());
+   printf("%-12s %-18s %-12s %12s", "sequence", axis1_, axis2_, "time [ms]");
+   if (has_aee_) printf(" %10s", "AEE");
+   printf("\n");
+}
+
+void
+print_benchmark_row(
+      const BenchmarkSequence& sequence_,
+      const char* value1_,
+      const char* value2_,
+      double best_ms_,
+      double aee_ // = -1
+)
+{
+   printf("%-12s %-18s %-12s %12.2f", sequence_.m_name.c_str(), value1_, value2_, best_ms_);
+   if (aee_ >= 0) printf(" %10.4f", aee_);
+   printf("\n");
+}
@@ -0,0 +1,119 @@
+/*  ---------------------------------------------------------------------
+    Copyright 2017 Fangjun Kuang
+    email: csukuangfj at gmail dot com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a COPYING file of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>
+    -----------------------------------------------------------------  */
+#ifndef _ppm_benchmark_HPP_
+#define _ppm_benchmark_HPP_
+
+#include <functional>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "Cpm.hpp"
+#include "OpticalFlowKfj.hpp"
+
+/**
+ * The frames and the ground truth of a Middlebury flow sequence.
+ */
+struct BenchmarkSequence
+{
+   cv::String m_name;
+   cv::Mat m_f1;  //!< frame10.png
+   cv::Mat m_f2;  //!< frame11.png
+   OpticalFlowKfj m_of; //!< with the ground truth of flow10.flo
+};
+
+/**
+ * Read Hydrangea, RubberWhale and Venus from KFJ_DATA_PATH/middlebury_flow.
+ * A sequence whose frames cannot be read is reported and skipped.
+ */
+std::vector<BenchmarkSequence>
+load_benchmark_sequences();
+
+/**
+ * @param argc_          [in] Argument count of main()
+ * @param argv_          [in] Arguments of main(), the optional argument is the number of runs
+ * @param default_runs_  [in] Number of runs without the argument
+ * @return the number of runs, at least 1
+ */
+int
+get_benchmark_num_runs(int argc_, char* argv_[], int default_runs_);
+
+/**
+ * The configuration shared by the benchmarks that compute the flow.
+ */
+CpmConfig
+get_benchmark_config();
+
+/**
+ * Run a step several times and return the time of the fastest run.
+ *
+ * @param num_runs_  [in] Number of runs
+ * @param prepare_   [in] Called before every run, it is not timed
+ * @param run_       [in] The timed step
+ * @return the time of the fastest run in milliseconds
+ */
+double
+get_best_time_ms(
+      int num_runs_,
+      const std::function<void()>& prepare_,
+      const std::function<void()>& run_
+);
+
+/**
+ * Compute the flow of a sequence several times.
+ *
+ * @param sequence_  [in]  The sequence
+ * @param config_    [in]  Configuration of Cpm
+ * @param cost_      [in]  Name of the match cost, see MatchCost::create()
+ * @param num_runs_  [in]  Number of runs, the fastest run is reported
+ * @param best_ms_   [out] Time of the fastest run in milliseconds
+ * @param aee_       [out] Average endpoint error of the flow
+ */
+void
+run_flow_benchmark(
+      const BenchmarkSequence& sequence_,
+      const CpmConfig& config_,
+      const char* cost_,
+      int num_runs_,
+      double& best_ms_,
+      double& aee_
+);
+
+/**
+ * Print the number of threads and the header of the table.
+ *
+ * @param axis1_    [in] Name of the first varied parameter
+ * @param axis2_    [in] Name of the second varied parameter
+ * @param has_aee_  [in] true to add the AEE column
+ */
+void
+print_benchmark_header(const char* axis1_, const char* axis2_, bool has_aee_);
+
+/**
+ * Print a row of the table, the AEE column is omitted if aee_ is negative.
+ */
+void
+print_benchmark_row(
+      const BenchmarkSequence& sequence_,
+      const char* value1_,
+      const char* value2_,
+      double best_ms_,
+      double aee_ = -1
+);
+
+#endif //_ppm_benchmark_HPP_
@@ -0,0 +1,77 @@
+/*  ---------------------------------------------------------------------
+    Copyright 2017 Fangjun Kuang
+    email: csukuangfj at gmail dot com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a COPYING file of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>
+    -----------------------------------------------------------------  */
+#include <vector>
+
+#include "ppm_benchmark.hpp"
+
+// time the descriptors of both pyramids, i.e., Cpm::compute_descriptor(),
+// for the SIFT and census descriptors with and without the descriptor pyramid
+
+/**
+ * Exposes the steps of Cpm::compute_optical_flow() that compute the descriptors.
+ */
+class DescriptorBenchmarkCpm : public Cpm
+{
+public:
+   using Cpm::init_pyramid;
+   using Cpm::compute_descriptor;
+};
+
+int main(int argc, char* argv[])
+{
+   int num_runs = get_benchmark_num_runs(argc, argv, 5); // the fastest run is reported
+
+   struct Descriptor
+   {
+      DescriptorType m_type;
+      const char* m_cost;
+   };
+   std::vector<Descriptor> descriptors{
+         {DescriptorType::E_DESC_TYPE_SIFT, "sad"},
+         {DescriptorType::E_DESC_TYPE_CENSUS_TRANSFORM, "hamming"},
+   };
+
+   print_benchmark_header("descriptor", "pyramid", false);
+   for (const BenchmarkSequence& sequence : load_benchmark_sequences())
+   {
+      for (const Descriptor& descriptor : descriptors)
+      {
+         for (int is_pyramid = 0; is_pyramid < 2; is_pyramid++)
+         {
+            CpmConfig config;
+            config.set_pyramid_ratio(0.75);
+            config.set_number_of_pyramid_levels(8);
+            config.set_minimum_image_width(15);
+            config.set_verbose(0);
+            config.set_descriptor_type(descriptor.m_type);
+            config.set_descriptor_pyramid(is_pyramid != 0);
+
+            DescriptorBenchmarkCpm cpm;
+            cpm.init(sequence.m_f1, sequence.m_f2, config, MatchCost::create(descriptor.m_cost));
+            cpm.init_pyramid();
+
+            double best_ms = get_best_time_ms(num_runs, []() {}, [&]() {cpm.compute_descriptor();});
+
+            print_benchmark_row(sequence, descriptor_type_to_string(descriptor.m_type).c_str(),
+                                is_pyramid ? "level 0" : "per level", best_ms);
+         }
+      }
+   }
+
+   return 0;
+}
@@ -0,0 +1,62 @@
+/*  ---------------------------------------------------------------------
+    Copyright 2017 Fangjun Kuang
+    email: csukuangfj at gmail dot com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a COPYING file of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>
+    -----------------------------------------------------------------  */
+#include <vector>
+
+#include "ppm_benchmark.hpp"
+
+// compare the descriptors computed at every pyramid level with
+// the descriptor pyramid derived from level 0, in time and AEE
+
+int main(int argc, char* argv[])
+{
+   int num_runs = get_benchmark_num_runs(argc, argv, 3); // the fastest run is reported
+
+   struct Descriptor
+   {
+      DescriptorType m_type;
+      const char* m_cost;
+   };
+   std::vector<Descriptor> descriptors{
+         {DescriptorType::E_DESC_TYPE_SIFT, "sad"},
+         {DescriptorType::E_DESC_TYPE_PCA_SIFT, "sad"},
+         {DescriptorType::E_DESC_TYPE_CENSUS_TRANSFORM, "hamming"},
+   };
+
+   print_benchmark_header("descriptor", "pyramid", true);
+   for (const BenchmarkSequence& sequence : load_benchmark_sequences())
+   {
+      for (const Descriptor& descriptor : descriptors)
+      {
+         for (int is_pyramid = 0; is_pyramid < 2; is_pyramid++)
+         {
+            CpmConfig config = get_benchmark_config();
+            config.set_cross_check(true);
+            config.set_descriptor_type(descriptor.m_type);
+            config.set_descriptor_pyramid(is_pyramid != 0);
+
+            double best_ms, aee;
+            run_flow_benchmark(sequence, config, descriptor.m_cost, num_runs, best_ms, aee);
+
+            print_benchmark_row(sequence, descriptor_type_to_string(descriptor.m_type).c_str(),
+                                is_pyramid ? "level 0" : "per level", best_ms, aee);
+         }
+      }
+   }
+
+   return 0;
+}
@@ -0,0 +1,49 @@
+/*  ---------------------------------------------------------------------
+    Copyright 2017 Fangjun Kuang
+    email: csukuangfj at gmail dot com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a COPYING file of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>
+    -----------------------------------------------------------------  */
+#include "ppm_benchmark.hpp"
+
+// compare the serial and the parallel propagation with and without
+// the cross check, in time and AEE
+
+int main(int argc, char* argv[])
+{
+   int num_runs = get_benchmark_num_runs(argc, argv, 3); // the fastest run is reported
+
+   print_benchmark_header("cross check", "propagation", true);
+   for (const BenchmarkSequence& sequence : load_benchmark_sequences())
+   {
+      for (int is_cross_check = 1; is_cross_check >= 0; is_cross_check--)
+      {
+         for (int is_parallel = 0; is_parallel < 2; is_parallel++)
+         {
+            CpmConfig config = get_benchmark_config();
+            config.set_cross_check(is_cross_check != 0);
+            config.set_parallel_propagation(is_parallel != 0);
+            config.set_descriptor_type(DescriptorType::E_DESC_TYPE_SIFT);
+
+            double best_ms, aee;
+            run_flow_benchmark(sequence, config, "sad", num_runs, best_ms, aee);
+
+            print_benchmark_row(sequence, is_cross_check ? "on" : "off",
+                                is_parallel ? "parallel" : "serial", best_ms, aee);
+         }
+      }
+   }
+
+   return 0;
+}
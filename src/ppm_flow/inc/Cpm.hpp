@@ -24,12 +24,32 @@
 
 #include "MatchCost.hpp"
 #include "CpmConfig.hpp"
-
-
+#include "CpmImpl.hpp"
+
+/**
+ * Coarse-to-fine PatchMatch.
+ *
+ * An instance can be reused for a sequence of frame pairs: call init() and
+ * compute_optical_flow() for every pair. Pyramids, descriptors, seeds, flows
+ * and the CpmImpl instances are kept between the calls, so frames of the same size
+ * do not allocate new buffers. The seed grid is rebuilt only if the image size,
+ * the grid space or the pyramid changes.
+ *
+ * For a video, call init_stream() once and push_frame() for every frame.
+ * The flow between the previous and the current frame is computed
+ * and the pyramid and descriptors of the previous frame are reused.
+ */
 class Cpm
 {
 public:
-   Cpm() {}
+   Cpm()
+      : m_seeds_grid_space(0),
+        m_seeds_num_levels(0),
+        m_seeds_pyramid_ratio(0),
+        m_seeds_order(CpmConfig::SeedOrder::E_SEED_ORDER_ROW_MAJOR),
+        m_seeds_merged(false),
+        m_num_stream_frames(0)
+   {}
 
    /**
     * @param image1_    [in] First frame, reference frame, depth: CV_8U or CV_32F
@@ -45,6 +65,12 @@ public:
    );
 
    /**
+    * Set the frames for the next call of compute_optical_flow().
+    *
+    * Frames of depth CV_32F are not copied, so they must not be modified
+    * until compute_optical_flow() returns. Frames of depth CV_8U are converted
+    * into buffers owned by this instance.
+    *
     * @param image1_    [in] First frame, reference frame, depth: CV_8U or CV_32F
     * @param image2_    [in] Second frame, depth: CV_8U or CV_32F
     * @param config_    [in] Configurations
@@ -57,9 +83,56 @@ public:
          cv::Ptr<MatchCost> cost_ptr_
    );
 
-   //! Run ppm flow
+   /**
+    * Run ppm flow.
+    *
+    * If CpmConfig::get_tile_memory_budget() is positive, the reference frame is split into tiles
+    * whose pyramids and descriptors fit into the budget. Every tile is matched within a halo
+    * of max displacement plus the half patch size, and the seed flows of the tiles are stitched
+    * and cross checked as a whole. The frames and the dense flow are not counted in the budget.
+    */
    void compute_optical_flow();
 
+   /**
+    * Start a new stream of frames.
+    *
+    * @param config_    [in] Configurations
+    * @param cost_ptr_  [in] For computing matching cost
+    */
+   void init_stream(
+         const CpmConfig& config_,
+         cv::Ptr<MatchCost> cost_ptr_
+   );
+
+   /**
+    * Append a frame to the stream and compute the flow from the previous frame to it.
+    *
+    * The previous frame becomes the reference frame, i.e., get_frame1(),
+    * and its pyramid and descriptors are not recomputed. Only the pyramid
+    * and the descriptors of the new frame are computed. The frame is copied,
+    * so the caller can reuse its buffer.
+    *
+    * If the size or the number of channels differs from the previous frame,
+    * the stream restarts with this frame. Frames of a stream are not tiled.
+    *
+    * @param frame_ [in] The next frame, depth: CV_8U or CV_32F
+    *
+    * @return true if the flow is computed, false if it is the first frame of the stream
+    */
+   bool push_frame(const cv::Mat& frame_);
+
+   /**
+    * Warm-start the next computation from a known flow, e.g., the flow of the previous frame pair.
+    *
+    * Seeds whose warm-start flow is worse than the random initialization are initialized randomly.
+    * The flow is used only once and ignored if its size differs from the frames.
+    * In a stream, CpmConfig::set_warm_start() warm-starts every pair automatically.
+    *
+    * @param u_ [in] Flow in the x-direction at the resolution of the frames, CV_32FC1
+    * @param v_ [in] Flow in the y-direction, same size as u_, CV_32FC1
+    */
+   void set_warm_start_flow(const cv::Mat& u_, const cv::Mat& v_);
+
    /**
     * Get the matches of PPM. It can be used as input for Epic flow
     * @param matches_ [out] CV_32FC1.
@@ -73,32 +146,142 @@ public:
    cv::Mat get_frame1() const {return m_f;}
    cv::Mat get_frame2() const {return m_g;}
 
+   //! The buffer is reused by the next compute_optical_flow(); clone it to keep the result.
    cv::Mat get_u() const {return m_u;}
+   //! The buffer is reused by the next compute_optical_flow(); clone it to keep the result.
    cv::Mat get_v() const {return m_v;}
 
+   /**
+    * Statistics of every pyramid level of the last computation, index 0 is the finest level.
+    * The right view is computed only if cross check is enabled.
+    * They are not available for the tiled execution.
+    */
+   const std::vector<CpmLevelStats>& get_level_stats(
+         CpmConfig::ViewIndex view_ = CpmConfig::ViewIndex::E_LEFT_VIEW) const
+   {
+      CV_Assert(!m_impl[view_].empty());
+      return m_impl[view_]->get_level_stats();
+   }
+
    CpmConfig& get_config() {return m_config;}
    void set_config(const CpmConfig& val_) {m_config = val_;}
 
 protected: // protected for testing
    /**
     * set up the pyramid
+    *
+    * The pyramids of the two frames are built concurrently.
     */
    void init_pyramid();
 
+   /**
+    * Set up the pyramid of one frame.
+    * The number of pyramid levels in the configuration is updated.
+    *
+    * @param image_    [in] the frame
+    * @param pyramid_  [out] its pyramid, the 0th element is the finest level
+    */
+   void init_frame_pyramid(const cv::Mat& image_, std::vector<cv::Mat>& pyramid_);
+
    /**
     * Compute descriptor for each pixel
     * in the pyramid
+    *
+    * The large levels of the two frames are computed one after the other,
+    * each with the row parallelism of the descriptor. Every (frame, level) pair
+    * of the small coarse levels is an independent task of cv::parallel_for_().
+    *
+    * The seeds have to be initialized, see CpmConfig::get_sparse_reference_descriptor().
     */
    void compute_descriptor();
 
+   /**
+    * Compute the descriptors of one pyramid.
+    *
+    * @param pyramid_     [in] pyramid of a frame
+    * @param descriptor_  [out] descriptors at every level of the pyramid
+    * @param masks_       [in] Optional. CV_8UC1 at every level, only the descriptors of nonzero pixels
+    *                          are needed. SIFT descriptors of the other pixels are not computed;
+    *                          the transforms are cheap and always dense.
+    */
+   void compute_frame_descriptor(
+         const std::vector<cv::Mat>& pyramid_,
+         std::vector<cv::Mat>& descriptor_,
+         const std::vector<cv::Mat>& masks_ = std::vector<cv::Mat>()
+   );
+
+   /**
+    * Compute the descriptors of one pyramid level.
+    * It only reads the object, so the levels of both frames can be computed concurrently.
+    *
+    * @param image_       [in]  the image of the level
+    * @param mask_        [in]  CV_8UC1 or empty, see compute_frame_descriptor()
+    * @param descriptor_  [out] the descriptors of the level
+    */
+   void compute_level_descriptor(
+         const cv::Mat& image_,
+         const cv::Mat& mask_,
+         cv::Mat& descriptor_
+   ) const;
+
+   //! Set the configuration and the cost, and create the CpmImpl instances if needed
+   void init_config(
+         const CpmConfig& config_,
+         cv::Ptr<MatchCost> cost_ptr_
+   );
+
    /**
     * Compute the coordinate of every pixel at each level in the pyramid.
+    *
+    * It does nothing if the seeds have been computed for the same image size,
+    * grid space and pyramid.
     */
    void init_seeds();
 
+   /**
+    * Same as init_seeds() but only for the first num_levels_ levels of the pyramid.
+    * Level 0 needs no pyramid.
+    */
+   void init_seeds(int num_levels_);
+
+   //! Tiled version of compute_optical_flow(), see CpmConfig::get_tile_memory_budget()
+   void compute_optical_flow_tiled();
+
+   /**
+    * Same as compute_optical_flow() without the tiling, the cross check and the dense flow,
+    * i.e., it computes only the seed flows of every level. The tiles use it since
+    * the whole frame cross checks and densifies the stitched seed flows.
+    */
+   void compute_seeds_flow();
+
+   /**
+    * Estimate the memory of a tile per pixel, including the frames, the pyramids
+    * and the descriptors of a tile.
+    */
+   double estimate_tile_bytes_per_pixel();
+
+   /**
+    * Stitch the seed flows of a tile into the seed flows of the whole frame.
+    *
+    * @param tile_         [in] Instance that has processed the tile.
+    * @param tile_origin_  [in] Position of seed 0 of the tile in the seed grid of the whole frame.
+    * @param core_         [in] Range of the seed grid, in seeds of the whole frame, that this tile owns.
+    */
+   void stitch_tile_seeds(const Cpm& tile_, const cv::Point& tile_origin_, const cv::Rect& core_);
+
 protected:
 
+   //! run_seeds_patch_match() followed by seeds_flow_to_dense()
    void run_patch_match();
+
+   //! Estimate the seed flows of every level from the descriptors, for both views if the cross check is enabled.
+   void run_seeds_patch_match();
+
+   /**
+    * Cross check the seed flows at level 0 if it is enabled, and
+    * convert them to the dense flows m_u and m_v.
+    */
+   void seeds_flow_to_dense();
    cv::Ptr<MatchCost> m_cost_ptr;
 
 protected: // protected for testing
@@ -115,20 +298,55 @@ protected: // protected for testing
 
    /**
     * Every element has the following format:
-    *  - height: number of seeds
+    *  - height: number of seeds at the level
     *  - width: 2. 0-th column: x coordinate of the seed, 1-st column: y coordinate of the seed
     *  - type: CV_32SC1
+    *
+    * Level 0 has m_num_seeds seeds. Seeds that collapse onto the same pixel at a coarser level
+    * are merged into one seed, so coarser levels have fewer seeds. The seeds of every level
+    * form a regular grid, stored in the order of CpmConfig::get_seed_order().
+    *
+    * It is a view of the columns 0-1 of m_seeds_packed.
     */
    std::vector<cv::Mat> m_seeds;
 
    /**
     * Because seeds are not continuous, we need to keep the information of its neighbors.
     *
-    * Index of seed's neighbors
+    * Index of seed's neighbors at every level
+    *
+    * CV_32SC1, 8 columns, the same number of rows as m_seeds.
+    * It is a view of the columns 2-9 of m_seeds_packed.
+    */
+   std::vector<cv::Mat> m_seed_neighbors;
+
+   /**
+    * Coordinates and neighbors of every seed at each level in one row,
+    * i.e., x, y and the 8 neighbor indices, so that a seed touches a single
+    * row of 40 bytes during propagation.
+    *
+    * CV_32SC1, 10 columns, the same number of rows as m_seeds
+    */
+   std::vector<cv::Mat> m_seeds_packed;
+
+   /**
+    * Index of the seed at level 0 of every grid position,
+    * CV_32SC1, m_seeds_per_col x m_seeds_per_row.
+    * It is the identity in row major order.
+    */
+   cv::Mat m_seed_grid_index;
+
+   /**
+    * Index of the seed at level i+1 of every seed at level i, i.e.,
+    * the seed it is initialized from.
+    *
+    * Merged seeds propagate over fewer and farther neighbors at the coarse levels,
+    * so the flows that initialize level 0 differ from those of an unmerged grid,
+    * and so do the cross check and the output flow.
     *
-    * CV_32SC1, 8 columns
+    * CV_32SC1, 1 column, the same number of rows as m_seeds. Empty at the coarsest level.
     */
-   cv::Mat m_seed_neighbors;
+   std::vector<cv::Mat> m_seeds_coarser_index;
 
    /**
     * Pyramid of the raw image m_f.
@@ -161,18 +379,61 @@ protected: // protected for testing
    /**
     * Horizontal flow field of seed pixels at every level.
     *
-    * Every element is of type CV_32FC1.
+    * Every element is of type CV_32FC1 with one row per seed of the level and 1 column.
+    * Row n is the flow of the n-th seed.
     */
    std::vector<cv::Mat> m_seeds_flow_u;
 
    /**
     * Vertical flow field of seed pixels at every level.
     *
-    * Every element is of type CV_32FC1.
+    * Every element is of type CV_32FC1 with one row per seed of the level and 1 column.
+    * Row n is the flow of the n-th seed.
     */
    std::vector<cv::Mat> m_seeds_flow_v;
 
-   std::vector<cv::Mat> m_seeds_flow_cost;
+   std::vector<cv::Mat> m_seeds_flow_cost; //!< matching cost of seeds at every level, same layout as m_seeds_flow_u
+
+   std::vector<cv::Mat> m_right_seeds_flow_u;    //!< flow of the right view for cross check, same layout as m_seeds_flow_u
+   std::vector<cv::Mat> m_right_seeds_flow_v;    //!< flow of the right view for cross check, same layout as m_seeds_flow_v
+   std::vector<cv::Mat> m_right_seeds_flow_cost; //!< cost of the right view for cross check, same layout as m_seeds_flow_cost
+
+   cv::Mat m_checked_u; //!< flow of seeds after cross check in the x direction, num_seeds x 1
+   cv::Mat m_checked_v; //!< flow of seeds after cross check in the y direction, num_seeds x 1
+
+   cv::Mat m_warm_start_flow_u; //!< dense warm-start flow set by set_warm_start_flow(), x direction
+   cv::Mat m_warm_start_flow_v; //!< dense warm-start flow set by set_warm_start_flow(), y direction
+
+   cv::Mat m_warm_start_u;       //!< warm-start flow of seeds at level 0 in the x direction, num_seeds x 1
+   cv::Mat m_warm_start_v;       //!< warm-start flow of seeds at level 0 in the y direction, num_seeds x 1
+   cv::Mat m_right_warm_start_u; //!< warm-start flow of the right view, i.e., -m_warm_start_u
+   cv::Mat m_right_warm_start_v; //!< warm-start flow of the right view, i.e., -m_warm_start_v
+
+   cv::Mat m_stream_flow_u; //!< seed flow of the previous pair of the stream in the x direction, num_seeds x 1
+   cv::Mat m_stream_flow_v; //!< seed flow of the previous pair of the stream in the y direction, num_seeds x 1
+
+   std::vector<cv::Ptr<Cpm> > m_tile_workers; //!< one instance per thread processing tiles, reused across calls
+
+   /**
+    * Patch match implementation of the left view and the right view.
+    * They are recreated only if the property type changes.
+    */
+   cv::Ptr<CpmImpl> m_impl[2];
+   CpmConfig::PmPropertyType m_impl_type; //!< property type of m_impl
+
+   cv::Mat m_pca_basis;                //!< principal components of SIFT for DescriptorType::E_DESC_TYPE_PCA_SIFT
+   std::string m_pca_basis_filename;   //!< file of m_pca_basis
+
+   //! image size, grid space, number of levels, pyramid ratio, order and merging of the current seeds
+   cv::Size m_seeds_image_size;
+   int m_seeds_grid_space;
+   int m_seeds_num_levels;
+   float m_seeds_pyramid_ratio;
+   CpmConfig::SeedOrder m_seeds_order;
+   bool m_seeds_merged;
+
+   //! number of frames pushed since init_stream(), 0 if the frames are set by init()
+   int m_num_stream_frames;
 
 protected: // protected for testing
    //****************************************************
@@ -182,6 +443,9 @@ protected: // protected for testing
                 //!< depth: CV_8U or CV_32F
    cv::Mat m_g; //!< image 2, same type with m_f
 
+   cv::Mat m_f_buffer; //!< storage of m_f if the input frame has to be converted
+   cv::Mat m_g_buffer; //!< storage of m_g if the input frame has to be converted
+
    cv::Mat m_u; //!< flow field in the x direction, CV_32FC1, fields of non-seed pixels are set to 0
    cv::Mat m_v; //!< flow field in the y direction, CV_32FC1, fields of non-seed pixels are set to 0
 
@@ -41,6 +41,12 @@ public:
       E_RIGHT_VIEW   = 1, //!< second frame
    };
 
+   enum SeedOrder
+   {
+      E_SEED_ORDER_ROW_MAJOR  = 0, //!< seeds are stored row by row
+      E_SEED_ORDER_MORTON     = 1, //!< seeds are stored along the Z-order (Morton) curve of the seed grid
+   };
+
 public:
    CpmConfig();
 
@@ -59,6 +65,18 @@ public:
    void set_number_of_iterations(int val_) {m_num_iterations = val_;}
    int get_number_of_iterations() const {return m_num_iterations;}
 
+   void set_min_number_of_iterations(int val_) {m_min_num_iterations = val_;}
+   int get_min_number_of_iterations() const {return m_min_num_iterations;}
+
+   void set_stop_ratio(float val_) {m_stop_ratio = val_;}
+   float get_stop_ratio() const {return m_stop_ratio;}
+
+   void set_stop_ratio_change(float val_) {m_stop_ratio_change = val_;}
+   float get_stop_ratio_change() const {return m_stop_ratio_change;}
+
+   void set_stop_count_seeds(bool val_) {m_stop_count_seeds = val_;}
+   bool get_stop_count_seeds() const {return m_stop_count_seeds;}
+
    void set_half_patch_size(int val_) {m_half_patch_size = val_;}
    int get_half_patch_size() const {return m_half_patch_size;}
 
@@ -77,6 +95,15 @@ public:
    void set_descriptor_color_to_gray(bool color_to_gray_) {m_descriptor_color_to_gray = color_to_gray_;}
    bool get_descriptor_color_to_gray() const {return m_descriptor_color_to_gray;}
 
+   void set_descriptor_pyramid(bool val_) {m_descriptor_pyramid = val_;}
+   bool get_descriptor_pyramid() const {return m_descriptor_pyramid;}
+
+   void set_pca_sift_components(int val_) {m_pca_sift_components = val_;}
+   int get_pca_sift_components() const {return m_pca_sift_components;}
+
+   void set_pca_sift_basis_filename(const std::string& val_) {m_pca_sift_basis_filename = val_;}
+   std::string get_pca_sift_basis_filename() const {return m_pca_sift_basis_filename;}
+
    void set_match_cost_type(MatchCostType type_) {m_match_cost_type = type_;}
    MatchCostType get_match_cost_type() const {return m_match_cost_type;}
 
@@ -85,6 +112,14 @@ public:
 
    static std::string pm_property_type_to_string(PmPropertyType type_);
 
+   void set_seed_order(SeedOrder val_) {m_seed_order = val_;}
+   SeedOrder get_seed_order() const {return m_seed_order;}
+
+   static std::string seed_order_to_string(SeedOrder order_);
+
+   void set_merge_coarse_seeds(bool val_) {m_merge_coarse_seeds = val_;}
+   bool get_merge_coarse_seeds() const {return m_merge_coarse_seeds;}
+
    std::string to_string() const;
    void show_parameters() const;
 
@@ -100,6 +135,39 @@ public:
    void set_use_interpolation(bool val_) {m_use_interpolation = val_;}
    bool get_use_interpolation() const {return m_use_interpolation;}
 
+   void set_parallel_propagation(bool val_) {m_parallel_propagation = val_;}
+   bool get_parallel_propagation() const {return m_parallel_propagation;}
+
+   void set_warm_start(bool val_) {m_warm_start = val_;}
+   bool get_warm_start() const {return m_warm_start;}
+
+   void set_warm_start_levels(int val_) {m_warm_start_levels = val_;}
+   int get_warm_start_levels() const {return m_warm_start_levels;}
+
+   void set_warm_start_number_of_iterations(int val_) {m_warm_start_num_iterations = val_;}
+   int get_warm_start_number_of_iterations() const {return m_warm_start_num_iterations;}
+
+   void set_tile_memory_budget(int val_) {m_tile_memory_budget = val_;}
+   int get_tile_memory_budget() const {return m_tile_memory_budget;}
+
+   void set_parallel_tiles(bool val_) {m_parallel_tiles = val_;}
+   bool get_parallel_tiles() const {return m_parallel_tiles;}
+
+   void set_time_budget(float val_) {m_time_budget = val_;}
+   float get_time_budget() const {return m_time_budget;}
+
+   void set_cost_cache(bool val_) {m_cost_cache = val_;}
+   bool get_cost_cache() const {return m_cost_cache;}
+
+   void set_subpixel_cost(bool val_) {m_subpixel_cost = val_;}
+   bool get_subpixel_cost() const {return m_subpixel_cost;}
+
+   void set_sparse_reference_descriptor(bool val_) {m_sparse_reference_descriptor = val_;}
+   bool get_sparse_reference_descriptor() const {return m_sparse_reference_descriptor;}
+
+   void set_random_seed(int val_) {m_random_seed = val_;}
+   int get_random_seed() const {return m_random_seed;}
+
 private:
    int m_grid_space;    //!< Grid space between seeds.
                         //!< The horizontal space and the vertical space are equal.
@@ -110,7 +178,19 @@ private:
                                //!< it computes as many levels as possible.
    int m_max_displacement;     //!< Maximum displacement
 
-   int m_num_iterations;      //!< Number of iterations in PatchMatch Propagation step
+   int m_num_iterations;      //!< Maximum number of iterations in PatchMatch Propagation step
+
+   int m_min_num_iterations;  //!< Minimum number of iterations in PatchMatch Propagation step,
+                              //!< unless the time budget runs out
+
+   float m_stop_ratio;        //!< A level stops if the number of improvements per seed in an iteration is less than it
+
+   float m_stop_ratio_change; //!< A level stops if the number of improvements per seed changes less than it
+                              //!< between two iterations. 0 to disable it.
+
+   bool m_stop_count_seeds;   //!< true to count improved seeds instead of improvements for the stop ratios,
+                              //!< i.e., a seed improved by several neighbors counts once. It stops later
+                              //!< than the default, which counts as the original implementation.
 
    int m_half_patch_size;     //!< half patch size for computing match cost.
                               //!< 0 means to compute point-wise cost, i.e, 1x1.
@@ -127,11 +207,65 @@ private:
                                        //!< descriptor of the grayscale image
                                        //!< false to compute the descriptor of each channel separately and then
                                        //!< concatenate them
+   bool m_descriptor_pyramid;          //!< true to compute the descriptor only at level 0 and downsample it to the coarser
+                                       //!< levels, see MyImageProcessing::downsample_descriptor().
+                                       //!< false to compute the descriptor of the image at every level
+   int m_pca_sift_components;          //!< number of principal components of DescriptorType::E_DESC_TYPE_PCA_SIFT,
+                                       //!< e.g., 16 or 32 instead of the 128 bytes of SIFT
+   std::string m_pca_sift_basis_filename; //!< principal components of SIFT, see SiftDescriptor::load_pca_basis()
 
    MatchCostType m_match_cost_type;   //!< match cost type
 
    PmPropertyType m_pm_property_type; //!< property type, i.e, model type in the thesis
 
+   SeedOrder m_seed_order;    //!< Storage order of the seeds at every level. The Morton order keeps the neighbors
+                              //!< of a seed close in memory; backward propagation then visits the seeds in reverse.
+
+   bool m_merge_coarse_seeds; //!< true to merge the seeds that fall on the same pixel at a coarse level, i.e.,
+                              //!< fewer seeds are matched there. It changes the flow. false keeps one seed
+                              //!< per grid position at every level as the original implementation.
+
+   bool m_parallel_propagation; //!< true to propagate independent seeds concurrently.
+                                //!< Seeds are scheduled in phases so that no two seeds
+                                //!< in the same phase are neighbors.
+                                //!< The two views of the cross check then run one after the other,
+                                //!< each with the whole thread pool.
+
+   bool m_warm_start;   //!< true to warm-start every frame pair of a stream
+                        //!< from the seed flow of the previous pair, see Cpm::push_frame()
+
+   int m_warm_start_levels;   //!< Number of levels, counted from the coarsest one, that are warm-started.
+                              //!< When it is less than 1, all levels are warm-started.
+
+   int m_warm_start_num_iterations; //!< Number of iterations in PatchMatch Propagation step on warm-started levels
+
+   int m_tile_memory_budget;  //!< Memory budget in MB of the tiled execution, see Cpm::compute_optical_flow().
+                              //!< When it is less than 1, the frames are not tiled.
+
+   bool m_parallel_tiles;     //!< true to process tiles concurrently. The budget is shared by all threads.
+
+   float m_time_budget;       //!< Time budget of the patch match in milliseconds, excluding the pyramids and the descriptors.
+                              //!< It is split across levels and iterations, see CpmLevelStats::m_truncated.
+                              //!< When it is not positive, the time is not limited.
+
+   bool m_cost_cache;         //!< true to cache the costs of recently evaluated integer displacements of every seed
+                              //!< within a level. It does not change the result, see CpmLevelStats::m_num_cost_cache_hits.
+
+   bool m_subpixel_cost;      //!< true to interpolate the matching cost of non-integer flows bilinearly
+                              //!< from the 2x2 neighboring pixels, false to round the flows.
+                              //!< The cost cache is disabled since it is keyed on integer displacements.
+
+   bool m_sparse_reference_descriptor; //!< true to sample the SIFT descriptors of the first frame only at the seeds
+                                       //!< and their patches. It does not change the result. The saving is partial:
+                                       //!< the derivative filters, the orientation bands and the cell filter
+                                       //!< still run on the whole frame, and the other descriptors ignore it.
+                                       //!< It is ignored with the cross check, which matches every pixel
+                                       //!< of the second frame, and with the descriptor pyramid.
+
+   int m_random_seed;         //!< Key of the random numbers of the patch match. Every seed, level, iteration
+                              //!< and view draws from its own stream, so the flow does not depend on the
+                              //!< number of threads.
+
 private:
    std::string m_filename_1;
    std::string m_filename_2;
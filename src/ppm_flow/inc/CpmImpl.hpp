@@ -18,9 +18,46 @@
 #ifndef _CpmImpl_HPP_
 #define _CpmImpl_HPP_
 
+#include <climits>
+
 #include <opencv2/core.hpp>
 
 #include "CpmConfig.hpp"
+#include "Philox.hpp"
+
+/**
+ * Statistics of the patch match at one pyramid level.
+ */
+struct CpmLevelStats
+{
+   CpmLevelStats()
+      : m_truncated(false),
+        m_time(0),
+        m_num_seeds(0),
+        m_num_iterations(0),
+        m_num_cost_evaluations(0),
+        m_num_cost_cache_hits(0)
+   {}
+
+   bool m_truncated;    //!< true if the level stopped early because its share of the time budget ran out
+   double m_time;       //!< time spent on the propagation of the level in milliseconds
+   int m_num_seeds;     //!< number of seeds of the level
+   int m_num_iterations;   //!< number of iterations executed
+   std::vector<float> m_improved_fraction; //!< improvements per seed, or the fraction of improved seeds
+                                           //!< if CpmConfig::get_stop_count_seeds(), one element per iteration
+   int64 m_num_cost_evaluations; //!< number of candidates whose matching cost is computed in all iterations
+   int64 m_num_cost_cache_hits;  //!< number of candidates whose matching cost is taken from the cost cache
+};
+
+/**
+ * Entry of the cost cache of a seed, see CpmConfig::get_cost_cache().
+ */
+struct CpmCostCacheEntry
+{
+   int m_key;     //!< integer displacement packed by CpmImpl::cost_cache_key()
+   float m_cost;  //!< exact cost, or a lower bound that is not less than the cost of the seed
+                  //!< when it was computed, see MatchCost::Kernel
+};
 
 class CpmImpl
 {
@@ -31,6 +68,32 @@ public:
    CpmImpl();
 
 public:
+   /**
+    * Coarse-to-fine patch match.
+    *
+    * Properties, flows and costs are stored per seed instead of per pixel.
+    * Row n of every output corresponds to the n-th seed, i.e., row n of seeds_[level].
+    * Every level has its own seeds, see Cpm::m_seeds.
+    *
+    * The buffers of the outputs and of the seed properties are reused
+    * if the instance is called repeatedly with the same number of seeds.
+    *
+    * @param flows_u_    [out] Flow of every seed in the x-direction at each level, CV_32FC1, num_seeds x 1.
+    * @param flows_v_    [out] Flow of every seed in the y-direction at each level, CV_32FC1, num_seeds x 1.
+    * @param flows_cost_ [out] Matching cost of every seed at each level, CV_32FC1, num_seeds x 1.
+    * @param seeds_               [in] Seed coordinates at each level, CV_32SC1, 2 columns.
+    * @param seed_neighbors_      [in] Neighbor indices of the seeds at each level, CV_32SC1, 8 columns.
+    * @param seeds_coarser_index_ [in] Index of the seed at level i+1 of every seed at level i, CV_32SC1, 1 column.
+    * @param warm_start_u_ [in] Optional. Flow of every seed at level 0 in the x-direction, CV_32FC1, num_seeds x 1,
+    *                           e.g., the flow of the previous frame pair. If it is not empty,
+    *                           the levels selected by CpmConfig::get_warm_start_levels() are
+    *                           warm-started and run CpmConfig::get_warm_start_number_of_iterations() iterations.
+    * @param warm_start_v_ [in] Optional. Flow of every seed at level 0 in the y-direction, same layout as warm_start_u_.
+    *
+    * If CpmConfig::get_time_budget() is positive, every level gets a share of the remaining budget
+    * proportional to its number of seeds. A level stops before the iteration that is expected to exceed
+    * its share and hands its current properties to the next finer level. See get_level_stats().
+    */
    void property_patch_match_impl(
          const std::vector<cv::Mat>& image1_,
          const std::vector<cv::Mat>& image2_,
@@ -39,10 +102,54 @@ public:
          std::vector<cv::Mat>& flows_cost_,
          cv::Ptr<MatchCost> cost_func_ptr_,
          const std::vector<cv::Mat>& seeds_,
-         const cv::Mat& seed_neighbors_,
-         const CpmConfig& config_
+         const std::vector<cv::Mat>& seed_neighbors_,
+         const std::vector<cv::Mat>& seeds_coarser_index_,
+         const CpmConfig& config_,
+         const cv::Mat& warm_start_u_ = cv::Mat(),
+         const cv::Mat& warm_start_v_ = cv::Mat()
+   );
+
+   /**
+    * Replace the property of a seed by the warm-start flow if the flow has a lower matching cost.
+    *
+    * Seeds whose warm-start flow is worse keep their current property,
+    * e.g., the one from the random initialization.
+    *
+    * @param f_             [in] Descriptor image of the first frame at the current level.
+    * @param g_             [in] Descriptor image of the second frame at the current level.
+    * @param warm_start_u_  [in] Flow of every seed in the x-direction at the resolution of level 0, CV_32FC1, num_seeds x 1.
+    * @param warm_start_v_  [in] Flow of every seed in the y-direction at the resolution of level 0, CV_32FC1, num_seeds x 1.
+    * @param scale_         [in] Scale from level 0 to the current level.
+    * @param property_      [in,out] Property of every seed, CV_32FC1, num_seeds x m_num_properties.
+    * @param cost_          [in,out] Matching cost of every seed, CV_32FC1, num_seeds x 1.
+    * @param seeds_         [in] Seed coordinates at the current level, CV_32SC1, 2 columns.
+    *
+    * @return Number of seeds that take the warm-start flow.
+    */
+   int property_warm_start(
+         const cv::Mat& f_,
+         const cv::Mat& g_,
+         const cv::Mat& warm_start_u_,
+         const cv::Mat& warm_start_v_,
+         float scale_,
+         cv::Mat& property_,
+         cv::Mat& cost_,
+         cv::Ptr<MatchCost> cost_func_ptr_,
+         const cv::Mat& seeds_,
+         int half_patch_size_
    );
 
+   /**
+    * @param property_    [in,out] Property of every seed, CV_32FC1, num_seeds x m_num_properties.
+    * @param cost_        [in,out] Matching cost of every seed, CV_32FC1, num_seeds x 1.
+    * @param num_iterations_ [in] Maximum number of iterations.
+    * @param level_       [in] Pyramid level, selects the random streams of the seeds, see get_rng().
+    * @param config_      [in] For the stop ratios and the minimum number of iterations.
+    *                          The level stops once the number of improvements per seed in an iteration
+    *                          is less than CpmConfig::get_stop_ratio().
+    * @param deadline_    [in] No iteration is started that is expected to end after it.
+    * @param stats_       [out] Optional. Statistics of the level.
+    */
    void property_propagation(
          cv::Mat& property_,
          const cv::Mat& f_,
@@ -54,15 +161,110 @@ public:
          const cv::Mat& seed_coord_,
          const cv::Mat& neighbors_,
          int half_patch_size_,
-         bool verbose_ = true,   // for debug purpose only
-         int level_num_ = 0      // for debug purpose only
+         int level_,
+         const CpmConfig& config_,
+         double deadline_ = 0,   // in ticks of cv::getTickCount(), 0 for no deadline
+         CpmLevelStats* stats_ = nullptr
+   );
+
+   /**
+    * Propagation and random search for a single seed.
+    *
+    * It writes only the property and the cost of the n_-th seed and reads the properties
+    * of its neighbors, so seeds that are not neighbors of each other can be processed concurrently.
+    *
+    * @param n_                [in] Index of the seed.
+    * @param neighbor_index_   [in] Which neighbors to propagate from, e.g., {1,2,4,5} or {0,3,6,7}.
+    * @param level_            [in] Pyramid level.
+    * @param iteration_        [in] Iteration of the propagation at the level.
+    * @param p_try_property_   [in] Buffer with m_num_properties elements for the random search.
+    * @param num_cost_evaluations_ [in,out] Incremented by the number of candidates whose cost is computed.
+    * @param num_cache_hits_   [in,out] Incremented by the number of candidates whose cost is found in the cost cache.
+    *
+    * It is implemented only by CpmImplKernel, which calls the model functions without virtual calls.
+    *
+    * @return Number of times the cost of the seed was improved.
+    */
+   virtual int propagate_seed(
+         int n_,
+         const std::vector<int>& neighbor_index_,
+         cv::Mat& property_,
+         const cv::Mat& f_,
+         const cv::Mat& g_,
+         cv::Mat& cost_,
+         MatchCost::Kernel cost_kernel_,
+         float max_search_radius_,
+         const cv::Mat& seed_coord_,
+         const cv::Mat& neighbors_,
+         int half_patch_size_,
+         int level_,
+         int iteration_,
+         float* p_try_property_,
+         int& num_cost_evaluations_,
+         int& num_cache_hits_
+   ) = 0;
+
+   /**
+    * improve_cost() for the n_-th seed with its cost cache.
+    *
+    * It calls improve_cost() if the cost cache is disabled.
+    *
+    * @param num_cost_evaluations_ [in,out] Incremented if the cost is computed.
+    * @param num_cache_hits_       [in,out] Incremented if the cost is found in the cost cache.
+    *
+    * @return true if the cost is improved.
+    */
+   bool improve_cost_cached(
+         int n_,
+         const cv::Mat& f_,
+         const cv::Mat& g_,
+         int x_,
+         int y_,
+         float& u_old_,
+         float& v_old_,
+         float& cost_old_,
+         float u_new_,
+         float v_new_,
+         MatchCost::Kernel cost_kernel_,
+         int half_patch_size_,
+         int& num_cost_evaluations_,
+         int& num_cache_hits_
+   );
+
+   /**
+    * Initialize the properties of every seed from the coarser level and
+    * compute the resulting flows.
+    *
+    * Models provide specialized versions without virtual calls, see CpmImplKernel.
+    *
+    * @param coarse_property_ [in]  Seed-indexed properties at the coarser level.
+    * @param coarser_index_   [in]  Index of the seed at the coarser level of every seed at the finer level, CV_32SC1.
+    * @param fine_seeds_      [in]  Seed coordinates at the finer level.
+    * @param scale_           [in]  Scale from the coarser level to the finer level, larger than 1.
+    * @param fine_property_   [out] Seed-indexed properties at the finer level.
+    * @param fine_u_          [out] Flow of every seed at the finer level in the x-direction, CV_32FC1, num_seeds x 1.
+    * @param fine_v_          [out] Flow of every seed at the finer level in the y-direction, CV_32FC1, num_seeds x 1.
+    */
+   virtual void properties_from_coarser_level(
+         const cv::Mat& coarse_property_,
+         const cv::Mat& coarser_index_,
+         const cv::Mat& fine_seeds_,
+         float scale_,
+         cv::Mat& fine_property_,
+         cv::Mat& fine_u_,
+         cv::Mat& fine_v_
    );
 
+   /**
+    * @param seeds_property_ [in,out] Seed-indexed properties at each level, CV_32FC1, num_seeds x m_num_properties.
+    * @param flows_cost_     [in,out] Seed-indexed matching cost at each level, CV_32FC1, num_seeds x 1.
+    */
    void
    property_init_from_coarser_level(
          const std::vector<cv::Mat>& image1_,
          const std::vector<cv::Mat>& image2_,
          const std::vector<cv::Mat>& seeds_,
+         const std::vector<cv::Mat>& seeds_coarser_index_,
          std::vector<cv::Mat>& seeds_property_,
          std::vector<cv::Mat>& flows_cost_,
          cv::Ptr<MatchCost> cost_func_ptr_,
@@ -72,18 +274,33 @@ public:
          int fine_level_num_
    );
 
+   /**
+    * @param property_           [out] Property of every seed, CV_32FC1, num_seeds x m_num_properties.
+    * @param seeds_              [in]  Seed coordinates, CV_32SC1, 2 columns.
+    * @param max_property_value_ [in]  Properties are drawn from [-max_property_value_, max_property_value_).
+    * @param level_              [in]  Pyramid level, selects the random streams of the seeds, see get_rng().
+    */
    virtual void property_random_init(
          cv::Mat& property_,
          const cv::Mat& seeds_,
-         float max_property_value_
+         float max_property_value_,
+         int level_
    ) = 0;
 
-   virtual void property_to_uv(
+   /**
+    * Convert the property of every seed to flow.
+    *
+    * @param property_ [in]  Property of every seed, CV_32FC1, num_seeds x m_num_properties.
+    * @param seeds_    [in]  Seed coordinates, CV_32SC1, 2 columns.
+    * @param u_        [out] Flow of every seed in the x-direction, CV_32FC1, num_seeds x 1.
+    * @param v_        [out] Flow of every seed in the y-direction, CV_32FC1, num_seeds x 1.
+    */
+   void property_to_uv(
          const cv::Mat& property_,
          const cv::Mat& seeds_,
          cv::Mat& u_,
          cv::Mat& v_
-   ) = 0;
+   );
 
    virtual void property_to_uv(
          const float* p_property_,
@@ -93,10 +310,35 @@ public:
          int y_
    ) = 0;
 
+   /**
+    * Convert a flow to a property, i.e., the inverse of property_to_uv().
+    * Models with more than two properties use a pure translation.
+    *
+    * @param u_           [in]  Flow in the x-direction.
+    * @param v_           [in]  Flow in the y-direction.
+    * @param x_           [in]  x coordinate of the seed.
+    * @param y_           [in]  y coordinate of the seed.
+    * @param p_property_  [out] Property with m_num_properties elements.
+    */
+   virtual void property_from_uv(
+         float u_,
+         float v_,
+         int x_,
+         int y_,
+         float* p_property_
+   ) = 0;
+
+   /**
+    * @param p_old_property_ [in]  Current property of the seed.
+    * @param p_try_property_ [out] A random property around the current one.
+    * @param delta_          [in]  Radius of the search.
+    * @param rng_            [in,out] Random stream of the seed, see get_rng().
+    */
    virtual void random_search(
          const float* p_old_property_,
          float* p_try_property_,
-         float delta_
+         float delta_,
+         Philox& rng_
    ) = 0;
 
    virtual void init_from_coarser_level(
@@ -115,6 +357,83 @@ public:
    void set_is_left_view(bool val_) {m_is_left_view = val_;}
    bool get_is_left_view() const {return m_is_left_view;}
 
+   void set_parallel_propagation(bool val_) {m_parallel_propagation = val_;}
+   bool get_parallel_propagation() const {return m_parallel_propagation;}
+
+   /**
+    * Random stream of a seed.
+    *
+    * The stream is keyed on (random seed, view) and its counter on (seed, level, iteration),
+    * so the result does not depend on the number of threads or on the order of the seeds.
+    *
+    * @param n_         [in] Index of the seed at the level.
+    * @param level_     [in] Pyramid level.
+    * @param iteration_ [in] Iteration of the propagation, E_RNG_INIT_ITERATION for the random initialization.
+    */
+   Philox get_rng(int n_, int level_, int iteration_) const
+   {
+      return Philox((uint32_t)m_random_seed, m_is_left_view ? 0u : 1u,
+                    (uint32_t)n_, (uint32_t)level_, (uint32_t)iteration_);
+   }
+
+   enum {E_RNG_INIT_ITERATION = -1};   //!< iteration of the random initialization in get_rng()
+
+   enum {E_COST_CACHE_SIZE = 8};             //!< number of cost cache entries of a seed, a power of 2
+   enum {E_COST_CACHE_EMPTY_KEY = INT_MIN};  //!< key of unused cost cache entries
+
+   //! Key of an integer displacement in the cost cache
+   static int cost_cache_key(int dx_, int dy_)
+   {
+      return (int)(((unsigned)dy_ << 16) | ((unsigned)dx_ & 0xFFFFu));
+   }
+
+   /**
+    * Look up the cost of an integer displacement of a seed.
+    *
+    * Costs are cached only within property_propagation() of one level, where the cost of a seed
+    * never increases. A cached lower bound is therefore never less than the current cost of the seed,
+    * i.e., if the returned cost is less than the current cost, it is exact.
+    *
+    * @param n_    [in]  Index of the seed.
+    * @param dx_   [in]  Displacement in the x-direction, i.e., the rounded flow.
+    * @param dy_   [in]  Displacement in the y-direction.
+    * @param cost_ [out] Cached cost, if found.
+    *
+    * @return true if the displacement is in the cache, false if the cache is disabled or misses.
+    */
+   bool cost_cache_lookup(int n_, int dx_, int dy_, float& cost_) const
+   {
+      if (m_cost_cache.empty()) return false;
+
+      const CpmCostCacheEntry& entry = m_cost_cache[(size_t)n_*E_COST_CACHE_SIZE + cost_cache_slot(dx_, dy_)];
+      if (entry.m_key != cost_cache_key(dx_, dy_)) return false;
+
+      cost_ = entry.m_cost;
+      return true;
+   }
+
+   //! Save the cost of an integer displacement of a seed, replacing the entry in its slot.
+   void cost_cache_insert(int n_, int dx_, int dy_, float cost_)
+   {
+      if (m_cost_cache.empty()) return;
+
+      CpmCostCacheEntry& entry = m_cost_cache[(size_t)n_*E_COST_CACHE_SIZE + cost_cache_slot(dx_, dy_)];
+      entry.m_key = cost_cache_key(dx_, dy_);
+      entry.m_cost = cost_;
+   }
+
+   void set_random_seed(int val_) {m_random_seed = val_;}
+   int get_random_seed() const {return m_random_seed;}
+
+   //! true if the costs are interpolated bilinearly, see CpmConfig::get_subpixel_cost()
+   bool get_subpixel_cost() const {return m_subpixel_cost;}
+
+   //! Fused kernel of the subpixel costs, may be nullptr, see MatchCost::get_bilinear_kernel()
+   MatchCost::BilinearKernel get_bilinear_kernel() const {return m_bilinear_kernel;}
+
+   //! Statistics of every level of the last call of property_patch_match_impl(), index 0 is the finest level
+   const std::vector<CpmLevelStats>& get_level_stats() const {return m_level_stats;}
+
 private:
    int m_num_properties;
 
@@ -123,6 +442,36 @@ private:
                            //!< stops random search
 
    bool m_is_left_view;
+
+   bool m_parallel_propagation; //!< true to propagate independent seeds concurrently
+
+   int m_random_seed; //!< key of the random streams, see get_rng()
+
+   bool m_subpixel_cost; //!< set from the config in property_patch_match_impl()
+   MatchCost::BilinearKernel m_bilinear_kernel; //!< for the type of the descriptors if m_subpixel_cost is true
+
+   //! direct-mapped: adjacent displacements of a 3x3 neighborhood fall into different slots
+   static int cost_cache_slot(int dx_, int dy_) {return (dx_ + 3*dy_) & (E_COST_CACHE_SIZE - 1);}
+
+   /**
+    * E_COST_CACHE_SIZE entries per seed of the level being propagated, 64 bytes per seed.
+    * It is flushed at the beginning of property_propagation() and empty if the cache is disabled.
+    */
+   std::vector<CpmCostCacheEntry> m_cost_cache;
+
+   /**
+    * Property of every seed at each level, CV_32FC1, num_seeds x m_num_properties.
+    * It is kept across calls of property_patch_match_impl() to reuse the buffers.
+    */
+   std::vector<cv::Mat> m_seeds_property;
+
+   cv::Mat m_fine_u; //!< flow of the fine level initialized from the coarser level, num_seeds x 1
+   cv::Mat m_fine_v; //!< flow of the fine level initialized from the coarser level, num_seeds x 1
+
+   std::vector<cv::Mat> m_warm_start_u; //!< warm-start flow of the seeds at each level in the x-direction
+   std::vector<cv::Mat> m_warm_start_v; //!< warm-start flow of the seeds at each level in the y-direction
+
+   std::vector<CpmLevelStats> m_level_stats; //!< statistics of every level
 };
 
 #endif //_CpmImpl_HPP_
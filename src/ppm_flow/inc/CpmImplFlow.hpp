@@ -25,20 +25,17 @@
  */
 class CpmImplFlow : public CpmImpl
 {
+public:
+   enum {E_NUM_PROPERTIES = 2}; //!< number of properties, known at compile time for CpmImplKernel
+
 public:
    CpmImplFlow();
 
    virtual void property_random_init(
          cv::Mat& property_,
          const cv::Mat& seeds_,
-         float max_property_value_
-   ) override;
-
-   virtual void property_to_uv(
-         const cv::Mat& property_,
-         const cv::Mat& seeds_,
-         cv::Mat& u_,
-         cv::Mat& v_
+         float max_property_value_,
+         int level_
    ) override;
 
    virtual void property_to_uv(
@@ -49,10 +46,19 @@ public:
          int y_
    ) override;
 
+   virtual void property_from_uv(
+         float u_,
+         float v_,
+         int x_,
+         int y_,
+         float* p_property_
+   ) override;
+
    virtual void random_search(
          const float* p_old_property_,
          float* p_try_property_,
-         float delta_
+         float delta_,
+         Philox& rng_
    ) override;
 
    virtual void init_from_coarser_level(
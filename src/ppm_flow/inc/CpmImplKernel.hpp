@@ -0,0 +1,267 @@
+/*  ---------------------------------------------------------------------
+    Copyright 2017 Fangjun Kuang
+    email: csukuangfj at gmail dot com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a COPYING file of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>
+    -----------------------------------------------------------------  */
+#ifndef _CpmImplKernel_HPP_
+#define _CpmImplKernel_HPP_
+
+#include <cstring>
+
+#include "CpmImpl.hpp"
+#include "CpmImplFlow.hpp"
+#include "CpmImplAffineModel.hpp"
+#include "CpmImplQuadraticModel.hpp"
+#include "CpmImplProjectivePlanar.hpp"
+#include "pm_common.hpp"
+
+/**
+ * Propagation kernels specialized for a motion model.
+ *
+ * The model functions are called with qualified names, i.e., without
+ * virtual dispatch, and the number of properties is a compile time constant.
+ * Every model instantiates its kernel in its own translation unit
+ * so that the model math can be inlined into the loops.
+ *
+ * @tparam Model CpmImplFlow, CpmImplAffineModel, CpmImplQuadraticModel or CpmImplProjectivePlanar
+ */
+template<class Model>
+class CpmImplKernel : public Model
+{
+public:
+   enum {E_NUM_PROPERTIES = Model::E_NUM_PROPERTIES};
+
+   virtual int propagate_seed(
+         int n_,
+         const std::vector<int>& neighbor_index_,
+         cv::Mat& property_,
+         const cv::Mat& f_,
+         const cv::Mat& g_,
+         cv::Mat& cost_,
+         MatchCost::Kernel cost_kernel_,
+         float max_search_radius_,
+         const cv::Mat& seed_coord_,
+         const cv::Mat& neighbors_,
+         int half_patch_size_,
+         int level_,
+         int iteration_,
+         float* p_try_property_,
+         int& num_cost_evaluations_,
+         int& num_cache_hits_
+   ) override;
+
+   virtual void properties_from_coarser_level(
+         const cv::Mat& coarse_property_,
+         const cv::Mat& coarser_index_,
+         const cv::Mat& fine_seeds_,
+         float scale_,
+         cv::Mat& fine_property_,
+         cv::Mat& fine_u_,
+         cv::Mat& fine_v_
+   ) override;
+};
+
+template<class Model>
+int
+CpmImplKernel<Model>::propagate_seed(
+      int n_,
+      const std::vector<int>& neighbor_index_,
+      cv::Mat &property_,
+      const cv::Mat &f_,
+      const cv::Mat &g_,
+      cv::Mat &cost_,
+      MatchCost::Kernel cost_kernel_,
+      float max_search_radius_,
+      const cv::Mat &seed_coord_,
+      const cv::Mat &neighbors_,
+      int half_patch_size_,
+      int level_,
+      int iteration_,
+      float* p_try_property_,
+      int& num_cost_evaluations_,
+      int& num_cache_hits_
+)
+{
+   bool is_improved;
+   int num_improved = 0;
+
+   const int* p_coord = seed_coord_.ptr<int>(n_);
+   int x = p_coord[0];
+   int y = p_coord[1];
+
+   float* p_property = property_.ptr<float>(n_);
+   float old_u, old_v;
+   Model::property_to_uv(p_property, old_u, old_v, x, y);
+
+   float& old_cost = cost_.at<float>(n_);
+
+   const int* p_neighbors = neighbors_.ptr<int>(n_);
+   int nz = (int)neighbor_index_.size();
+   CV_Assert(nz <= 8);
+
+   // gather the flows of the neighbors and evaluate them in one batch
+   int candidate_seeds[8];
+   float candidate_u[8];
+   float candidate_v[8];
+   cv::Point candidates[8];
+   float candidate_costs[8];
+   int num_candidates = 0;
+
+   // candidates that are not in the cost cache
+   int miss_index[8];
+   cv::Point miss_candidates[8];
+   float miss_costs[8];
+   int num_misses = 0;
+
+   for (int k = 0; k < nz; k++)
+   {
+      int index = p_neighbors[neighbor_index_[k]];
+      if (index == -1) continue; // the seed is on the corners or at the boundaries
+
+      float try_u, try_v;
+      Model::property_to_uv(property_.ptr<float>(index), try_u, try_v, x, y);
+
+      if ((cv::abs(try_u - old_u) < 1e-5) && (cv::abs(try_v - old_v) < 1e-5))
+      {
+         continue;
+      }
+
+      candidate_seeds[num_candidates] = index;
+      candidate_u[num_candidates] = try_u;
+      candidate_v[num_candidates] = try_v;
+      candidates[num_candidates] = cv::Point(cvRound(x + try_u), cvRound(y + try_v));
+
+      if (this->cost_cache_lookup(n_, candidates[num_candidates].x - x, candidates[num_candidates].y - y,
+                                  candidate_costs[num_candidates]))
+      {
+         num_cache_hits_++;
+      }
+      else
+      {
+         miss_index[num_misses] = num_candidates;
+         miss_candidates[num_misses] = candidates[num_candidates];
+         num_misses++;
+      }
+      num_candidates++;
+   }
+
+   if (this->get_subpixel_cost())
+   {
+      // the cost cache is disabled, so every candidate is a miss
+      for (int k = 0; k < num_candidates; k++)
+      {
+         if (!compute_subpixel_cost(f_, g_, x, y, x + candidate_u[k], y + candidate_v[k], cost_kernel_,
+                                    this->get_bilinear_kernel(), half_patch_size_, candidate_costs[k]))
+         {
+            candidate_costs[k] = FLT_MAX;
+         }
+      }
+      num_cost_evaluations_ += num_candidates;
+      num_misses = 0;
+   }
+
+   // candidates that cannot beat the current cost need no exact cost
+   num_cost_evaluations_ += MatchCost::compute_cost_batch(cost_kernel_, f_, g_, x, y,
+                                                          miss_candidates, num_misses, miss_costs, half_patch_size_,
+                                                          -1, old_cost);
+   for (int k = 0; k < num_misses; k++)
+   {
+      const cv::Point& p = miss_candidates[k];
+      candidate_costs[miss_index[k]] = miss_costs[k];
+      this->cost_cache_insert(n_, p.x - x, p.y - y, miss_costs[k]);
+   }
+
+   // accept them in order, as if they were evaluated one after another
+   for (int k = 0; k < num_candidates; k++)
+   {
+      if (candidate_costs[k] < old_cost)
+      {
+         old_cost = candidate_costs[k];
+         old_u = candidate_u[k];
+         old_v = candidate_v[k];
+         memcpy(p_property, property_.ptr<float>(candidate_seeds[k]), sizeof(float)*E_NUM_PROPERTIES);
+         num_improved++;
+      }
+   }
+
+   // random search
+   float min_search_value = this->get_min_search_value();
+   Philox rng = this->get_rng(n_, level_, iteration_);
+   for (float delta = max_search_radius_; delta > min_search_value; delta /= 2)
+   {
+      Model::random_search(p_property, p_try_property_, delta, rng);
+
+      float try_u, try_v;
+      Model::property_to_uv(p_try_property_, try_u, try_v, x, y);
+
+      if ((cv::abs(try_u - old_u) < 1e-5) && (cv::abs(try_v - old_v) < 1e-5))
+      {
+         continue;
+      }
+
+      is_improved = this->improve_cost_cached(n_, f_, g_, x, y, old_u, old_v, old_cost, try_u, try_v, cost_kernel_,
+                                              half_patch_size_, num_cost_evaluations_, num_cache_hits_);
+      if (is_improved)
+      {
+         memcpy(p_property, p_try_property_, sizeof(float)*E_NUM_PROPERTIES);
+         num_improved++;
+      }
+   }
+
+   return num_improved;
+}
+
+template<class Model>
+void
+CpmImplKernel<Model>::properties_from_coarser_level(
+      const cv::Mat& coarse_property_,
+      const cv::Mat& coarser_index_,
+      const cv::Mat& fine_seeds_,
+      float scale_,
+      cv::Mat& fine_property_,
+      cv::Mat& fine_u_,
+      cv::Mat& fine_v_
+)
+{
+   int num_seeds = fine_seeds_.rows;
+   CV_Assert(coarser_index_.rows == num_seeds);
+   CV_Assert(coarser_index_.type() == CV_32SC1);
+   CV_Assert(coarse_property_.cols == E_NUM_PROPERTIES);
+
+   fine_property_.create(num_seeds, E_NUM_PROPERTIES, CV_32FC1);
+   fine_u_.create(num_seeds, 1, CV_32FC1);
+   fine_v_.create(num_seeds, 1, CV_32FC1);
+
+   float* p_u = fine_u_.ptr<float>(0);
+   float* p_v = fine_v_.ptr<float>(0);
+   const int* p_coarser_index = coarser_index_.ptr<int>(0);
+
+   for (int n = 0; n < num_seeds; n++)
+   {
+      const int* p_coord = fine_seeds_.ptr<int>(n);
+      float* p_property_fine_level = fine_property_.ptr<float>(n);
+
+      Model::init_from_coarser_level(coarse_property_.ptr<float>(p_coarser_index[n]), p_property_fine_level, scale_);
+      Model::property_to_uv(p_property_fine_level, p_u[n], p_v[n], p_coord[0], p_coord[1]);
+   }
+}
+
+// instantiated in the translation unit of every model
+extern template class CpmImplKernel<CpmImplFlow>;
+extern template class CpmImplKernel<CpmImplAffineModel>;
+extern template class CpmImplKernel<CpmImplQuadraticModel>;
+extern template class CpmImplKernel<CpmImplProjectivePlanar>;
+
+#endif //_CpmImplKernel_HPP_
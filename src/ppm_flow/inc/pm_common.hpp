@@ -24,6 +24,18 @@
 bool
 is_inside(int x, int w);
 
+bool
+compute_subpixel_cost(const cv::Mat& f_,
+                      const cv::Mat& g_,
+                      int x_,
+                      int y_,
+                      float x2_,
+                      float y2_,
+                      MatchCost::Kernel cost_kernel_,
+                      MatchCost::BilinearKernel bilinear_kernel_,
+                      int half_patch_size_,
+                      float& cost_);
+
 bool
 improve_cost(const cv::Mat& f_,
              const cv::Mat& g_,
@@ -34,8 +46,10 @@ improve_cost(const cv::Mat& f_,
              float& cost_old_,
              float u_new_,
              float v_new_,
-             cv::Ptr<MatchCost> cost_func_ptr_,
-             int half_patch_size_);
+             MatchCost::Kernel cost_kernel_,
+             int half_patch_size_,
+             bool subpixel_ = false,
+             MatchCost::BilinearKernel bilinear_kernel_ = nullptr);
 
 void
 compute_cost(
@@ -46,6 +60,16 @@ compute_cost(
       cv::Mat& cost_,
       const cv::Ptr<MatchCost> cost_func_ptr_,
       const cv::Mat& seeds_,
-      int half_path_size_
+      int half_path_size_,
+      bool subpixel_ = false
+);
+
+void
+seeds_to_dense_map(
+      const cv::Mat& values_,
+      const cv::Mat& seeds_,
+      const cv::Size& size_,
+      cv::Mat& map_,
+      float default_value_ = 0
 );
 #endif //_pm_common_HPP_
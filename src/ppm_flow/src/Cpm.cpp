@@ -15,12 +15,14 @@
     You should have received a COPYING file of the GNU General Public License
     along with this program. If not, see <http://www.gnu.org/licenses/>
     -----------------------------------------------------------------  */
+#include <algorithm>
 #include <iostream>
 #include <opencv2/imgproc.hpp>
 
 #include "MyTimer.hpp"
 
 #include "MyImageProcessing.hpp"
+#include "PackedHammingCost.hpp"
 
 #include "Cpm.hpp"
 #include "CpmImpl.hpp"
@@ -38,21 +40,26 @@ static const int g_invalid_flow = 10000;
 /**
  * Internal implementation for Coarse-to-fine PatchMatch (CPM).
  *
- * Since the neighbors of a seed do not change across levels,
- * seed_neighbors is not a vector of cv::Mat.
+ * Seeds that collapse onto the same pixel at a coarse level are merged,
+ * so every level has its own seeds and neighbors.
  *
+ * @param impl_             [in] Implementation of the property type of config_.
  * @param image1_           [in] Image pyramid. The 0th element is the reference frame, which is the raw image.
  * @param image2_           [in] Image pyramid.
- * @param flows_u_          [out] Flow field for each level in the x-direction.
- * @param flows_v_          [out] Flow field for each level in the y-direction.
- * @param flows_cost_       [out] Flow matching cost for (flows_u_, flows_v_).
+ * @param flows_u_          [out] Flow of every seed for each level in the x-direction, CV_32FC1, num_seeds x 1.
+ * @param flows_v_          [out] Flow of every seed for each level in the y-direction, CV_32FC1, num_seeds x 1.
+ * @param flows_cost_       [out] Flow matching cost for (flows_u_, flows_v_), CV_32FC1, num_seeds x 1.
  * @param cost_func_ptr_    [in] Pointer to the function for computing matching cost.
  * @param seeds_            [in] Pixel coordinates of every seed in each level.
- * @param seed_neighbors_   [in] Neighbor indices of a seed.
+ * @param seed_neighbors_   [in] Neighbor indices of every seed in each level.
+ * @param seeds_coarser_index_ [in] Index of the seed at the next coarser level of every seed in each level.
  * @param config_           [in] CPM configuration.
+ * @param warm_start_u_     [in] Optional warm-start flow of every seed at level 0 in the x-direction, CV_32FC1, num_seeds x 1.
+ * @param warm_start_v_     [in] Optional warm-start flow of every seed at level 0 in the y-direction, CV_32FC1, num_seeds x 1.
  */
 static void
 patch_match_impl(
+      CpmImpl& impl_,
       const std::vector<cv::Mat>& image1_,
       const std::vector<cv::Mat>& image2_,
       std::vector<cv::Mat>& flows_u_,
@@ -60,23 +67,109 @@ patch_match_impl(
       std::vector<cv::Mat>& flows_cost_,
       cv::Ptr<MatchCost> cost_func_ptr_,
       const std::vector<cv::Mat>& seeds_,
-      const cv::Mat& seed_neighbors_,
+      const std::vector<cv::Mat>& seed_neighbors_,
+      const std::vector<cv::Mat>& seeds_coarser_index_,
       const CpmConfig& config_,
-      CpmConfig::ViewIndex view_index_
+      CpmConfig::ViewIndex view_index_,
+      const cv::Mat& warm_start_u_,
+      const cv::Mat& warm_start_v_
 )
 {
-   auto ptr_cpm_impl = CpmImpl::create(config_.get_pm_property_type());
-   CV_Assert(!ptr_cpm_impl.empty());
-   ptr_cpm_impl->set_is_left_view(CpmConfig::ViewIndex::E_LEFT_VIEW == view_index_);
-   ptr_cpm_impl->property_patch_match_impl(image1_, image2_, flows_u_, flows_v_, flows_cost_, cost_func_ptr_, seeds_, seed_neighbors_, config_);
+   impl_.set_is_left_view(CpmConfig::ViewIndex::E_LEFT_VIEW == view_index_);
+   impl_.set_parallel_propagation(config_.get_parallel_propagation());
+   impl_.property_patch_match_impl(image1_, image2_, flows_u_, flows_v_, flows_cost_, cost_func_ptr_, seeds_, seed_neighbors_,
+                                   seeds_coarser_index_, config_, warm_start_u_, warm_start_v_);
 }
 
+/**
+ * Parallel loop body for running the left view and the right view
+ * patch match concurrently.
+ *
+ * The two views share only read-only inputs. Each view writes to
+ * its own output vectors and uses its own CpmImpl instance.
+ */
+class PatchMatchLoopBody : public cv::ParallelLoopBody
+{
+public:
+   PatchMatchLoopBody(
+         const std::vector<cv::Mat>& f_descriptor_,
+         const std::vector<cv::Mat>& g_descriptor_,
+         const cv::Ptr<CpmImpl>* impls_,              // array of 2 elements, one for each view
+         std::vector<cv::Mat>* const* flows_u_,       // array of 2 elements, one for each view
+         std::vector<cv::Mat>* const* flows_v_,       // array of 2 elements, one for each view
+         std::vector<cv::Mat>* const* flows_cost_,    // array of 2 elements, one for each view
+         cv::Ptr<MatchCost> cost_func_ptr_,
+         const std::vector<cv::Mat>& seeds_,
+         const std::vector<cv::Mat>& seed_neighbors_,
+         const std::vector<cv::Mat>& seeds_coarser_index_,
+         const CpmConfig& config_,
+         const cv::Mat* warm_start_u_,                // array of 2 elements, one for each view
+         const cv::Mat* warm_start_v_                 // array of 2 elements, one for each view
+   )
+      : m_f_descriptor(f_descriptor_),
+        m_g_descriptor(g_descriptor_),
+        m_impls(impls_),
+        m_flows_u(flows_u_),
+        m_flows_v(flows_v_),
+        m_flows_cost(flows_cost_),
+        m_cost_func_ptr(cost_func_ptr_),
+        m_seeds(seeds_),
+        m_seed_neighbors(seed_neighbors_),
+        m_seeds_coarser_index(seeds_coarser_index_),
+        m_config(config_),
+        m_warm_start_u(warm_start_u_),
+        m_warm_start_v(warm_start_v_)
+   {}
+
+   virtual void operator ()(const cv::Range& range) const
+   {
+      for (int i = range.start; i < range.end; i++)
+      {
+         if (i == CpmConfig::ViewIndex::E_LEFT_VIEW)
+         {
+            patch_match_impl(*m_impls[i], m_f_descriptor, m_g_descriptor, *m_flows_u[i], *m_flows_v[i], *m_flows_cost[i],
+                             m_cost_func_ptr, m_seeds, m_seed_neighbors, m_seeds_coarser_index, m_config,
+                             CpmConfig::ViewIndex::E_LEFT_VIEW,
+                             m_warm_start_u[i], m_warm_start_v[i]);
+         }
+         else
+         {
+            patch_match_impl(*m_impls[i], m_g_descriptor, m_f_descriptor, *m_flows_u[i], *m_flows_v[i], *m_flows_cost[i],
+                             m_cost_func_ptr, m_seeds, m_seed_neighbors, m_seeds_coarser_index, m_config,
+                             CpmConfig::ViewIndex::E_RIGHT_VIEW,
+                             m_warm_start_u[i], m_warm_start_v[i]);
+         }
+      }
+   }
+
+private:
+   const std::vector<cv::Mat>& m_f_descriptor;
+   const std::vector<cv::Mat>& m_g_descriptor;
+   const cv::Ptr<CpmImpl>* m_impls;
+   std::vector<cv::Mat>* const* m_flows_u;
+   std::vector<cv::Mat>* const* m_flows_v;
+   std::vector<cv::Mat>* const* m_flows_cost;
+   cv::Ptr<MatchCost> m_cost_func_ptr;
+   const std::vector<cv::Mat>& m_seeds;
+   const std::vector<cv::Mat>& m_seed_neighbors;
+   const std::vector<cv::Mat>& m_seeds_coarser_index;
+   const CpmConfig& m_config;
+   const cv::Mat* m_warm_start_u;
+   const cv::Mat* m_warm_start_v;
+};
+
 Cpm::Cpm(
       const cv::Mat& image1_,
       const cv::Mat& image2_,
       const CpmConfig& config_,
       cv::Ptr<MatchCost> cost_ptr_
 )
+   : m_seeds_grid_space(0),
+     m_seeds_num_levels(0),
+     m_seeds_pyramid_ratio(0),
+     m_seeds_order(CpmConfig::SeedOrder::E_SEED_ORDER_ROW_MAJOR),
+     m_seeds_merged(false),
+     m_num_stream_frames(0)
 {
    init(image1_, image2_, config_, cost_ptr_);
 }
@@ -95,30 +188,171 @@ Cpm::init(
    CV_Assert((image1_.depth() == CV_8U)  ||
              (image1_.depth() == CV_32F));
 
-   if (image1_.depth() == CV_8U)
+   if (config_.get_tile_memory_budget() > 0)
+   {
+      // every tile converts only its own part of the frames
+      m_f = image1_;
+      m_g = image2_;
+   }
+   else if (image1_.depth() == CV_8U)
    {
-      image1_.convertTo(m_f, CV_32F);
-      image2_.convertTo(m_g, CV_32F);
+      // the buffers are reused if the size does not change
+      image1_.convertTo(m_f_buffer, CV_32F);
+      image2_.convertTo(m_g_buffer, CV_32F);
+      m_f = m_f_buffer;
+      m_g = m_g_buffer;
    }
    else if (image1_.depth() == CV_32F)
    {
-      m_f = image1_.clone();
-      m_g = image2_.clone();
+      // no copy, the frames are only read
+      m_f = image1_;
+      m_g = image2_;
    }
    else
    {
       CV_Assert(false); // unreachable code
    }
 
+   init_config(config_, cost_ptr_);
+   m_num_stream_frames = 0;
+}
+
+void
+Cpm::init_config(
+      const CpmConfig& config_,
+      cv::Ptr<MatchCost> cost_ptr_
+)
+{
    m_config = config_;
    m_cost_ptr = cost_ptr_;
+
+   CpmConfig::PmPropertyType type = m_config.get_pm_property_type();
+   if (m_impl[0].empty() || (m_impl_type != type))
+   {
+      m_impl[0] = CpmImpl::create(type);
+      m_impl[1] = CpmImpl::create(type);
+      CV_Assert(!m_impl[0].empty() && !m_impl[1].empty());
+      m_impl_type = type;
+   }
+
+   // the basis is loaded once and shared by all frames
+   if ((m_config.get_descriptor_type() == DescriptorType::E_DESC_TYPE_PCA_SIFT) &&
+       (m_pca_basis.empty() || (m_pca_basis_filename != m_config.get_pca_sift_basis_filename())))
+   {
+      m_pca_basis_filename = m_config.get_pca_sift_basis_filename();
+      bool is_loaded = SiftDescriptor::load_pca_basis(m_pca_basis_filename, m_pca_basis);
+      if (!is_loaded)
+      {
+         std::cerr << "File '" << m_pca_basis_filename << "' cannot be read!" << std::endl;
+      }
+      CV_Assert(is_loaded);
+   }
+}
+
+void
+Cpm::init_stream(
+      const CpmConfig& config_,
+      cv::Ptr<MatchCost> cost_ptr_
+)
+{
+   init_config(config_, cost_ptr_);
+   m_num_stream_frames = 0;
+}
+
+bool
+Cpm::push_frame(const cv::Mat& frame_)
+{
+   CV_Assert(m_config.get_tile_memory_budget() <= 0); // frames of a stream are not tiled
+   CV_Assert(!frame_.empty());
+   CV_Assert((frame_.depth() == CV_8U) ||
+             (frame_.depth() == CV_32F));
+   CV_Assert(!m_cost_ptr.empty());
+
+   MyTimer timer;
+   bool verbose = m_config.get_verbose();
+
+   bool is_pair = (m_num_stream_frames > 0) &&
+                  (frame_.size() == m_g.size()) &&
+                  (CV_MAKETYPE(CV_32F, frame_.channels()) == m_g.type());
+   if (is_pair)
+   {
+      // the previous frame becomes the reference frame,
+      // together with its pyramid and descriptors
+      cv::swap(m_f_buffer, m_g_buffer);
+      m_f_pyramid.swap(m_g_pyramid);
+      m_f_pyramid_descriptor.swap(m_g_pyramid_descriptor);
+      m_f = m_f_buffer;
+   }
+   else
+   {
+      m_num_stream_frames = 0; // restart the stream if the frame size changes
+      m_stream_flow_u.release();
+      m_stream_flow_v.release();
+   }
+
+   // the frame is always copied since the caller may reuse its buffer for the next frame
+   frame_.convertTo(m_g_buffer, CV_32F);
+   m_g = m_g_buffer;
+   m_num_stream_frames++;
+
+   timer.start();
+   init_frame_pyramid(m_g, m_g_pyramid);
+   compute_frame_descriptor(m_g_pyramid, m_g_pyramid_descriptor);
+   timer.stop();
+   if (verbose)
+   {
+      std::cout << "pyramid and descriptor of the new frame took " << timer.get_s() << " s" << std::endl;
+   }
+
+   if (!is_pair)
+   {
+      return false;
+   }
+
+   CV_Assert(m_f_pyramid_descriptor.size() == m_g_pyramid_descriptor.size());
+
+   init_seeds();
+
+   // constant motion: the flow of the previous pair is the prior of this pair
+   if (m_config.get_warm_start() && (m_stream_flow_u.rows == m_num_seeds))
+   {
+      m_stream_flow_u.copyTo(m_warm_start_u);
+      m_stream_flow_v.copyTo(m_warm_start_v);
+   }
+
+   timer.start();
+   run_patch_match();
+   timer.stop();
+   if (verbose)
+   {
+      std::cout << "run_patch_match took " << timer.get_s() << " s" << std::endl;
+   }
+
+   if (m_config.get_warm_start())
+   {
+      // the flow of the left view before the cross check, i.e., every seed has a flow
+      m_seeds_flow_u[0].copyTo(m_stream_flow_u);
+      m_seeds_flow_v[0].copyTo(m_stream_flow_v);
+   }
+
+   return true;
+}
+
+void
+Cpm::set_warm_start_flow(const cv::Mat& u_, const cv::Mat& v_)
+{
+   CV_Assert(u_.type() == CV_32FC1);
+   CV_Assert(v_.type() == CV_32FC1);
+   CV_Assert(u_.size() == v_.size());
+
+   u_.copyTo(m_warm_start_flow_u);
+   v_.copyTo(m_warm_start_flow_v);
 }
 
 void
 Cpm::compute_optical_flow()
 {
    MyTimer timer;
-   cv::setRNGSeed(100); // make the result reproducible
 
    bool verbose = m_config.get_verbose();
    if (verbose)
@@ -126,6 +360,35 @@ Cpm::compute_optical_flow()
       m_config.show_parameters();
    }
 
+   if (m_config.get_tile_memory_budget() > 0)
+   {
+      timer.start();
+      compute_optical_flow_tiled();
+      timer.stop();
+      if (verbose)
+      {
+         std::cout << "compute_optical_flow_tiled took " << timer.get_s() << " s" << std::endl;
+      }
+      return;
+   }
+
+   compute_seeds_flow();
+
+   timer.start();
+   seeds_flow_to_dense();
+   timer.stop();
+   if (verbose)
+   {
+      std::cout << "seeds_flow_to_dense took " << timer.get_s() << " s" << std::endl;
+   }
+}
+
+void
+Cpm::compute_seeds_flow()
+{
+   MyTimer timer;
+   bool verbose = m_config.get_verbose();
+
    timer.start();
    init_pyramid();
    timer.stop();
@@ -134,6 +397,15 @@ Cpm::compute_optical_flow()
       std::cout << "init_pyramid took " << timer.get_s() << " s" << std::endl;
    }
 
+   // the seeds depend only on the size of the pyramid and select the descriptors of the first frame
+   timer.start();
+   init_seeds();
+   timer.stop();
+   if (verbose)
+   {
+      std::cout << "init_seeds took " << timer.get_s() << " s" << std::endl;
+   }
+
    timer.start();
    compute_descriptor();
    timer.stop();
@@ -143,173 +415,856 @@ Cpm::compute_optical_flow()
    }
 
    timer.start();
-   init_seeds();
+   run_seeds_patch_match();
    timer.stop();
    if (verbose)
    {
-      std::cout << "init_seeds took " << timer.get_s() << " s" << std::endl;
+      std::cout << "run_seeds_patch_match took " << timer.get_s() << " s" << std::endl;
+   }
+}
+
+/**
+ * A tile of the tiled execution.
+ *
+ * Both the region and the core are aligned to the seed grid of the whole frame.
+ */
+struct CpmTile
+{
+   cv::Rect m_region;  //!< pixels of the frames processed by the tile, i.e., the core plus the halo
+   cv::Rect m_core;    //!< seeds owned by the tile, in units of seeds of the whole frame
+};
+
+/**
+ * Parallel loop body for processing the tiles.
+ *
+ * Worker w processes tiles w, w + num_workers, ... with its own Cpm instance,
+ * so at most num_workers tiles are in memory at the same time.
+ */
+class TileLoopBody : public cv::ParallelLoopBody
+{
+public:
+   TileLoopBody(
+         Cpm& cpm_,
+         const std::vector<CpmTile>& tiles_,
+         std::vector<cv::Ptr<Cpm> >& workers_,
+         const cv::Mat& f_,
+         const cv::Mat& g_,
+         const cv::Mat& warm_start_u_,
+         const cv::Mat& warm_start_v_,
+         const CpmConfig& tile_config_,
+         cv::Ptr<MatchCost> cost_ptr_,
+         void (Cpm::*compute_)(),
+         void (Cpm::*stitch_)(const Cpm&, const cv::Point&, const cv::Rect&)
+   )
+      : m_cpm(cpm_),
+        m_tiles(tiles_),
+        m_workers(workers_),
+        m_f(f_),
+        m_g(g_),
+        m_warm_start_u(warm_start_u_),
+        m_warm_start_v(warm_start_v_),
+        m_tile_config(tile_config_),
+        m_cost_ptr(cost_ptr_),
+        m_compute(compute_),
+        m_stitch(stitch_)
+   {}
+
+   virtual void operator ()(const cv::Range& range) const
+   {
+      int num_workers = (int)m_workers.size();
+      int grid_space = m_tile_config.get_grid_space();
+
+      for (int w = range.start; w < range.end; w++)
+      {
+         Cpm& worker = *m_workers[w];
+         for (size_t t = (size_t)w; t < m_tiles.size(); t += (size_t)num_workers)
+         {
+            const cv::Rect& region = m_tiles[t].m_region;
+
+            worker.init(m_f(region), m_g(region), m_tile_config, m_cost_ptr);
+            if (!m_warm_start_u.empty())
+            {
+               worker.set_warm_start_flow(m_warm_start_u(region), m_warm_start_v(region));
+            }
+            // only the seed flows are stitched; the whole frame does the cross check and the dense flow
+            (worker.*m_compute)();
+
+            // the tiles own disjoint seeds, so they can be stitched concurrently
+            cv::Point origin(region.x / grid_space, region.y / grid_space);
+            (m_cpm.*m_stitch)(worker, origin, m_tiles[t].m_core);
+         }
+      }
+   }
+
+private:
+   Cpm& m_cpm;
+   const std::vector<CpmTile>& m_tiles;
+   std::vector<cv::Ptr<Cpm> >& m_workers;
+   const cv::Mat& m_f;
+   const cv::Mat& m_g;
+   const cv::Mat& m_warm_start_u;
+   const cv::Mat& m_warm_start_v;
+   const CpmConfig& m_tile_config;
+   cv::Ptr<MatchCost> m_cost_ptr;
+   void (Cpm::*m_compute)();
+   void (Cpm::*m_stitch)(const Cpm&, const cv::Point&, const cv::Rect&);
+};
+
+/**
+ * Split the seed grid of one axis into the cores of the tiles.
+ *
+ * @param size_         [in]  Image size along the axis.
+ * @param num_seeds_    [in]  Number of seeds along the axis.
+ * @param grid_space_   [in]  Grid space.
+ * @param core_size_    [in]  Core size of a tile in pixels, a multiple of grid_space_ unless it covers the image.
+ * @param halo_         [in]  Halo around the core in pixels.
+ * @param cores_        [out] Range of seeds owned by every tile.
+ * @param regions_      [out] Range of pixels processed by every tile.
+ */
+static void
+split_tile_axis(
+      int size_,
+      int num_seeds_,
+      int grid_space_,
+      int core_size_,
+      int halo_,
+      std::vector<cv::Range>& cores_,
+      std::vector<cv::Range>& regions_
+)
+{
+   cores_.clear();
+   regions_.clear();
+
+   for (int start = 0; start < size_; start += core_size_)
+   {
+      int end = start + core_size_;
+
+      int first_seed = start / grid_space_;
+      int last_seed = (end >= size_) ? num_seeds_ : (end / grid_space_);
+      if (first_seed >= last_seed) continue;
+
+      // the region starts at a multiple of the grid space so that the seeds
+      // of the tile coincide with the seeds of the whole frame
+      int region_start = (cv::max(start - halo_, 0) / grid_space_) * grid_space_;
+      int region_end = cv::min(end + halo_, size_);
+
+      cores_.push_back(cv::Range(first_seed, last_seed));
+      regions_.push_back(cv::Range(region_start, region_end));
+   }
+}
+
+double
+Cpm::estimate_tile_bytes_per_pixel()
+{
+   int cn = m_f.channels();
+
+   // the descriptor size is found from a small image
+   std::vector<cv::Mat> pyramid(1), descriptor;
+   pyramid[0].create(32, 32, CV_32FC(cn));
+   pyramid[0] = 0;
+   compute_frame_descriptor(pyramid, descriptor);
+   double descriptor_bytes = (double)descriptor[0].elemSize();
+
+   // the area of the pyramid is 1 + r^2 + r^4 + ... of the finest level
+   float ratio = m_config.get_pyramid_ratio();
+   double pyramid_factor = 1.0 / (1.0 - (double)ratio*ratio);
+
+   double frame_bytes = 2.0 * sizeof(float) * cn;                                    // m_f, m_g
+   double pyramid_bytes = pyramid_factor * 2.0 * (sizeof(float) * cn + descriptor_bytes); // pyramids and descriptors of both frames
+
+   // a tile computes only the seed flows, see compute_seeds_flow()
+   return frame_bytes + pyramid_bytes;
+}
+
+void
+Cpm::compute_optical_flow_tiled()
+{
+   CV_Assert(!m_f.empty());
+   CV_Assert(m_f.size() == m_g.size());
+   CV_Assert(m_config.get_pyramid_ratio() < 1);
+
+   bool verbose = m_config.get_verbose();
+
+   // only the seeds at level 0 are needed for stitching
+   init_seeds(1);
+
+   int grid_space = m_config.get_grid_space();
+   int halo = m_config.get_max_displacement() + m_config.get_half_patch_size();
+
+   int num_workers = m_config.get_parallel_tiles() ? cv::max(cv::getNumThreads(), 1) : 1;
+
+   double budget = (double)m_config.get_tile_memory_budget() * 1024 * 1024;
+   double max_pixels = budget / (num_workers * estimate_tile_bytes_per_pixel());
+
+   // square tiles unless the frame is narrower than a tile
+   int width = m_f.cols;
+   int height = m_f.rows;
+
+   int core_width = (int)std::sqrt(max_pixels) - 2*halo;
+   if (core_width >= width)
+   {
+      core_width = width;
+   }
+   else
+   {
+      core_width = (core_width / grid_space) * grid_space;
+   }
+   CV_Assert(core_width >= grid_space); // the memory budget is too small for the halo
+
+   int core_height = (int)(max_pixels / cv::min(core_width + 2*halo, width)) - 2*halo;
+   if (core_height >= height)
+   {
+      core_height = height;
+   }
+   else
+   {
+      core_height = (core_height / grid_space) * grid_space;
+   }
+   CV_Assert(core_height >= grid_space); // the memory budget is too small for the halo
+
+   std::vector<cv::Range> cores_x, regions_x, cores_y, regions_y;
+   split_tile_axis(width, m_seeds_per_row, grid_space, core_width, halo, cores_x, regions_x);
+   split_tile_axis(height, m_seeds_per_col, grid_space, core_height, halo, cores_y, regions_y);
+
+   std::vector<CpmTile> tiles;
+   for (size_t j = 0; j < cores_y.size(); j++)
+   {
+      for (size_t i = 0; i < cores_x.size(); i++)
+      {
+         CpmTile tile;
+         tile.m_region = cv::Rect(regions_x[i].start, regions_y[j].start,
+                                  regions_x[i].size(), regions_y[j].size());
+         tile.m_core = cv::Rect(cores_x[i].start, cores_y[j].start,
+                                cores_x[i].size(), cores_y[j].size());
+         tiles.push_back(tile);
+      }
+   }
+
+   num_workers = cv::min(num_workers, (int)tiles.size());
+   if (verbose)
+   {
+      std::cout << "tiled execution: " << tiles.size() << " tiles of " << core_width << "x" << core_height
+                << " pixels with a halo of " << halo << " pixels, " << num_workers << " worker(s)" << std::endl;
+   }
+
+   // every seed is owned by exactly one tile
+   m_seeds_flow_u.resize(1);
+   m_seeds_flow_v.resize(1);
+   m_seeds_flow_cost.resize(1);
+   m_seeds_flow_u[0].create(m_num_seeds, 1, CV_32FC1);
+   m_seeds_flow_v[0].create(m_num_seeds, 1, CV_32FC1);
+   m_seeds_flow_cost[0].create(m_num_seeds, 1, CV_32FC1);
+   if (m_config.get_cross_check())
+   {
+      m_right_seeds_flow_u.resize(1);
+      m_right_seeds_flow_v.resize(1);
+      m_right_seeds_flow_cost.resize(1);
+      m_right_seeds_flow_u[0].create(m_num_seeds, 1, CV_32FC1);
+      m_right_seeds_flow_v[0].create(m_num_seeds, 1, CV_32FC1);
+      m_right_seeds_flow_cost[0].create(m_num_seeds, 1, CV_32FC1);
+   }
+
+   CpmConfig tile_config = m_config;
+   tile_config.set_tile_memory_budget(0);
+   tile_config.set_verbose(false);
+
+   // the workers share the time budget of the frame
+   tile_config.set_time_budget(m_config.get_time_budget() * num_workers / (float)tiles.size());
+
+   while ((int)m_tile_workers.size() < num_workers)
+   {
+      m_tile_workers.push_back(cv::makePtr<Cpm>());
+   }
+   m_tile_workers.resize((size_t)num_workers);
+
+   // the warm-start flow is used only once
+   cv::Mat warm_start_u, warm_start_v;
+   if (m_warm_start_flow_u.size() == m_f.size())
+   {
+      warm_start_u = m_warm_start_flow_u;
+      warm_start_v = m_warm_start_flow_v;
+   }
+
+   TileLoopBody loop_body(*this, tiles, m_tile_workers, m_f, m_g, warm_start_u, warm_start_v,
+                          tile_config, m_cost_ptr, &Cpm::compute_seeds_flow, &Cpm::stitch_tile_seeds);
+   cv::parallel_for_(cv::Range(0, num_workers), loop_body, num_workers);
+
+   m_warm_start_flow_u.release();
+   m_warm_start_flow_v.release();
+
+   // the cross check of the whole frame sees the same flows as without tiling
+   seeds_flow_to_dense();
+}
+
+void
+Cpm::stitch_tile_seeds(const Cpm& tile_, const cv::Point& tile_origin_, const cv::Rect& core_)
+{
+   bool cross_check = m_config.get_cross_check();
+
+   for (int y = core_.y; y < core_.y + core_.height; y++)
+   {
+      int tile_y = y - tile_origin_.y;
+      CV_Assert((tile_y >= 0) && (tile_y < tile_.m_seeds_per_col));
+
+      for (int x = core_.x; x < core_.x + core_.width; x++)
+      {
+         int tile_x = x - tile_origin_.x;
+         CV_Assert((tile_x >= 0) && (tile_x < tile_.m_seeds_per_row));
+
+         int n = m_seed_grid_index.at<int>(y, x);
+         int tile_n = tile_.m_seed_grid_index.at<int>(tile_y, tile_x);
+
+         m_seeds_flow_u[0].at<float>(n) = tile_.m_seeds_flow_u[0].at<float>(tile_n);
+         m_seeds_flow_v[0].at<float>(n) = tile_.m_seeds_flow_v[0].at<float>(tile_n);
+         m_seeds_flow_cost[0].at<float>(n) = tile_.m_seeds_flow_cost[0].at<float>(tile_n);
+
+         if (cross_check)
+         {
+            m_right_seeds_flow_u[0].at<float>(n) = tile_.m_right_seeds_flow_u[0].at<float>(tile_n);
+            m_right_seeds_flow_v[0].at<float>(n) = tile_.m_right_seeds_flow_v[0].at<float>(tile_n);
+            m_right_seeds_flow_cost[0].at<float>(n) = tile_.m_right_seeds_flow_cost[0].at<float>(tile_n);
+         }
+      }
+   }
+}
+
+void
+Cpm::get_matches(cv::Mat& matches_)
+{
+   cv::Mat m;
+   m.create(m_num_seeds, 4, CV_32FC1);
+
+   int j = 0;
+   for (int i = 0; i < m_num_seeds; i++)
+   {
+      int y1 = m_seeds[0].at<int>(i, 1);
+      int x1 = m_seeds[0].at<int>(i, 0);
+
+      float u = m_u.at<float>(y1,x1);
+      float v = m_v.at<float>(y1,x1);
+      if ((u >= g_invalid_flow) || (v >= g_invalid_flow))
+      {
+         // do not return invalid flows
+         continue;
+      }
+
+      int y2 = cvRound(y1 + v);
+      int x2 = cvRound(x1 + u);
+
+      m.at<float>(j,0) = x1;
+      m.at<float>(j,1) = y1;
+      m.at<float>(j,2) = x2;
+      m.at<float>(j,3) = y2;
+      j++;
+   }
+   matches_ = m(cv::Range(0,j), cv::Range(0,4)).clone();
+}
+
+/**
+ * Build the pyramid of a frame without modifying the configuration,
+ * so that the pyramids of the two frames can be built concurrently.
+ *
+ * @param config_   [in]  Configuration.
+ * @param image_    [in]  The frame.
+ * @param pyramid_  [out] Its pyramid, the 0th element is the finest level.
+ * @param ratio_    [out] The pyramid ratio that is actually used.
+ * @return the number of levels that is actually used
+ */
+static int
+build_frame_pyramid(
+      const CpmConfig& config_,
+      const cv::Mat& image_,
+      std::vector<cv::Mat>& pyramid_,
+      float& ratio_
+)
+{
+   ratio_ = config_.get_pyramid_ratio();
+   int num_levels = config_.get_number_of_pyramid_levels();
+
+   int minimum_width = config_.get_minimum_image_width();
+
+   if (num_levels < 1)
+   {
+      num_levels = MyImageProcessing::get_image_pyramid_by_ratio(image_, pyramid_, ratio_, minimum_width);
+   }
+   else
+   {
+      num_levels = MyImageProcessing::get_image_pyramid_by_levels(image_, pyramid_, ratio_, num_levels, minimum_width);
+   }
+
+   return num_levels;
+}
+
+/**
+ * Save the number of levels and the ratio of a pyramid in the configuration,
+ * the next frame uses the same values.
+ */
+static void
+update_pyramid_config(
+      CpmConfig& config_,
+      int num_levels_,
+      float ratio_
+)
+{
+   if (num_levels_ != config_.get_number_of_pyramid_levels())
+   {
+      config_.set_number_of_pyramid_levels(num_levels_);
+   }
+
+   if (fabs(ratio_ - config_.get_pyramid_ratio()) < 1e-5)
+   {
+      config_.set_pyramid_ratio(ratio_);
+   }
+}
+
+/**
+ * Parallel loop body for the pyramids of the two frames,
+ * one task per frame.
+ */
+class FramePyramidLoopBody : public cv::ParallelLoopBody
+{
+public:
+   FramePyramidLoopBody(
+         const cv::Mat* const* images_,         // array of 2 elements, one for each frame
+         std::vector<cv::Mat>* const* pyramids_, // array of 2 elements, one for each frame
+         const CpmConfig& config_,
+         int* num_levels_,                      // array of 2 elements, one for each frame
+         float* ratios_                         // array of 2 elements, one for each frame
+   )
+      : m_images(images_),
+        m_pyramids(pyramids_),
+        m_config(config_),
+        m_num_levels(num_levels_),
+        m_ratios(ratios_)
+   {}
+
+   virtual void operator ()(const cv::Range& range) const
+   {
+      for (int i = range.start; i < range.end; i++)
+      {
+         m_num_levels[i] = build_frame_pyramid(m_config, *m_images[i], *m_pyramids[i], m_ratios[i]);
+      }
+   }
+
+private:
+   const cv::Mat* const* m_images;
+   std::vector<cv::Mat>* const* m_pyramids;
+   const CpmConfig& m_config;
+   int* m_num_levels;
+   float* m_ratios;
+};
+
+void
+Cpm::init_pyramid()
+{
+   const cv::Mat* images[2] = {&m_f, &m_g};
+   std::vector<cv::Mat>* pyramids[2] = {&m_f_pyramid, &m_g_pyramid};
+   int num_levels[2];
+   float ratios[2];
+
+   // the two chains are independent since the configuration is updated afterwards
+   cv::parallel_for_(cv::Range(0, 2), FramePyramidLoopBody(images, pyramids, m_config, num_levels, ratios));
+
+   // the frames have the same size
+   CV_Assert(num_levels[0] == num_levels[1]);
+   update_pyramid_config(m_config, num_levels[0], ratios[0]);
+}
+
+void
+Cpm::init_frame_pyramid(const cv::Mat& image_, std::vector<cv::Mat>& pyramid_)
+{
+   float ratio;
+   int num_levels = build_frame_pyramid(m_config, image_, pyramid_, ratio);
+   update_pyramid_config(m_config, num_levels, ratio);
+}
+
+/**
+ * Mark the pixels whose descriptors are read by the matching costs of the seeds,
+ * i.e., the patch of every seed.
+ *
+ * @param pyramid_          [in]  Pyramid of the first frame.
+ * @param seeds_            [in]  Seed coordinates at each level, CV_32SC1, 2 columns.
+ * @param half_patch_size_  [in]  Half patch size.
+ * @param masks_            [out] CV_8UC1 at each level with the size of the pyramid level, 255 for the marked pixels.
+ */
+static void
+get_seed_patch_masks(
+      const std::vector<cv::Mat>& pyramid_,
+      const std::vector<cv::Mat>& seeds_,
+      int half_patch_size_,
+      std::vector<cv::Mat>& masks_
+)
+{
+   int num_levels = (int)pyramid_.size();
+   CV_Assert(seeds_.size() == (size_t)num_levels);
+
+   masks_.resize((size_t)num_levels);
+
+   int r = half_patch_size_;
+   for (int i = 0; i < num_levels; i++)
+   {
+      cv::Mat& mask = masks_[i];
+      mask.create(pyramid_[i].size(), CV_8UC1);
+      mask = 0;
+
+      cv::Rect image_rect(cv::Point(0, 0), mask.size());
+      for (int n = 0; n < seeds_[i].rows; n++)
+      {
+         const int* p_coord = seeds_[i].ptr<int>(n);
+         mask(cv::Rect(p_coord[0] - r, p_coord[1] - r, 2*r + 1, 2*r + 1) & image_rect) = 255;
+      }
    }
+}
+
+/**
+ * Parallel loop body for the descriptors of the small levels of the two frames.
+ *
+ * Task t is level t/2 of frame t%2. The tasks are ordered from the finest
+ * level to the coarsest one, so that the most expensive tasks start first.
+ * The row-parallel loops of the descriptors run serially inside a task.
+ */
+class LevelDescriptorLoopBody : public cv::ParallelLoopBody
+{
+public:
+   LevelDescriptorLoopBody(
+         const Cpm& cpm_,
+         const std::vector<cv::Mat>* const* pyramids_,   // array of 2 elements, one for each frame
+         std::vector<cv::Mat>* const* descriptors_,      // array of 2 elements, one for each frame
+         const std::vector<cv::Mat>* const* masks_,      // array of 2 elements, one for each frame
+         void (Cpm::*compute_)(const cv::Mat&, const cv::Mat&, cv::Mat&) const
+   )
+      : m_cpm(cpm_),
+        m_pyramids(pyramids_),
+        m_descriptors(descriptors_),
+        m_masks(masks_),
+        m_compute(compute_)
+   {}
+
+   virtual void operator ()(const cv::Range& range) const
+   {
+      for (int t = range.start; t < range.end; t++)
+      {
+         int frame = t % 2;
+         size_t level = (size_t)(t / 2);
+
+         const std::vector<cv::Mat>& masks = *m_masks[frame];
+         (m_cpm.*m_compute)((*m_pyramids[frame])[level], masks.empty() ? cv::Mat() : masks[level],
+                            (*m_descriptors[frame])[level]);
+      }
+   }
+
+private:
+   const Cpm& m_cpm;
+   const std::vector<cv::Mat>* const* m_pyramids;
+   std::vector<cv::Mat>* const* m_descriptors;
+   const std::vector<cv::Mat>* const* m_masks;
+   void (Cpm::*m_compute)(const cv::Mat&, const cv::Mat&, cv::Mat&) const;
+};
+
+/**
+ * Compute the coarser levels of a descriptor pyramid from level 0,
+ * every level aggregates the descriptors of the next finer level.
+ */
+static void
+downsample_descriptor_pyramid(
+      const std::vector<cv::Mat>& pyramid_,
+      std::vector<cv::Mat>& descriptor_,
+      bool is_binary_
+)
+{
+   for (size_t i = 1; i < pyramid_.size(); i++)
+   {
+      MyImageProcessing::downsample_descriptor(descriptor_[i-1], pyramid_[i].size(), descriptor_[i], is_binary_);
+   }
+}
 
-   timer.start();
-   run_patch_match();
-   timer.stop();
+/**
+ * Number of the finest levels whose descriptors are computed one at a time with the
+ * row parallelism of the descriptor. The remaining levels are computed as concurrent tasks.
+ *
+ * A coarser level becomes a task once it takes one thread no longer than level 0 takes all threads.
+ * Level 0 is about half of the work of a pyramid and is never a task.
+ *
+ * @param pyramid_      [in] Pyramid of a frame.
+ * @param num_levels_   [in] Number of levels whose descriptors are computed.
+ */
+static int
+get_num_row_parallel_levels(const std::vector<cv::Mat>& pyramid_, int num_levels_)
+{
+   double level0_area = (double)pyramid_[0].total();
+   int num_threads = cv::max(cv::getNumThreads(), 1);
 
-   if (m_config.get_verbose())
+   int res = 1;
+   while ((res < num_levels_) && ((double)pyramid_[(size_t)res].total() * num_threads > level0_area))
    {
-      std::cout << "run_patch_match took " << timer.get_s() << " s" << std::endl;
+      res++;
    }
+   return res;
 }
 
 void
-Cpm::get_matches(cv::Mat& matches_)
+Cpm::compute_descriptor()
 {
-   cv::Mat m;
-   m.create(m_num_seeds, 4, CV_32FC1);
+   CV_Assert(m_f_pyramid.size() > 0);
+   CV_Assert(m_f_pyramid.size() == m_g_pyramid.size());
 
-   int j = 0;
-   for (int i = 0; i < m_num_seeds; i++)
+   // the left view reads the first frame only at the seeds, but
+   // the right view of the cross check searches every pixel of it
+   std::vector<cv::Mat> masks;
+   if (m_config.get_sparse_reference_descriptor() && !m_config.get_cross_check() &&
+       !m_config.get_descriptor_pyramid())
    {
-      int y1 = m_seeds[0].at<int>(i, 1);
-      int x1 = m_seeds[0].at<int>(i, 0);
+      CV_Assert(m_seeds.size() == m_f_pyramid.size());
+      get_seed_patch_masks(m_f_pyramid, m_seeds, m_config.get_half_patch_size(), masks);
+   }
 
-      float u = m_u.at<float>(y1,x1);
-      float v = m_v.at<float>(y1,x1);
-      if ((u >= g_invalid_flow) || (v >= g_invalid_flow))
+   int num_levels = (int)m_f_pyramid.size();
+   m_f_pyramid_descriptor.resize((size_t)num_levels);
+   m_g_pyramid_descriptor.resize((size_t)num_levels);
+
+   const std::vector<cv::Mat>* pyramids[2] = {&m_f_pyramid, &m_g_pyramid};
+   std::vector<cv::Mat>* descriptors[2] = {&m_f_pyramid_descriptor, &m_g_pyramid_descriptor};
+   std::vector<cv::Mat> no_masks;
+   const std::vector<cv::Mat>* frame_masks[2] = {&masks, &no_masks};
+
+   // the descriptor pyramid computes only level 0 of both frames from the images
+   bool is_descriptor_pyramid = m_config.get_descriptor_pyramid();
+   int num_computed_levels = is_descriptor_pyramid ? 1 : num_levels;
+
+   // nested parallel loops run serially, so the large levels are not tasks but
+   // use the row parallelism of the descriptor, one level of one frame at a time
+   int num_row_parallel_levels = get_num_row_parallel_levels(m_f_pyramid, num_computed_levels);
+   for (int i = 0; i < num_row_parallel_levels; i++)
+   {
+      for (int k = 0; k < 2; k++)
       {
-         // do not return invalid flows
-         continue;
+         const std::vector<cv::Mat>& masks = *frame_masks[k];
+         compute_level_descriptor((*pyramids[k])[i], masks.empty() ? cv::Mat() : masks[i], (*descriptors[k])[i]);
       }
+   }
 
-      int y2 = cvRound(y1 + v);
-      int x2 = cvRound(x1 + u);
+   // the small levels do not keep the threads busy with their rows, so every level is a task
+   if (num_row_parallel_levels < num_computed_levels)
+   {
+      cv::parallel_for_(cv::Range(2*num_row_parallel_levels, 2*num_computed_levels),
+                        LevelDescriptorLoopBody(*this, pyramids, descriptors, frame_masks,
+                                                &Cpm::compute_level_descriptor));
+   }
 
-      m.at<float>(j,0) = x1;
-      m.at<float>(j,1) = y1;
-      m.at<float>(j,2) = x2;
-      m.at<float>(j,3) = y2;
-      j++;
+   if (is_descriptor_pyramid)
+   {
+      // the downsampling is row parallel and every level depends on the previous one
+      bool is_binary = is_binary_descriptor(m_config.get_descriptor_type());
+      downsample_descriptor_pyramid(m_f_pyramid, m_f_pyramid_descriptor, is_binary);
+      downsample_descriptor_pyramid(m_g_pyramid, m_g_pyramid_descriptor, is_binary);
    }
-   matches_ = m(cv::Range(0,j), cv::Range(0,4)).clone();
 }
 
 void
-Cpm::init_pyramid()
+Cpm::compute_frame_descriptor(
+      const std::vector<cv::Mat>& pyramid_,
+      std::vector<cv::Mat>& descriptor_,
+      const std::vector<cv::Mat>& masks_ /* = std::vector<cv::Mat>() */
+)
 {
-   float ratio = m_config.get_pyramid_ratio();
-   int num_levels = m_config.get_number_of_pyramid_levels();
+   CV_Assert(pyramid_.size() > 0);
+   CV_Assert(masks_.empty() || (masks_.size() == pyramid_.size()));
 
-   int minimum_width = m_config.get_minimum_image_width();
+   int num_levels = (int)pyramid_.size();
 
-   if (num_levels < 1)
-   {
-      MyImageProcessing::get_image_pyramid_by_ratio(m_f, m_f_pyramid, ratio, minimum_width);
-      num_levels = MyImageProcessing::get_image_pyramid_by_ratio(m_g, m_g_pyramid, ratio, minimum_width);
-   }
-   else
-   {
-      num_levels = MyImageProcessing::get_image_pyramid_by_levels(m_f, m_f_pyramid, ratio, num_levels, minimum_width);
-      num_levels = MyImageProcessing::get_image_pyramid_by_levels(m_g, m_g_pyramid, ratio, num_levels, minimum_width);
-   }
+   descriptor_.resize((size_t)num_levels);
+
+   // the descriptor pyramid computes only level 0 from its image and needs it for every pixel
+   bool is_descriptor_pyramid = m_config.get_descriptor_pyramid();
+   int num_computed_levels = is_descriptor_pyramid ? 1 : num_levels;
+   CV_Assert(masks_.empty() || !is_descriptor_pyramid);
 
-   if (num_levels != m_config.get_number_of_pyramid_levels())
+   for (int i = 0; i < num_computed_levels; i++)
    {
-      m_config.set_number_of_pyramid_levels(num_levels);
+      compute_level_descriptor(pyramid_[i], masks_.empty() ? cv::Mat() : masks_[i], descriptor_[i]);
    }
 
-   if (fabs(ratio - m_config.get_pyramid_ratio()) < 1e-5)
+   if (is_descriptor_pyramid)
    {
-      m_config.set_pyramid_ratio(ratio);
+      downsample_descriptor_pyramid(pyramid_, descriptor_, is_binary_descriptor(m_config.get_descriptor_type()));
    }
 }
 
 void
-Cpm::compute_descriptor()
+Cpm::compute_level_descriptor(
+      const cv::Mat& image_,
+      const cv::Mat& mask_,
+      cv::Mat& descriptor_
+) const
 {
-   CV_Assert(m_f_pyramid.size() > 0);
-   CV_Assert(m_f_pyramid.size() == m_g_pyramid.size());
-
-   int num_levels = m_config.get_number_of_pyramid_levels();
-
-   m_f_pyramid_descriptor.resize((size_t)num_levels);
-   m_g_pyramid_descriptor.resize((size_t)num_levels);
-
    DescriptorType desc_type = m_config.get_descriptor_type();
    switch (desc_type)
    {
       case DescriptorType::E_DESC_TYPE_SIFT:
-         for (int i = 0; i < num_levels; i++)
-         {
-            SiftDescriptor::compute_sift_descriptor(m_f_pyramid[i], m_f_pyramid_descriptor[i]);
-            SiftDescriptor::compute_sift_descriptor(m_g_pyramid[i], m_g_pyramid_descriptor[i]);
-         }
+         SiftDescriptor::compute_sift_descriptor_sampled(image_, mask_, descriptor_);
          break;
       case DescriptorType::E_DESC_TYPE_RANK_TRANSFORM:
-         // TODO: calculate the descriptor of the original image
-         // TODO: and then compute the pyramid of the descriptor image !
-         for (int i = 0; i < num_levels; i++)
-         {
-            MyImageProcessing::rank_transform(m_f_pyramid[i], m_f_pyramid_descriptor[i], 5, m_config.get_descriptor_color_to_gray()); // an odd number less than 16
-            MyImageProcessing::rank_transform(m_g_pyramid[i], m_g_pyramid_descriptor[i], 5, m_config.get_descriptor_color_to_gray()); // an odd number less than 16
-         }
+         MyImageProcessing::rank_transform(image_, descriptor_, 5, m_config.get_descriptor_color_to_gray()); // an odd number less than 16
          break;
       case DescriptorType::E_DESC_TYPE_CENSUS_TRANSFORM:
-         // TODO: calculate the descriptor of the original image
-         // TODO: and then compute the pyramid of the descriptor image !
-         for (int i = 0; i < num_levels; i++)
-         {
-            MyImageProcessing::census_transform(m_f_pyramid[i], m_f_pyramid_descriptor[i], 5, m_config.get_descriptor_color_to_gray()); // 3 or 5
-            MyImageProcessing::census_transform(m_g_pyramid[i], m_g_pyramid_descriptor[i], 5, m_config.get_descriptor_color_to_gray()); // 3 or 5
-         }
+         MyImageProcessing::census_transform(image_, descriptor_, 5, m_config.get_descriptor_color_to_gray()); // 3 or 5
          break;
       case DescriptorType::E_DESC_TYPE_COMPLETE_RANK_TRANSFORM:
-         // TODO: calculate the descriptor of the original image
-         // TODO: and then compute the pyramid of the descriptor image !
-         for (int i = 0; i < num_levels; i++)
-         {
-            MyImageProcessing::complete_rank_transform(m_f_pyramid[i], m_f_pyramid_descriptor[i], 5, m_config.get_descriptor_color_to_gray()); // an odd number, less than 16
-            MyImageProcessing::complete_rank_transform(m_g_pyramid[i], m_g_pyramid_descriptor[i], 5, m_config.get_descriptor_color_to_gray()); // an odd number, less than 16
-         }
+         MyImageProcessing::complete_rank_transform(image_, descriptor_, 5, m_config.get_descriptor_color_to_gray()); // an odd number, less than 16
          break;
       case DescriptorType::E_DESC_TYPE_COMPLETE_CENSUS_TRANSFORM:
-         // TODO: calculate the descriptor of the original image
-         // TODO: and then compute the pyramid of the descriptor image !
-         for (int i = 0; i < num_levels; i++)
-         {
-            MyImageProcessing::complete_census_transform(m_f_pyramid[i], m_f_pyramid_descriptor[i], 5, m_config.get_descriptor_color_to_gray()); // an odd number, less than 16
-            MyImageProcessing::complete_census_transform(m_g_pyramid[i], m_g_pyramid_descriptor[i], 5, m_config.get_descriptor_color_to_gray()); // an odd number, less than 16
-         }
+         MyImageProcessing::complete_census_transform(image_, descriptor_, 5, m_config.get_descriptor_color_to_gray()); // an odd number, less than 16
          break;
+      case DescriptorType::E_DESC_TYPE_PACKED_CENSUS_TRANSFORM:
+         // only the hamming distance is meaningful for bit-packed descriptors
+         CV_Assert(dynamic_cast<const PackedHammingCost*>(m_cost_ptr.get()) != nullptr);
+         MyImageProcessing::packed_census_transform(image_, descriptor_, 5, m_config.get_descriptor_color_to_gray()); // 3 or 5
+         break;
+      case DescriptorType::E_DESC_TYPE_PCA_SIFT:
+      {
+         cv::Mat sift;
+         SiftDescriptor::compute_sift_descriptor_sampled(image_, mask_, sift);
+         SiftDescriptor::project_sift_descriptor(sift, m_pca_basis, m_config.get_pca_sift_components(), descriptor_);
+         break;
+      }
       default:
          CV_Assert(false);  // unreachable code
          break;
    }
 }
 
-void
-Cpm::init_seeds()
+/**
+ * Collapse the seeds of a pyramid level along one axis.
+ *
+ * The coordinate of the g-th seed along the axis is (int)((g*step_ + offset_)*level_ratio_)
+ * at the level. It does not decrease with g, so equal coordinates are adjacent.
+ * Without merging, every seed keeps its own element as in the original implementation.
+ *
+ * @param num_          [in]  Number of seeds along the axis at level 0.
+ * @param step_         [in]  Grid space at level 0.
+ * @param offset_       [in]  Coordinate of the first seed at level 0.
+ * @param level_ratio_  [in]  Scale from level 0 to the level.
+ * @param size_         [in]  Image size along the axis at the level.
+ * @param is_merged_    [in]  true to merge the seeds with equal coordinates.
+ * @param unique_       [out] Distinct coordinates at the level in increasing order.
+ * @param index_        [out] Index into unique_ of every seed at level 0, num_ elements.
+ * @param first_        [out] The first seed at level 0 of every element in unique_.
+ */
+static void
+collapse_seed_axis(
+      int num_,
+      int step_,
+      int offset_,
+      float level_ratio_,
+      int size_,
+      bool is_merged_,
+      std::vector<int>& unique_,
+      std::vector<int>& index_,
+      std::vector<int>& first_
+)
 {
-   CV_Assert(!m_f.empty());
-   CV_Assert(m_f.size() == m_g.size());
+   unique_.clear();
+   first_.clear();
+   index_.resize((size_t)num_);
 
-   int num_levels = m_config.get_number_of_pyramid_levels();
+   for (int g = 0; g < num_; g++)
+   {
+      int c = (int)((g*step_ + offset_) * level_ratio_);
+      c = cv::min(c, size_-1);
 
-   int step = m_config.get_grid_space();
+      if (!is_merged_ || unique_.empty() || (unique_.back() != c))
+      {
+         unique_.push_back(c);
+         first_.push_back(g);
+      }
+      index_[g] = (int)unique_.size() - 1;
+   }
+}
 
-   // init seeds for the raw image : m_seeds[0]
-   m_seeds_per_row = m_f.cols / step;
-   m_seeds_per_col = m_f.rows / step;
-   m_seed_x_offset = step >> 1;
-   m_seed_y_offset = step >> 1;
-   m_num_seeds = m_seeds_per_col * m_seeds_per_row;
+/**
+ * Interleave the bits of x_ and y_, i.e., the position on the Z-order curve.
+ */
+static inline uint64
+morton_code(int x_, int y_)
+{
+   uint64 code = 0;
+   for (int b = 0; b < 32; b++)
+   {
+      code |= (uint64)(((unsigned)x_ >> b) & 1u) << (2*b);
+      code |= (uint64)(((unsigned)y_ >> b) & 1u) << (2*b + 1);
+   }
+   return code;
+}
 
-   m_seeds.resize((size_t)num_levels);
+/**
+ * Storage index of every seed on a regular grid.
+ *
+ * @param cols_   [in]  Number of seeds per row.
+ * @param rows_   [in]  Number of seeds per column.
+ * @param order_  [in]  Storage order.
+ * @param rank_   [out] Storage index of the seed at grid (x, y) in element y*cols_ + x.
+ */
+static void
+get_seed_rank(
+      int cols_,
+      int rows_,
+      CpmConfig::SeedOrder order_,
+      std::vector<int>& rank_
+)
+{
+   int num_seeds = cols_*rows_;
+   rank_.resize((size_t)num_seeds);
 
-   m_seeds[0].create(m_num_seeds, 2, CV_32SC1); // column 0 - x, column 1 - y
+   switch (order_)
+   {
+      case CpmConfig::SeedOrder::E_SEED_ORDER_ROW_MAJOR:
+         for (int g = 0; g < num_seeds; g++)
+         {
+            rank_[g] = g;
+         }
+         break;
+      case CpmConfig::SeedOrder::E_SEED_ORDER_MORTON:
+      {
+         // the grid is not a power of two, so sort the codes instead of decoding consecutive ones
+         std::vector<std::pair<uint64, int> > codes((size_t)num_seeds);
+         for (int g = 0; g < num_seeds; g++)
+         {
+            codes[g] = std::make_pair(morton_code(g % cols_, g / cols_), g);
+         }
+         std::sort(codes.begin(), codes.end());
+         for (int r = 0; r < num_seeds; r++)
+         {
+            rank_[codes[r].second] = r;
+         }
+         break;
+      }
+      default:
+         CV_Assert(false);  // unreachable code
+         break;
+   }
+}
 
-   m_seed_neighbors.create(m_num_seeds, 8, CV_32SC1); // each seed has 8 neighbors
+/**
+ * Neighbor indices of the seeds on a regular grid.
+ *
+ * @param cols_       [in]  Number of seeds per row.
+ * @param rows_       [in]  Number of seeds per column.
+ * @param rank_       [in]  Storage index of every grid position, see get_seed_rank().
+ * @param neighbors_  [out] CV_32SC1, cols_*rows_ x 8, row rank_[g] for grid position g.
+ *                          Invalid neighbors are denoted by -1.
+ */
+static void
+get_grid_neighbors(
+      int cols_,
+      int rows_,
+      const std::vector<int>& rank_,
+      cv::Mat& neighbors_
+)
+{
+   neighbors_.create(cols_*rows_, 8, CV_32SC1); // each seed has 8 neighbors
 
-   m_seed_neighbors = -1; // seeds at corners and boundaries do not have enough neighbors,
-                          // invalid neighbors are denoted by -1
+   neighbors_ = -1; // seeds at corners and boundaries do not have enough neighbors,
+                    // invalid neighbors are denoted by -1
 
    //
    // Neighbor indices
@@ -328,53 +1283,218 @@ Cpm::init_seeds()
              { 1, -1}, // bottom left, 6
              { 1,  1}, // bottom right,7
         };
-   for (int i = 0; i < m_num_seeds; i++)
+   for (int i = 0; i < cols_*rows_; i++)
    {
-      int* p = m_seeds[0].ptr<int>(i);
-      int grid_x = i % m_seeds_per_row;
-      int grid_y = i / m_seeds_per_row;
-
-      int x_coord = grid_x*step + m_seed_x_offset;
-      int y_coord = grid_y*step + m_seed_y_offset;
-
-      p[0] = x_coord;
-      p[1] = y_coord;
+      int grid_x = i % cols_;
+      int grid_y = i / cols_;
 
-      // init neighbors
+      int* p_neighbors = neighbors_.ptr<int>(rank_[i]);
       for (int j = 0; j < 8; j++)
       {
          int n_y = grid_y + neighbor_offset[j][0];
          int n_x = grid_x + neighbor_offset[j][1];
-         if (!is_inside(n_y, m_seeds_per_col) || !is_inside(n_x, m_seeds_per_row))
+         if (!is_inside(n_y, rows_) || !is_inside(n_x, cols_))
          {
             continue;
          }
-         m_seed_neighbors.at<int>(i,j) = n_y * m_seeds_per_row + n_x;
+         p_neighbors[j] = rank_[n_y * cols_ + n_x];
       }
    }
+}
+
+void
+Cpm::init_seeds()
+{
+   init_seeds(m_config.get_number_of_pyramid_levels());
+}
+
+void
+Cpm::init_seeds(int num_levels_)
+{
+   CV_Assert(!m_f.empty());
+   CV_Assert(m_f.size() == m_g.size());
+   CV_Assert(num_levels_ > 0);
+
+   int num_levels = num_levels_;
+
+   int step = m_config.get_grid_space();
+
+   float ratio = m_config.get_pyramid_ratio();
+
+   CpmConfig::SeedOrder order = m_config.get_seed_order();
+
+   bool is_merged = m_config.get_merge_coarse_seeds();
+
+   if ((m_seeds_image_size == m_f.size()) && (m_seeds_grid_space == step) &&
+       (m_seeds_num_levels == num_levels) && (std::fabs(m_seeds_pyramid_ratio - ratio) < 1e-6f) &&
+       (m_seeds_order == order) && (m_seeds_merged == is_merged))
+   {
+      return; // the seeds depend only on the geometry, the order and the merging, which have not changed
+   }
+
+   m_seeds_image_size = m_f.size();
+   m_seeds_grid_space = step;
+   m_seeds_num_levels = num_levels;
+   m_seeds_pyramid_ratio = ratio;
+   m_seeds_order = order;
+   m_seeds_merged = is_merged;
+
+   // init seeds for the raw image : m_seeds[0]
+   m_seeds_per_row = m_f.cols / step;
+   m_seeds_per_col = m_f.rows / step;
+   m_seed_x_offset = step >> 1;
+   m_seed_y_offset = step >> 1;
+   m_num_seeds = m_seeds_per_col * m_seeds_per_row;
+
+   m_seeds.resize((size_t)num_levels);
+   m_seed_neighbors.resize((size_t)num_levels);
+   m_seeds_packed.resize((size_t)num_levels);
+   m_seeds_coarser_index.resize((size_t)num_levels);
+
+   // the seed grid is separable, so seeds are collapsed along x and y independently
+   std::vector<std::vector<int> > unique_x((size_t)num_levels), index_x((size_t)num_levels), first_x((size_t)num_levels);
+   std::vector<std::vector<int> > unique_y((size_t)num_levels), index_y((size_t)num_levels), first_y((size_t)num_levels);
 
-   for (int i = 1; i < num_levels; i++)
+   // storage index of every grid position at each level
+   std::vector<std::vector<int> > rank((size_t)num_levels);
+
+   for (int i = 0; i < num_levels; i++)
    {
-      m_seeds[i].create(m_num_seeds, 2, CV_32SC1);
+      float level_ratio = (float)std::pow(ratio, i);
+
+      cv::Size level_size = (i == 0) ? m_f.size() : m_f_pyramid[i].size();
+
+      collapse_seed_axis(m_seeds_per_row, step, m_seed_x_offset, level_ratio, level_size.width, is_merged,
+                         unique_x[i], index_x[i], first_x[i]);
+      collapse_seed_axis(m_seeds_per_col, step, m_seed_y_offset, level_ratio, level_size.height, is_merged,
+                         unique_y[i], index_y[i], first_y[i]);
+
+      int nx = (int)unique_x[i].size();
+      int ny = (int)unique_y[i].size();
+
+      get_seed_rank(nx, ny, order, rank[i]);
+
+      // column 0 - x, column 1 - y, columns 2-9 - neighbors
+      // the seeds at level 0 are not collapsed, i.e., the grid at level 0 has m_seeds_per_row x m_seeds_per_col seeds
+      m_seeds_packed[i].create(nx*ny, 10, CV_32SC1);
+      m_seeds[i] = m_seeds_packed[i].colRange(0, 2);
+      m_seed_neighbors[i] = m_seeds_packed[i].colRange(2, 10);
+      for (int y = 0; y < ny; y++)
+      {
+         for (int x = 0; x < nx; x++)
+         {
+            int* p = m_seeds_packed[i].ptr<int>(rank[i][y*nx + x]);
+            p[0] = unique_x[i][x];
+            p[1] = unique_y[i][y];
+         }
+      }
+
+      get_grid_neighbors(nx, ny, rank[i], m_seed_neighbors[i]);
+   }
 
-      int nx = m_f_pyramid[i].cols;
-      int ny = m_f_pyramid[i].rows;
+   CV_Assert(m_seeds[0].rows == m_num_seeds);
+
+   m_seed_grid_index.create(m_seeds_per_col, m_seeds_per_row, CV_32SC1);
+   std::copy(rank[0].begin(), rank[0].end(), m_seed_grid_index.ptr<int>(0));
+
+   for (int i = 0; i < num_levels - 1; i++)
+   {
+      // a collapsed seed takes the coarser seed of the first fine seed collapsed onto it
+      int nx = (int)unique_x[i].size();
+      int ny = (int)unique_y[i].size();
+      int coarse_nx = (int)unique_x[i+1].size();
+
+      m_seeds_coarser_index[i].create(nx*ny, 1, CV_32SC1);
+      int* p_index = m_seeds_coarser_index[i].ptr<int>(0);
+      for (int y = 0; y < ny; y++)
+      {
+         int coarse_y = index_y[i+1][first_y[i][y]];
+         for (int x = 0; x < nx; x++)
+         {
+            int coarse_x = index_x[i+1][first_x[i][x]];
+            p_index[rank[i][y*nx + x]] = rank[i+1][coarse_y*coarse_nx + coarse_x];
+         }
+      }
+   }
+   m_seeds_coarser_index[num_levels-1].release(); // the coarsest level has no coarser level
 
-      float ratio = (float)std::pow(m_config.get_pyramid_ratio(), i);
-      for (int j = 0; j < m_num_seeds; j++)
+   if (m_config.get_verbose())
+   {
+      for (int i = 0; i < num_levels; i++)
       {
-         int y = (int)(m_seeds[0].at<int>(j,1) * ratio);
-         int x = (int)(m_seeds[0].at<int>(j,0) * ratio);
+         std::cout << "level " << i << ": " << m_seeds[i].rows << " seeds" << std::endl;
+      }
+   }
+}
+
+/**
+ * Read the values of a dense map at the seeds, i.e., the inverse of seeds_to_dense_map().
+ *
+ * @param map_     [in]  Dense map, CV_32FC1.
+ * @param seeds_   [in]  Seed coordinates at level 0, CV_32SC1, 2 columns.
+ * @param values_  [out] Value of every seed, CV_32FC1, num_seeds x 1.
+ */
+static void
+dense_map_to_seeds(
+      const cv::Mat& map_,
+      const cv::Mat& seeds_,
+      cv::Mat& values_
+)
+{
+   CV_Assert(map_.type() == CV_32FC1);
+
+   int num_seeds = seeds_.rows;
+   values_.create(num_seeds, 1, CV_32FC1);
 
-         y = cv::min(y, ny-1);
-         x = cv::min(x, nx-1);
+   float* p_values = values_.ptr<float>(0);
+   for (int n = 0; n < num_seeds; n++)
+   {
+      const int* p_coord = seeds_.ptr<int>(n);
+      p_values[n] = map_.at<float>(p_coord[1], p_coord[0]);
+   }
+}
 
-         m_seeds[i].at<int>(j,1) = y;
-         m_seeds[i].at<int>(j,0) = x;
+/**
+ * Print the statistics of every level, from the coarsest level to the finest level.
+ */
+static void
+show_level_stats(const std::vector<CpmLevelStats>& stats_)
+{
+   for (int i = (int)stats_.size() - 1; i >= 0; i--)
+   {
+      const CpmLevelStats& stats = stats_[i];
+      std::cout << "level " << i << ": " << stats.m_num_seeds << " seeds, "
+                << stats.m_num_iterations << " iteration(s), "
+                << stats.m_num_cost_evaluations << " cost evaluations, "
+                << stats.m_num_cost_cache_hits << " cache hits ("
+                << 100.0 * (double)stats.m_num_cost_cache_hits
+                   / (double)std::max(stats.m_num_cost_evaluations + stats.m_num_cost_cache_hits, (int64)1)
+                << "%), "
+                << stats.m_time << " ms" << (stats.m_truncated ? ", truncated" : "") << std::endl
+                << "  updates per seed:";
+      for (float fraction : stats.m_improved_fraction)
+      {
+         std::cout << " " << fraction;
       }
+      std::cout << std::endl;
    }
 }
 
+/**
+ * Cross check the flows of the left view and the right view.
+ *
+ * @param seeds_        [in]  Seed coordinates at level 0, CV_32SC1, 2 columns.
+ * @param u1_           [in]  Flow of every seed of the left view in the x-direction, CV_32FC1, num_seeds x 1.
+ * @param v1_           [in]  Flow of every seed of the left view in the y-direction, CV_32FC1, num_seeds x 1.
+ * @param u2_           [in]  Flow of every seed of the right view in the x-direction, CV_32FC1, num_seeds x 1.
+ * @param v2_           [in]  Flow of every seed of the right view in the y-direction, CV_32FC1, num_seeds x 1.
+ * @param u             [out] Checked flow of every seed in the x-direction, CV_32FC1, num_seeds x 1.
+ *                            Invalid flows are set to g_invalid_flow.
+ * @param v             [out] Checked flow of every seed in the y-direction, CV_32FC1, num_seeds x 1.
+ *                            Invalid flows are set to g_invalid_flow.
+ * @param image_size_   [in]  Size of the image at level 0.
+ * @param grid_index_   [in]  Seed index of every grid position, see Cpm::m_seed_grid_index.
+ */
 static void
 cross_check(
       const cv::Mat& seeds_,
@@ -384,15 +1504,18 @@ cross_check(
       const cv::Mat& v2_,
       cv::Mat& u,
       cv::Mat& v,
+      const cv::Size& image_size_,
       int grid_space_,
-      int grid_w_,
+      const cv::Mat& grid_index_,
       float threshold_,
       float max_displacement_,
       bool verbose_
 )
 {
-   u.create(u1_.size(), CV_32FC1);
-   v.create(u1_.size(), CV_32FC1);
+   int num_seeds = seeds_.rows;
+
+   u.create(num_seeds, 1, CV_32FC1);
+   v.create(num_seeds, 1, CV_32FC1);
 
    u = 0;
    v = 0;
@@ -405,25 +1528,24 @@ cross_check(
 
    int border_width = 5; // TODO: how to choose the border width ?
 
-   int ny = u1_.rows;
-   int nx = u1_.cols;
+   int ny = image_size_.height;
+   int nx = image_size_.width;
 
    int offset = grid_space_ / 2;
 
    int valid_num = 0;
 
-   int num_seeds = seeds_.rows;
    for (int i = 0; i < num_seeds; i++)
    {
       int y = seeds_.at<int>(i, 1);
       int x = seeds_.at<int>(i, 0);
 
-      float u1 = u1_.at<float>(y,x);
-      float v1 = v1_.at<float>(y,x);
+      float u1 = u1_.at<float>(i);
+      float v1 = v1_.at<float>(i);
       if (cv::sqrt(u1*u1 + v1*v1) > max_displacement_)
       {
-         u.at<float>(y,x) = g_invalid_flow;
-         v.at<float>(y,x) = g_invalid_flow;
+         u.at<float>(i) = g_invalid_flow;
+         v.at<float>(i) = g_invalid_flow;
 
          continue;
       }
@@ -434,43 +1556,43 @@ cross_check(
       int seed_y = (y2 - offset) / grid_space_; // Fixme: seed_y and seed_x may be out of range
       int seed_x = (x2 - offset) / grid_space_;
 
-      int seed_index = seed_y * grid_w_ + seed_x;
+      int seed_index = grid_index_.at<int>(seed_y, seed_x);
 
       int other_y = seeds_.at<int>(seed_index, 1);
       int other_x = seeds_.at<int>(seed_index, 0);
       if ((other_x < border_width) || (other_x >= nx - border_width)
           || (other_y < border_width) || (other_y >= ny - border_width))
       {
-         u.at<float>(y,x) = g_invalid_flow;
-         v.at<float>(y,x) = g_invalid_flow;
+         u.at<float>(i) = g_invalid_flow;
+         v.at<float>(i) = g_invalid_flow;
          continue;
       }
 
-      float u2 = u2_.at<float>(other_y, other_x);
-      float v2 = v2_.at<float>(other_y, other_x);
+      float u2 = u2_.at<float>(seed_index);
+      float v2 = v2_.at<float>(seed_index);
 
       if (cv::sqrt(u2*u2 + v2*v2) > max_displacement_)
       {
-         u.at<float>(y,x) = g_invalid_flow;
-         v.at<float>(y,x) = g_invalid_flow;
+         u.at<float>(i) = g_invalid_flow;
+         v.at<float>(i) = g_invalid_flow;
          continue;
       }
 
       float diff = cv::sqrt((u1+u2)*(u1+u2) + (v1+v2)*(v1+v2));
       if (diff > threshold_)
       {
-         u.at<float>(y,x) = g_invalid_flow;
-         v.at<float>(y,x) = g_invalid_flow;
+         u.at<float>(i) = g_invalid_flow;
+         v.at<float>(i) = g_invalid_flow;
          continue;
       }
 
-      u.at<float>(y,x) = u1;
-      v.at<float>(y,x) = v1;
+      u.at<float>(i) = u1;
+      v.at<float>(i) = v1;
       valid_num++;
 
 #ifdef KFJ_DEBUG
-      my_u.at<float>(y,x) = u1;
-      my_v.at<float>(y,x) = v1;
+      my_u.at<float>(i) = u1;
+      my_v.at<float>(i) = v1;
 #endif
    }
    if (verbose_)
@@ -481,8 +1603,11 @@ cross_check(
 
 #ifdef KFJ_DEBUG
    cv::String my_filename = cv::format("after-cross-check.flo");
+   cv::Mat my_dense_u, my_dense_v;
+   seeds_to_dense_map(my_u, seeds_, image_size_, my_dense_u);
+   seeds_to_dense_map(my_v, seeds_, image_size_, my_dense_v);
    OpticalFlowKfj of;
-   of.set_estimated_flow(my_u, my_v);
+   of.set_estimated_flow(my_dense_u, my_dense_v);
    of.save_estimated_flow_to_file(my_filename.c_str());
    printf("Save flow after cross check to '%s'\n", my_filename.c_str());
 #endif
@@ -490,44 +1615,106 @@ cross_check(
 
 void
 Cpm::run_patch_match()
+{
+   run_seeds_patch_match();
+   seeds_flow_to_dense();
+}
+
+void
+Cpm::run_seeds_patch_match()
 {
    CV_Assert(!m_f_pyramid_descriptor.empty());
    CV_Assert(m_f_pyramid_descriptor.size() == m_g_pyramid_descriptor.size());
 
-   cv::Mat u, v;
-
-   patch_match_impl(m_f_pyramid_descriptor, m_g_pyramid_descriptor, m_seeds_flow_u, m_seeds_flow_v,
-                    m_seeds_flow_cost, m_cost_ptr, m_seeds, m_seed_neighbors, m_config, CpmConfig::ViewIndex::E_LEFT_VIEW);
+   // the warm-start flow is used only once
+   if (!m_warm_start_flow_u.empty())
+   {
+      if (m_warm_start_flow_u.size() == m_f.size())
+      {
+         dense_map_to_seeds(m_warm_start_flow_u, m_seeds[0], m_warm_start_u);
+         dense_map_to_seeds(m_warm_start_flow_v, m_seeds[0], m_warm_start_v);
+      }
+      m_warm_start_flow_u.release();
+      m_warm_start_flow_v.release();
+   }
+   if (m_warm_start_u.rows != m_num_seeds)
+   {
+      m_warm_start_u.release();
+      m_warm_start_v.release();
+   }
 
    if (m_config.get_cross_check())
    {
-      std::vector<cv::Mat> flows_u, flows_v, flows_cost;
-      patch_match_impl(m_g_pyramid_descriptor, m_f_pyramid_descriptor, flows_u, flows_v,
-                       flows_cost, m_cost_ptr, m_seeds, m_seed_neighbors, m_config, CpmConfig::ViewIndex::E_RIGHT_VIEW);
+      // the right view matches g to f, so its prior is the reversed flow
+      if (!m_warm_start_u.empty())
+      {
+         m_warm_start_u.convertTo(m_right_warm_start_u, CV_32F, -1);
+         m_warm_start_v.convertTo(m_right_warm_start_v, CV_32F, -1);
+      }
+      else
+      {
+         m_right_warm_start_u.release();
+         m_right_warm_start_v.release();
+      }
 
-      cross_check(m_seeds[0], m_seeds_flow_u[0], m_seeds_flow_v[0], flows_u[0], flows_v[0],
-                  u, v, m_config.get_grid_space(), m_seeds_per_row, 3, m_config.get_max_displacement(),
-                  m_config.get_verbose());
+      std::vector<cv::Mat>* flows_u[2] = {&m_seeds_flow_u, &m_right_seeds_flow_u};
+      std::vector<cv::Mat>* flows_v[2] = {&m_seeds_flow_v, &m_right_seeds_flow_v};
+      std::vector<cv::Mat>* flows_cost[2] = {&m_seeds_flow_cost, &m_right_seeds_flow_cost};
+      cv::Mat warm_start_u[2] = {m_warm_start_u, m_right_warm_start_u};
+      cv::Mat warm_start_v[2] = {m_warm_start_v, m_right_warm_start_v};
+      PatchMatchLoopBody loop_body(m_f_pyramid_descriptor, m_g_pyramid_descriptor, m_impl, flows_u, flows_v,
+                                   flows_cost, m_cost_ptr, m_seeds, m_seed_neighbors, m_seeds_coarser_index,
+                                   m_config, warm_start_u, warm_start_v);
+      if (m_config.get_parallel_propagation())
+      {
+         // the propagation of every view is parallel; nested parallel loops
+         // run serially, so the views run one after the other with the whole pool
+         loop_body(cv::Range(0, 2));
+      }
+      else
+      {
+         // run the left view and the right view concurrently
+         cv::parallel_for_(cv::Range(0, 2), loop_body, 2);
+      }
    }
    else
    {
-      u = m_seeds_flow_u[0];
-      v = m_seeds_flow_v[0];
+      patch_match_impl(*m_impl[CpmConfig::ViewIndex::E_LEFT_VIEW], m_f_pyramid_descriptor, m_g_pyramid_descriptor,
+                       m_seeds_flow_u, m_seeds_flow_v, m_seeds_flow_cost, m_cost_ptr, m_seeds, m_seed_neighbors,
+                       m_seeds_coarser_index, m_config, CpmConfig::ViewIndex::E_LEFT_VIEW, m_warm_start_u, m_warm_start_v);
    }
 
-   m_u.create(u.size(), CV_32FC1);
-   m_v.create(v.size(), CV_32FC1);
+   m_warm_start_u.release();
+   m_warm_start_v.release();
 
-   m_u = 0;
-   m_v = 0;
+   if (m_config.get_verbose())
+   {
+      show_level_stats(get_level_stats(CpmConfig::ViewIndex::E_LEFT_VIEW));
+   }
+}
 
-   int num_seeds = m_seeds[0].rows;
-   for (int i = 0; i < num_seeds; i++)
+void
+Cpm::seeds_flow_to_dense()
+{
+   cv::Mat u, v;
+
+   if (m_config.get_cross_check())
    {
-      int y = m_seeds[0].at<int>(i, 1);
-      int x = m_seeds[0].at<int>(i, 0);
+      cross_check(m_seeds[0], m_seeds_flow_u[0], m_seeds_flow_v[0], m_right_seeds_flow_u[0], m_right_seeds_flow_v[0],
+                  m_checked_u, m_checked_v, m_f.size(), m_config.get_grid_space(), m_seed_grid_index, 3,
+                  m_config.get_max_displacement(), m_config.get_verbose());
 
-      m_u.at<float>(y,x) = u.at<float>(y,x);
-      m_v.at<float>(y,x) = v.at<float>(y,x);
+      u = m_checked_u;
+      v = m_checked_v;
+   }
+   else
+   {
+      u = m_seeds_flow_u[0];
+      v = m_seeds_flow_v[0];
    }
+
+   // convert the seed-indexed flow to dense maps,
+   // flows of non-seed pixels are set to 0
+   seeds_to_dense_map(u, m_seeds[0], m_f.size(), m_u, 0);
+   seeds_to_dense_map(v, m_seeds[0], m_f.size(), m_v, 0);
 }
@@ -20,12 +20,18 @@
 
 #include "CpmConfig.hpp"
 
+#include "common.hpp"
+
 CpmConfig::CpmConfig()
    : m_grid_space(3),
      m_pyramid_ratio(0.75),
      m_num_pyramid_level(8),
      m_max_displacement(400),
      m_num_iterations(8),
+     m_min_num_iterations(1),
+     m_stop_ratio(0.02f),
+     m_stop_ratio_change(0.02f),
+     m_stop_count_seeds(false),
      m_half_patch_size(0),
      m_minimum_image_width(30),
      m_cross_check_enabled(true),
@@ -34,8 +40,24 @@ CpmConfig::CpmConfig()
 
      m_descriptor_type(DescriptorType::E_DESC_TYPE_SIFT),
      m_descriptor_color_to_gray(true),
+     m_descriptor_pyramid(false),
+     m_pca_sift_components(32),
+     m_pca_sift_basis_filename(std::string(KFJ_DATA_PATH) + "/sift_flow_descriptor/pcSIFT.bin"),
      m_match_cost_type(E_COST_TYPE_SAD),
      m_pm_property_type(PmPropertyType::E_PROPERTY_FLOW),
+     m_seed_order(SeedOrder::E_SEED_ORDER_ROW_MAJOR),
+     m_merge_coarse_seeds(false),
+     m_parallel_propagation(false),
+     m_warm_start(false),
+     m_warm_start_levels(0),
+     m_warm_start_num_iterations(2),
+     m_tile_memory_budget(0),
+     m_parallel_tiles(false),
+     m_time_budget(0),
+     m_cost_cache(true),
+     m_subpixel_cost(false),
+     m_sparse_reference_descriptor(false),
+     m_random_seed(100),
 
      m_use_interpolation(true)
 {}
@@ -65,6 +87,25 @@ CpmConfig::pm_property_type_to_string(PmPropertyType type_)
    return res;
 }
 
+std::string
+CpmConfig::seed_order_to_string(SeedOrder order_)
+{
+   std::string res;
+   switch (order_)
+   {
+      case SeedOrder::E_SEED_ORDER_ROW_MAJOR:
+         res = "Row major";
+         break;
+      case SeedOrder::E_SEED_ORDER_MORTON:
+         res = "Morton";
+         break;
+      default:
+         CV_Assert(false);  // unreachable code
+         break;
+   }
+   return res;
+}
+
 std::string
 CpmConfig::to_string() const
 {
@@ -75,14 +116,33 @@ CpmConfig::to_string() const
       << "Number of pyramid levels: " << m_num_pyramid_level << std::endl
       << "Max displacement: " << m_max_displacement << std::endl
       << "Number of iterations: " << m_num_iterations << std::endl
+      << "Minimum number of iterations: " << m_min_num_iterations << std::endl
+      << "Stop ratio: " << m_stop_ratio << std::endl
+      << "Stop ratio change: " << m_stop_ratio_change << std::endl
+      << "Stop count seeds: " << m_stop_count_seeds << std::endl
       << "Half patch size: " << m_half_patch_size << std::endl
       << "Minimum image width: " << m_minimum_image_width << std::endl
       << "Cross check: " << (m_cross_check_enabled ? "true" : "false" ) << std::endl
       << "Verbose: " << (m_verbose ? "true" : "false" ) << std::endl
       << "Descriptor type: " << descriptor_type_to_string(m_descriptor_type) << std::endl
       << "Descriptor color to gray: " << (m_descriptor_color_to_gray ? "true" : "false") << std::endl
+      << "Descriptor pyramid: " << (m_descriptor_pyramid ? "true" : "false") << std::endl
+      << "PCA SIFT components: " << m_pca_sift_components << std::endl
       << "Match cost type: " << match_cost_type_to_string(m_match_cost_type) << std::endl
       << "Property type: " << pm_property_type_to_string(m_pm_property_type) << std::endl
+      << "Seed order: " << seed_order_to_string(m_seed_order) << std::endl
+      << "Merge coarse seeds: " << (m_merge_coarse_seeds ? "true" : "false" ) << std::endl
+      << "Parallel propagation: " << (m_parallel_propagation ? "true" : "false" ) << std::endl
+      << "Warm start: " << (m_warm_start ? "true" : "false" ) << std::endl
+      << "Warm start levels: " << m_warm_start_levels << std::endl
+      << "Warm start number of iterations: " << m_warm_start_num_iterations << std::endl
+      << "Tile memory budget (MB): " << m_tile_memory_budget << std::endl
+      << "Parallel tiles: " << (m_parallel_tiles ? "true" : "false" ) << std::endl
+      << "Time budget (ms): " << m_time_budget << std::endl
+      << "Cost cache: " << (m_cost_cache ? "true" : "false" ) << std::endl
+      << "Subpixel cost: " << (m_subpixel_cost ? "true" : "false" ) << std::endl
+      << "Sparse reference descriptor: " << (m_sparse_reference_descriptor ? "true" : "false" ) << std::endl
+      << "Random seed: " << m_random_seed << std::endl
       << "Use interpolation: " << (m_use_interpolation ? "true" : "false" ) << std::endl
       ;
    if (!m_filename_1.empty())
@@ -15,14 +15,13 @@
     You should have received a COPYING file of the GNU General Public License
     along with this program. If not, see <http://www.gnu.org/licenses/>
     -----------------------------------------------------------------  */
+#include <atomic>
 #include <iostream>
+#include <unordered_map>
 #include <opencv2/core.hpp>
 
 #include "CpmImpl.hpp"
-#include "CpmImplFlow.hpp"
-#include "CpmImplAffineModel.hpp"
-#include "CpmImplQuadraticModel.hpp"
-#include "CpmImplProjectivePlanar.hpp"
+#include "CpmImplKernel.hpp"
 #include "CpmConfig.hpp"
 #include "MatchCost.hpp"
 #include "pm_common.hpp"
@@ -31,6 +30,99 @@
 
 #define KFJ_SAVE_DEBUG_INFO 0
 
+#if KFJ_SAVE_DEBUG_INFO
+/**
+ * Save the flow of the seeds to a file. Pixels that are not seeds have zero flow.
+ */
+static void
+save_seeds_flow(
+      OpticalFlowKfj& of_,
+      const cv::Mat& u_,
+      const cv::Mat& v_,
+      const cv::Mat& seeds_,
+      const cv::Size& size_,
+      const cv::String& filename_
+)
+{
+   cv::Mat u, v;
+   seeds_to_dense_map(u_, seeds_, size_, u, 0);
+   seeds_to_dense_map(v_, seeds_, size_, v, 0);
+   of_.set_estimated_flow(u, v);
+   of_.save_estimated_flow_to_file(filename_.c_str());
+}
+#endif
+
+/**
+ * Move seed-indexed values to the next coarser level.
+ *
+ * Several seeds may collapse onto one seed at the coarser level,
+ * which takes the value of the first of them. Seeds at the coarser level
+ * that no seed maps to are set to 0.
+ *
+ * @param values_         [in]  Value of every seed at the finer level, CV_32FC1, 1 column.
+ * @param coarser_index_  [in]  Index of the seed at the coarser level of every seed at the finer level, CV_32SC1.
+ * @param num_coarse_     [in]  Number of seeds at the coarser level.
+ * @param coarse_values_  [out] Value of every seed at the coarser level, CV_32FC1, num_coarse_ x 1.
+ */
+static void
+values_to_coarser_level(
+      const cv::Mat& values_,
+      const cv::Mat& coarser_index_,
+      int num_coarse_,
+      cv::Mat& coarse_values_
+)
+{
+   CV_Assert(values_.type() == CV_32FC1);
+   CV_Assert(coarser_index_.rows == values_.rows);
+
+   coarse_values_.create(num_coarse_, 1, CV_32FC1);
+   coarse_values_ = 0;
+
+   std::vector<char> is_set((size_t)num_coarse_, 0);
+   for (int n = 0; n < values_.rows; n++)
+   {
+      int index = coarser_index_.at<int>(n);
+      if (is_set[index]) continue;
+
+      coarse_values_.at<float>(index) = values_.at<float>(n);
+      is_set[index] = 1;
+   }
+}
+
+/**
+ * Deadline of a level for the time budget.
+ *
+ * The time left until end_tick_ is shared by the levels that have not run yet,
+ * in proportion to their number of seeds. Time saved by a coarser level
+ * goes to the finer levels.
+ *
+ * @param end_tick_         [in] End of the budget, in ticks of cv::getTickCount().
+ * @param remaining_seeds_  [in] Element i is the number of seeds of the levels [0, i).
+ * @param level_            [in] The level that is about to run.
+ *
+ * @return Deadline of the level in ticks of cv::getTickCount().
+ */
+static double
+level_deadline(
+      double end_tick_,
+      const std::vector<int>& remaining_seeds_,
+      int level_
+)
+{
+   double now = (double)cv::getTickCount();
+   double remaining = cv::max(end_tick_ - now, 0.0);
+   double share = (double)(remaining_seeds_[level_+1] - remaining_seeds_[level_]) / remaining_seeds_[level_+1];
+
+   // a deadline of 0 means no deadline
+   return cv::max(now + remaining * share, 1.0);
+}
+
+/**
+ * Create the implementation for a motion model.
+ *
+ * The propagation kernel specialized for the model is selected here once,
+ * see CpmImplKernel.
+ */
 cv::Ptr<CpmImpl>
 CpmImpl::create(CpmConfig::PmPropertyType type_)
 {
@@ -38,16 +130,16 @@ CpmImpl::create(CpmConfig::PmPropertyType type_)
    switch (type_)
    {
       case CpmConfig::PmPropertyType::E_PROPERTY_FLOW:
-         res = cv::makePtr<CpmImplFlow>();
+         res = cv::makePtr<CpmImplKernel<CpmImplFlow> >();
          break;
       case CpmConfig::PmPropertyType::E_PROPERTY_AFFINE_MODEL:
-         res = cv::makePtr<CpmImplAffineModel>();
+         res = cv::makePtr<CpmImplKernel<CpmImplAffineModel> >();
          break;
       case CpmConfig::PmPropertyType::E_PROPERTY_QUADRATIC_MODEL:
-         res = cv::makePtr<CpmImplQuadraticModel>();
+         res = cv::makePtr<CpmImplKernel<CpmImplQuadraticModel> >();
          break;
       case CpmConfig::PmPropertyType::E_PROPERTY_PROJECTIVE_PLANAR:
-         res = cv::makePtr<CpmImplProjectivePlanar>();
+         res = cv::makePtr<CpmImplKernel<CpmImplProjectivePlanar> >();
          break;
       default:
          CV_Assert(false);  // unreachable code
@@ -58,7 +150,11 @@ CpmImpl::create(CpmConfig::PmPropertyType type_)
 
 CpmImpl::CpmImpl()
    :
-   m_is_left_view(true)
+   m_is_left_view(true),
+   m_parallel_propagation(false),
+   m_random_seed(100),
+   m_subpixel_cost(false),
+   m_bilinear_kernel(nullptr)
 {}
 
 void
@@ -70,33 +166,106 @@ CpmImpl::property_patch_match_impl(
       std::vector<cv::Mat> &flows_cost_,
       cv::Ptr<MatchCost> cost_func_ptr_,
       const std::vector<cv::Mat> &seeds_,
-      const cv::Mat &seed_neighbors_,
-      const CpmConfig &config_
+      const std::vector<cv::Mat> &seed_neighbors_,
+      const std::vector<cv::Mat> &seeds_coarser_index_,
+      const CpmConfig &config_,
+      const cv::Mat &warm_start_u_,
+      const cv::Mat &warm_start_v_
 )
 {
    CV_Assert(!image1_.empty() && !image2_.empty());
    CV_Assert(image1_.size() == image2_.size());
 
    int num_levels = (int)image1_.size();
+   CV_Assert(seeds_.size() == (size_t)num_levels);
+   CV_Assert(seed_neighbors_.size() == (size_t)num_levels);
+   CV_Assert(seeds_coarser_index_.size() == (size_t)num_levels);
    for (int i = 0; i < num_levels; i++)
    {
       CV_Assert(image1_[i].size() == image2_[i].size());
       CV_Assert(image1_[i].type() == image2_[i].type());
+      CV_Assert(seed_neighbors_[i].rows == seeds_[i].rows);
    }
 
    flows_u_.resize((size_t)num_levels);
    flows_v_.resize((size_t)num_levels);
    flows_cost_.resize((size_t)num_levels);
 
-   std::vector<cv::Mat> seeds_property((size_t)num_levels);
+   m_seeds_property.resize((size_t)num_levels);
+   std::vector<cv::Mat>& seeds_property = m_seeds_property;
+
+   m_level_stats.assign((size_t)num_levels, CpmLevelStats());
+
+   m_random_seed = config_.get_random_seed();
+
+   // the descriptors of all levels have the same type
+   m_subpixel_cost = config_.get_subpixel_cost();
+   m_bilinear_kernel = m_subpixel_cost ? cost_func_ptr_->get_bilinear_kernel(image1_[0].type()) : nullptr;
+
+   // the remaining budget is shared by the remaining levels in proportion to their number of seeds
+   double tick_frequency = cv::getTickFrequency();
+   double end_tick = 0;
+   std::vector<int> remaining_seeds((size_t)num_levels + 1, 0); // seeds of levels [0, i)
+   bool has_budget = (config_.get_time_budget() > 0);
+   if (has_budget)
+   {
+      end_tick = (double)cv::getTickCount() + config_.get_time_budget() * 1e-3 * tick_frequency;
+      for (int i = 0; i < num_levels; i++)
+      {
+         remaining_seeds[i+1] = remaining_seeds[i] + seeds_[i].rows;
+      }
+   }
 
    float search_radius = config_.get_max_displacement() * (float)std::pow(config_.get_pyramid_ratio(), num_levels-1);
 
-   seeds_property[num_levels-1].create(image1_[num_levels-1].size(), CV_32FC(m_num_properties));
-   property_random_init(seeds_property[num_levels-1], seeds_[num_levels-1], search_radius);
+   // levels [first_warm_start_level, num_levels-1] are warm-started
+   bool warm_start = !warm_start_u_.empty();
+   int first_warm_start_level = num_levels;
+   if (warm_start)
+   {
+      CV_Assert(warm_start_u_.type() == CV_32FC1);
+      CV_Assert(warm_start_v_.type() == CV_32FC1);
+      CV_Assert(warm_start_u_.rows == seeds_[0].rows);
+      CV_Assert(warm_start_v_.rows == seeds_[0].rows);
+
+      int warm_start_levels = config_.get_warm_start_levels();
+      if ((warm_start_levels < 1) || (warm_start_levels > num_levels))
+      {
+         warm_start_levels = num_levels;
+      }
+      first_warm_start_level = num_levels - warm_start_levels;
+
+      // a collapsed seed takes the flow of the first seed collapsed onto it
+      m_warm_start_u.resize((size_t)num_levels);
+      m_warm_start_v.resize((size_t)num_levels);
+      m_warm_start_u[0] = warm_start_u_;
+      m_warm_start_v[0] = warm_start_v_;
+      for (int i = 1; i < num_levels; i++)
+      {
+         values_to_coarser_level(m_warm_start_u[i-1], seeds_coarser_index_[i-1], seeds_[i].rows, m_warm_start_u[i]);
+         values_to_coarser_level(m_warm_start_v[i-1], seeds_coarser_index_[i-1], seeds_[i].rows, m_warm_start_v[i]);
+      }
+   }
+
+   property_random_init(seeds_property[num_levels-1], seeds_[num_levels-1], search_radius, num_levels-1);
    property_to_uv(seeds_property[num_levels-1], seeds_[num_levels-1], flows_u_[num_levels-1], flows_v_[num_levels-1]);
    compute_cost(flows_u_[num_levels-1], flows_v_[num_levels-1], image1_[num_levels-1], image2_[num_levels-1], flows_cost_[num_levels-1],
-                cost_func_ptr_,seeds_[num_levels-1],config_.get_half_patch_size());
+                cost_func_ptr_,seeds_[num_levels-1],config_.get_half_patch_size(), m_subpixel_cost);
+
+   if (warm_start)
+   {
+      // the random init is kept for seeds whose warm-start flow is worse
+      int num_warm = property_warm_start(image1_[num_levels-1], image2_[num_levels-1],
+                                         m_warm_start_u[num_levels-1], m_warm_start_v[num_levels-1],
+                                         (float)std::pow(config_.get_pyramid_ratio(), num_levels-1),
+                                         seeds_property[num_levels-1], flows_cost_[num_levels-1], cost_func_ptr_,
+                                         seeds_[num_levels-1], config_.get_half_patch_size());
+      if (config_.get_verbose())
+      {
+         std::cout << "level " << num_levels-1 << ": " << num_warm << " of " << seeds_[num_levels-1].rows
+                   << " seeds are warm-started" << std::endl;
+      }
+   }
 
    cv::String filename = cv::format("/tmp/kuangfn/random-init-flow-level-%d.flo", num_levels-1);
    OpticalFlowKfj of;
@@ -104,13 +273,13 @@ CpmImpl::property_patch_match_impl(
 #if KFJ_SAVE_DEBUG_INFO
    if (m_is_left_view)
    {
-      of.set_estimated_flow(flows_u_[num_levels-1], flows_v_[num_levels-1]);
-      of.save_estimated_flow_to_file(filename.c_str());
+      save_seeds_flow(of, flows_u_[num_levels-1], flows_v_[num_levels-1], seeds_[num_levels-1], image1_[num_levels-1].size(), filename);
       printf("Save the random init flow to '%s'\n", filename.c_str());
    }
 #endif
 
    int num_iterations = config_.get_number_of_iterations();
+   int warm_start_num_iterations = config_.get_warm_start_number_of_iterations();
 
    property_propagation(
          seeds_property[num_levels-1],
@@ -118,13 +287,15 @@ CpmImpl::property_patch_match_impl(
          image2_[num_levels-1],
          flows_cost_[num_levels-1],
          cost_func_ptr_,
-         num_iterations,
+         warm_start ? warm_start_num_iterations : num_iterations,
          search_radius,
          seeds_[num_levels-1],
-         seed_neighbors_,
+         seed_neighbors_[num_levels-1],
          config_.get_half_patch_size(),
-         config_.get_verbose(),
-         num_levels - 1);
+         num_levels-1,
+         config_,
+         has_budget ? level_deadline(end_tick, remaining_seeds, num_levels-1) : 0,
+         &m_level_stats[num_levels-1]);
 
    property_to_uv(seeds_property[num_levels-1], seeds_[num_levels-1], flows_u_[num_levels-1], flows_v_[num_levels-1]);
 
@@ -132,8 +303,7 @@ CpmImpl::property_patch_match_impl(
    if (m_is_left_view)
    {
       filename = cv::format("/tmp/kuangfn/flow-level-%d.flo", num_levels-1);
-      of.set_estimated_flow(flows_u_[num_levels-1], flows_v_[num_levels-1]);
-      of.save_estimated_flow_to_file(filename.c_str());
+      save_seeds_flow(of, flows_u_[num_levels-1], flows_v_[num_levels-1], seeds_[num_levels-1], image1_[num_levels-1].size(), filename);
       printf("Save flow level at %d to '%s'\n",num_levels-1, filename.c_str());
    }
 #endif
@@ -147,6 +317,7 @@ CpmImpl::property_patch_match_impl(
             image1_,
             image2_,
             seeds_,
+            seeds_coarser_index_,
             seeds_property,
             flows_cost_,
             cost_func_ptr_,
@@ -155,13 +326,26 @@ CpmImpl::property_patch_match_impl(
             i+1,
             i);
 
+      bool is_warm_level = (i >= first_warm_start_level);
+      if (is_warm_level)
+      {
+         int num_warm = property_warm_start(image1_[i], image2_[i], m_warm_start_u[i], m_warm_start_v[i],
+                                            (float)std::pow(config_.get_pyramid_ratio(), i),
+                                            seeds_property[i], flows_cost_[i], cost_func_ptr_,
+                                            seeds_[i], config_.get_half_patch_size());
+         if (config_.get_verbose())
+         {
+            std::cout << "level " << i << ": " << num_warm << " of " << seeds_[i].rows
+                      << " seeds are warm-started" << std::endl;
+         }
+      }
+
 #if KFJ_SAVE_DEBUG_INFO
       if (m_is_left_view)
       {
          property_to_uv(seeds_property[i], seeds_[i], flows_u_[i], flows_v_[i]);
          filename = cv::format("/tmp/kuangfn/flow-level-%d-init.flo", i);
-         of.set_estimated_flow(flows_u_[i], flows_v_[i]);
-         of.save_estimated_flow_to_file(filename.c_str());
+         save_seeds_flow(of, flows_u_[i], flows_v_[i], seeds_[i], image1_[i].size(), filename);
          printf("Save flow level at %d to '%s'\n", i, filename.c_str());
       }
 #endif
@@ -174,27 +358,317 @@ CpmImpl::property_patch_match_impl(
             image2_[i],
             flows_cost_[i],
             cost_func_ptr_,
-            num_iterations,
+            is_warm_level ? warm_start_num_iterations : num_iterations,
             search_radius,
             seeds_[i],
-            seed_neighbors_,
+            seed_neighbors_[i],
             config_.get_half_patch_size(),
-            config_.get_verbose(),
-            i);
+            i,
+            config_,
+            has_budget ? level_deadline(end_tick, remaining_seeds, i) : 0,
+            &m_level_stats[i]);
       property_to_uv(seeds_property[i], seeds_[i], flows_u_[i], flows_v_[i]);
 
 #if KFJ_SAVE_DEBUG_INFO
       if (m_is_left_view)
       {
          filename = cv::format("/tmp/kuangfn/flow-level-%d.flo", i);
-         of.set_estimated_flow(flows_u_[i], flows_v_[i]);
-         of.save_estimated_flow_to_file(filename.c_str());
+         save_seeds_flow(of, flows_u_[i], flows_v_[i], seeds_[i], image1_[i].size(), filename);
          printf("Save flow level at %d to '%s'\n", i, filename.c_str());
       }
 #endif
    }
 }
 
+int
+CpmImpl::property_warm_start(
+      const cv::Mat& f_,
+      const cv::Mat& g_,
+      const cv::Mat& warm_start_u_,
+      const cv::Mat& warm_start_v_,
+      float scale_,
+      cv::Mat& property_,
+      cv::Mat& cost_,
+      cv::Ptr<MatchCost> cost_func_ptr_,
+      const cv::Mat& seeds_,
+      int half_patch_size_
+)
+{
+   int num_seeds = seeds_.rows;
+   CV_Assert(warm_start_u_.rows == num_seeds);
+   CV_Assert(warm_start_v_.rows == num_seeds);
+   CV_Assert(property_.rows == num_seeds);
+   CV_Assert(property_.cols == m_num_properties);
+   CV_Assert(cost_.rows == num_seeds);
+
+   int nx = f_.cols;
+   int ny = f_.rows;
+
+   MatchCost::Kernel cost_kernel = cost_func_ptr_->get_kernel(f_.type());
+
+   int num_warm = 0;
+   for (int n = 0; n < num_seeds; n++)
+   {
+      const int* p_coord = seeds_.ptr<int>(n);
+      int x = p_coord[0];
+      int y = p_coord[1];
+
+      float u = warm_start_u_.at<float>(n) * scale_;
+      float v = warm_start_v_.at<float>(n) * scale_;
+
+      float& old_cost = cost_.at<float>(n);
+      float c;
+      if (m_subpixel_cost)
+      {
+         if (!compute_subpixel_cost(f_, g_, x, y, x + u, y + v, cost_kernel, m_bilinear_kernel, half_patch_size_, c))
+         {
+            continue;
+         }
+      }
+      else
+      {
+         int x2 = cvRound(x + u);
+         int y2 = cvRound(y + v);
+         if (!is_inside(x2, nx) || !is_inside(y2, ny)) continue; // e.g., flows invalidated by the cross check
+
+         c = (float)MatchCost::compute_patch_cost(cost_kernel, f_, g_, x, y, x2, y2, half_patch_size_, old_cost);
+      }
+
+      if (c < old_cost)
+      {
+         old_cost = c;
+         property_from_uv(u, v, x, y, property_.ptr<float>(n));
+         num_warm++;
+      }
+   }
+
+   return num_warm;
+}
+
+void
+CpmImpl::property_to_uv(
+      const cv::Mat& property_,
+      const cv::Mat& seeds_,
+      cv::Mat& u_,
+      cv::Mat& v_
+)
+{
+   CV_Assert(property_.type() == CV_32FC1);
+   CV_Assert(property_.cols == m_num_properties);
+   CV_Assert(property_.rows == seeds_.rows);
+
+   int num_seeds = seeds_.rows;
+   u_.create(num_seeds, 1, CV_32FC1);
+   v_.create(num_seeds, 1, CV_32FC1);
+
+   for (int n = 0; n < num_seeds; n++)
+   {
+      int y = seeds_.at<int>(n, 1);
+      int x = seeds_.at<int>(n, 0);
+      property_to_uv(property_.ptr<float>(n), u_.at<float>(n), v_.at<float>(n), x, y);
+   }
+}
+
+/**
+ * Split the seeds into phases for parallel propagation.
+ *
+ * A seed writes only its own property and reads the properties of its neighbors.
+ * Seeds are colored greedily in index order such that no two neighboring seeds
+ * have the same color. Seeds with the same color can thus be updated concurrently.
+ *
+ * For the regular seed grid, it results in 4 phases.
+ *
+ * @param neighbors_  [in]  Neighbor indices of the seeds, CV_32SC1, 8 columns.
+ * @param phases_     [out] Seed indices of every phase.
+ */
+static void
+get_propagation_phases(
+      const cv::Mat& neighbors_,
+      std::vector<std::vector<int> >& phases_
+)
+{
+   int num_seeds = neighbors_.rows;
+   int num_neighbors = neighbors_.cols;
+
+   phases_.clear();
+
+   std::vector<int> colors((size_t)num_seeds, -1);
+   std::vector<char> used;
+
+   for (int n = 0; n < num_seeds; n++)
+   {
+      used.assign(phases_.size() + 1, 0);
+
+      const int* p_neighbors = neighbors_.ptr<int>(n);
+      for (int k = 0; k < num_neighbors; k++)
+      {
+         int index = p_neighbors[k];
+         if ((index != -1) && (colors[index] != -1))
+         {
+            used[colors[index]] = 1;
+         }
+      }
+
+      int color = 0;
+      while (used[color]) color++;
+
+      if (color == (int)phases_.size())
+      {
+         phases_.emplace_back();
+      }
+
+      colors[n] = color;
+      phases_[color].push_back(n);
+   }
+}
+
+/**
+ * Parallel loop body for processing the seeds of one phase.
+ */
+class PropagationLoopBody : public cv::ParallelLoopBody
+{
+public:
+   PropagationLoopBody(
+         CpmImpl* impl_,
+         const std::vector<int>& seeds_,
+         const std::vector<int>& neighbor_index_,
+         cv::Mat& property_,
+         const cv::Mat& f_,
+         const cv::Mat& g_,
+         cv::Mat& cost_,
+         MatchCost::Kernel cost_kernel_,
+         float max_search_radius_,
+         const cv::Mat& seed_coord_,
+         const cv::Mat& neighbors_,
+         int half_patch_size_,
+         int level_,
+         int iteration_,
+         bool count_seeds_,
+         std::atomic<int>& num_updates_,
+         std::atomic<int64>& num_cost_evaluations_,
+         std::atomic<int64>& num_cache_hits_
+   )
+      : m_impl(impl_),
+        m_seeds(seeds_),
+        m_neighbor_index(neighbor_index_),
+        m_property(property_),
+        m_f(f_),
+        m_g(g_),
+        m_cost(cost_),
+        m_cost_kernel(cost_kernel_),
+        m_max_search_radius(max_search_radius_),
+        m_seed_coord(seed_coord_),
+        m_neighbors(neighbors_),
+        m_half_patch_size(half_patch_size_),
+        m_level(level_),
+        m_iteration(iteration_),
+        m_count_seeds(count_seeds_),
+        m_num_updates(num_updates_),
+        m_num_cost_evaluations(num_cost_evaluations_),
+        m_num_cache_hits(num_cache_hits_)
+   {}
+
+   virtual void operator ()(const cv::Range& range) const
+   {
+      std::vector<float> try_property((size_t)m_impl->get_num_properties());
+      int num_updates = 0;
+      int num_cost_evaluations = 0;
+      int num_cache_hits = 0;
+
+      for (int i = range.start; i < range.end; i++)
+      {
+         int num_improved = m_impl->propagate_seed(m_seeds[i], m_neighbor_index, m_property, m_f, m_g, m_cost,
+                                                   m_cost_kernel, m_max_search_radius, m_seed_coord,
+                                                   m_neighbors, m_half_patch_size, m_level, m_iteration,
+                                                   try_property.data(),
+                                                   num_cost_evaluations, num_cache_hits);
+         num_updates += m_count_seeds ? (num_improved > 0) : num_improved;
+      }
+
+      m_num_updates += num_updates;
+      m_num_cost_evaluations += num_cost_evaluations;
+      m_num_cache_hits += num_cache_hits;
+   }
+
+private:
+   CpmImpl* m_impl;
+   const std::vector<int>& m_seeds;          //!< seed indices of this phase
+   const std::vector<int>& m_neighbor_index; //!< forward or backward neighbors
+   cv::Mat& m_property;
+   const cv::Mat& m_f;
+   const cv::Mat& m_g;
+   cv::Mat& m_cost;
+   MatchCost::Kernel m_cost_kernel;
+   float m_max_search_radius;
+   const cv::Mat& m_seed_coord;
+   const cv::Mat& m_neighbors;
+   int m_half_patch_size;
+   int m_level;
+   int m_iteration;
+   bool m_count_seeds;                       //!< see CpmConfig::get_stop_count_seeds()
+   std::atomic<int>& m_num_updates;
+   std::atomic<int64>& m_num_cost_evaluations;
+   std::atomic<int64>& m_num_cache_hits;
+};
+
+bool
+CpmImpl::improve_cost_cached(
+      int n_,
+      const cv::Mat& f_,
+      const cv::Mat& g_,
+      int x_,
+      int y_,
+      float& u_old_,
+      float& v_old_,
+      float& cost_old_,
+      float u_new_,
+      float v_new_,
+      MatchCost::Kernel cost_kernel_,
+      int half_patch_size_,
+      int& num_cost_evaluations_,
+      int& num_cache_hits_
+)
+{
+   if (m_cost_cache.empty())
+   {
+      num_cost_evaluations_++;
+      return improve_cost(f_, g_, x_, y_, u_old_, v_old_, cost_old_, u_new_, v_new_, cost_kernel_, half_patch_size_,
+                          m_subpixel_cost, m_bilinear_kernel);
+   }
+
+   // the same integer displacement as improve_cost()
+   int other_x = cvRound(x_ + u_new_);
+   int other_y = cvRound(y_ + v_new_);
+
+   if (!is_inside(other_x, f_.cols) || !is_inside(other_y, f_.rows))
+   {
+      return false;
+   }
+
+   float cost_new;
+   if (cost_cache_lookup(n_, other_x - x_, other_y - y_, cost_new))
+   {
+      num_cache_hits_++;
+   }
+   else
+   {
+      num_cost_evaluations_++;
+      cost_new = (float)MatchCost::compute_patch_cost(cost_kernel_, f_, g_,
+                                                      x_, y_, other_x, other_y, half_patch_size_, cost_old_);
+      cost_cache_insert(n_, other_x - x_, other_y - y_, cost_new);
+   }
+
+   if (cost_new < cost_old_)
+   {
+      cost_old_ = cost_new;
+      u_old_ = u_new_;
+      v_old_ = v_new_;
+      return true;
+   }
+
+   return false;
+}
+
 void
 CpmImpl::property_propagation(
       cv::Mat &property_,
@@ -207,16 +681,26 @@ CpmImpl::property_propagation(
       const cv::Mat &seed_coord_,
       const cv::Mat &neighbors_,
       int half_patch_size_,
-      bool verbose_ /* = true */,
-      int level_num_ /* = 0 */
+      int level_,
+      const CpmConfig& config_,
+      double deadline_ /* = 0 */,
+      CpmLevelStats* stats_ /* = nullptr */
 )
 {
+   double start_tick = (double)cv::getTickCount();
+   double last_iteration_ticks = 0; // duration of the last iteration, to predict the next one
+
+   CpmLevelStats stats;
+
    int num_seeds = seed_coord_.rows;
-   CV_Assert(property_.size() == f_.size());
-   CV_Assert(property_.size() == cost_.size());
-   CV_Assert(property_.type() == CV_32FC(m_num_properties));
+   CV_Assert(property_.rows == num_seeds);
+   CV_Assert(property_.cols == m_num_properties);
+   CV_Assert(property_.type() == CV_32FC1);
+   CV_Assert(cost_.rows == num_seeds);
    CV_Assert(cost_.type() == CV_32FC1);
 
+   stats.m_num_seeds = num_seeds;
+
    // 1:top neighbor, 2:left neighbor, 4:top right neighbor, 5: top left neighbor
    // 0:right neighbor, 3:bottom neighbor, 6:bottom left neighbor, 7:bottom right neighbor
    //
@@ -227,105 +711,144 @@ CpmImpl::property_propagation(
    // backward propagation: neighbors with 0,3,6,7
    std::vector<std::vector<int> > neighbor_indices = {{1,2,4,5}, {0,3,6,7}};
 
-   static const float stop_ratio = 0.02f; //TODO: increase the number may increase AAE but will definitely reduce running time
+   // a smaller stop ratio may decrease AAE but increases the running time, the authors use 0.05
+   float stop_ratio = config_.get_stop_ratio();
+   float stop_ratio_change = config_.get_stop_ratio_change();
+   int min_iterations = config_.get_min_number_of_iterations();
+   bool count_seeds = config_.get_stop_count_seeds();
 
-   //TODO: the authors use 0.05
    float last_update_percent = 0;
-   bool is_improved;
-   int num_improved;
 
-   float* ptr_try_property = new float[m_num_properties];
-   CV_Assert(ptr_try_property);
+   std::vector<std::vector<int> > phases;
+   if (m_parallel_propagation)
+   {
+      get_propagation_phases(neighbors_, phases);
+   }
+
+   std::vector<float> try_property((size_t)m_num_properties);
 
-   for (int i = 0; i < num_iterations_; i++)
+   // the cache is flushed for every level, since the descriptors and the seeds change.
+   // Subpixel costs depend on the fractional part of the flow and are not cached.
+   if (config_.get_cost_cache() && !m_subpixel_cost)
    {
-      num_improved = 0;
-      for (int n = 0; n < num_seeds; n++)
-      {
-         is_improved = false;
-         int y = seed_coord_.at<int>(n,1);
-         int x = seed_coord_.at<int>(n,0);
+      CpmCostCacheEntry empty_entry = {E_COST_CACHE_EMPTY_KEY, 0};
+      m_cost_cache.assign((size_t)num_seeds*E_COST_CACHE_SIZE, empty_entry);
+   }
+   else
+   {
+      m_cost_cache.clear();
+   }
 
-         float* p_property = property_.ptr<float>(y,x);
-         float old_u, old_v;
-         property_to_uv(p_property, old_u, old_v, x, y);
+   MatchCost::Kernel cost_kernel = cost_func_ptr_->get_kernel(f_.type());
 
-         float& old_cost = cost_.at<float>(y,x);
+   for (int i = 0; i < num_iterations_; i++)
+   {
+      double iteration_start_tick = (double)cv::getTickCount();
+      if ((deadline_ > 0) && (iteration_start_tick + last_iteration_ticks > deadline_))
+      {
+         // keep the current properties for the next finer level
+         stats.m_truncated = true;
+         break;
+      }
 
-         std::vector<int>& neighbor_index = neighbor_indices[(i&1)]; // even i: forward propagation, odd i: backward propagation
-         int nz = (int)neighbor_index.size();
+      int num_updates = 0;
+      int64 num_cost_evaluations = 0;
+      int64 num_cache_hits = 0;
+      std::vector<int>& neighbor_index = neighbor_indices[(i&1)]; // even i: forward propagation, odd i: backward propagation
 
-         for (int k = 0; k < nz; k++)
+      if (m_parallel_propagation)
+      {
+         // forward propagation visits the phases in increasing order, backward propagation in decreasing order
+         std::atomic<int> phase_updates(0);
+         std::atomic<int64> phase_cost_evaluations(0);
+         std::atomic<int64> phase_cache_hits(0);
+         int num_phases = (int)phases.size();
+         for (int p = 0; p < num_phases; p++)
          {
-            int index = neighbors_.at<int>(n, neighbor_index[k]);
-            if (index == -1) continue; // the seed is on the corners or at the boundaries
-
-            int y2 = seed_coord_.at<int>(index, 1);
-            int x2 = seed_coord_.at<int>(index, 0);
-
-            float* p_try_property = property_.ptr<float>(y2,x2);
-            float try_u, try_v;
-            property_to_uv(p_try_property, try_u, try_v, x, y);
-
-            if ((cv::abs(try_u - old_u) < 1e-5) && (cv::abs(try_v - old_v) < 1e-5))
-            {
-               continue;
-            }
-
-            is_improved = improve_cost(f_, g_, x, y, old_u, old_v, old_cost, try_u, try_v, cost_func_ptr_, half_patch_size_);
-            if (is_improved)
-            {
-               memcpy(p_property, p_try_property, sizeof(float)*m_num_properties);
-               num_improved++;
-            }
+            const std::vector<int>& phase = phases[(i&1) ? (num_phases - 1 - p) : p];
+            PropagationLoopBody loop_body(this, phase, neighbor_index, property_, f_, g_, cost_,
+                                          cost_kernel, max_search_radius_, seed_coord_, neighbors_,
+                                          half_patch_size_, level_, i, count_seeds, phase_updates, phase_cost_evaluations,
+                                          phase_cache_hits);
+            cv::parallel_for_(cv::Range(0, (int)phase.size()), loop_body);
          }
+         num_updates = phase_updates;
+         num_cost_evaluations = phase_cost_evaluations;
+         num_cache_hits = phase_cache_hits;
+      }
+      else
+      {
+         // in Morton order, the forward neighbors of most seeds are stored before them
+         // and the backward neighbors after them, so backward propagation runs in reverse
+         bool reverse = (i&1) && (config_.get_seed_order() == CpmConfig::SeedOrder::E_SEED_ORDER_MORTON);
 
-         // random search
-         for (float delta = max_search_radius_; delta > m_min_search_value; delta /= 2)
+         int seed_cost_evaluations = 0;
+         int seed_cache_hits = 0;
+         for (int k = 0; k < num_seeds; k++)
          {
-            random_search(p_property, ptr_try_property, delta);
-
-            float try_u, try_v;
-            property_to_uv(ptr_try_property, try_u, try_v, x, y);
-
-            if ((cv::abs(try_u - old_u) < 1e-5) && (cv::abs(try_v - old_v) < 1e-5))
-            {
-               continue;
-            }
-
-            is_improved = improve_cost(f_, g_, x, y, old_u, old_v, old_cost, try_u, try_v, cost_func_ptr_, half_patch_size_);
-            if (is_improved)
-            {
-               memcpy(p_property, ptr_try_property, sizeof(float)*m_num_properties);
-               num_improved++;
-            }
-         }
-      } // end for (int n = 0; n < num_seeds; n++)
-
-      if (verbose_)
-      {
-         std::cout << "number of improvement: " << num_improved << std::endl;
+            int n = reverse ? (num_seeds - 1 - k) : k;
+            int num_improved = propagate_seed(n, neighbor_index, property_, f_, g_, cost_, cost_kernel,
+                                              max_search_radius_, seed_coord_, neighbors_, half_patch_size_,
+                                              level_, i, try_property.data(), seed_cost_evaluations,
+                                              seed_cache_hits);
+            num_updates += count_seeds ? (num_improved > 0) : num_improved;
+         } // end for (int k = 0; k < num_seeds; k++)
+         num_cost_evaluations = seed_cost_evaluations;
+         num_cache_hits = seed_cache_hits;
       }
 
-      float update_percent = (float)num_improved/num_seeds;
-      if ((update_percent < stop_ratio) || cv::abs(update_percent - last_update_percent) < 0.02)
+      float update_percent = (float)num_updates/num_seeds;
+
+      stats.m_num_iterations++;
+      stats.m_improved_fraction.push_back(update_percent);
+      stats.m_num_cost_evaluations += num_cost_evaluations;
+      stats.m_num_cost_cache_hits += num_cache_hits;
+      last_iteration_ticks = (double)cv::getTickCount() - iteration_start_tick;
+
+      // the level has converged if few seeds improve or the number of improvements hardly changes
+      if ((i + 1 >= min_iterations) &&
+          ((update_percent < stop_ratio) || (cv::abs(update_percent - last_update_percent) < stop_ratio_change)))
       {
-         if (verbose_)
-         {
-            std::cout << "********************" << std::endl
-                      << "Exit the propagation loop in advance!" << std::endl
-                      << "number of improvement: " << num_improved << std::endl
-                      << "update percent: " << update_percent << std::endl
-                      << "Level number: " << level_num_ << std::endl
-                      << "Number of loops executed: " << (i+1) << std::endl
-                      << "++++++++++++++++++++" << std::endl;
-         }
          break;
       }
       last_update_percent = update_percent;
    } // for (int i = 0; i < num_iterations_; i++)
 
-   delete []ptr_try_property;
+   stats.m_time = ((double)cv::getTickCount() - start_tick) * 1e3 / cv::getTickFrequency();
+   if (stats_)
+   {
+      *stats_ = stats;
+   }
+}
+
+void
+CpmImpl::properties_from_coarser_level(
+      const cv::Mat& coarse_property_,
+      const cv::Mat& coarser_index_,
+      const cv::Mat& fine_seeds_,
+      float scale_,
+      cv::Mat& fine_property_,
+      cv::Mat& fine_u_,
+      cv::Mat& fine_v_
+)
+{
+   int num_seeds = fine_seeds_.rows;
+   CV_Assert(coarser_index_.rows == num_seeds);
+   CV_Assert(coarser_index_.type() == CV_32SC1);
+
+   fine_property_.create(num_seeds, m_num_properties, CV_32FC1);
+   fine_u_.create(num_seeds, 1, CV_32FC1);
+   fine_v_.create(num_seeds, 1, CV_32FC1);
+
+   for (int n = 0; n < num_seeds; n++)
+   {
+      int y = fine_seeds_.at<int>(n,1);
+      int x = fine_seeds_.at<int>(n,0);
+      float* p_property_fine_level = fine_property_.ptr<float>(n);
+
+      init_from_coarser_level(coarse_property_.ptr<float>(coarser_index_.at<int>(n)), p_property_fine_level, scale_);
+      property_to_uv(p_property_fine_level, fine_u_.at<float>(n), fine_v_.at<float>(n), x, y);
+   }
 }
 
 void
@@ -333,6 +856,7 @@ CpmImpl::property_init_from_coarser_level(
       const std::vector<cv::Mat> &image1_,
       const std::vector<cv::Mat> &image2_,
       const std::vector<cv::Mat> &seeds_,
+      const std::vector<cv::Mat> &seeds_coarser_index_,
       std::vector<cv::Mat> &seeds_property_,
       std::vector<cv::Mat> &flows_cost_,
       cv::Ptr<MatchCost> cost_func_ptr_,
@@ -350,7 +874,8 @@ CpmImpl::property_init_from_coarser_level(
 
    CV_Assert(seeds_property_.size() == (size_t)num_levels);
    CV_Assert(flows_cost_.size() == (size_t)num_levels);
-   CV_Assert(seeds_property_[coarse_level_num_].type() == CV_32FC(m_num_properties));
+   CV_Assert(seeds_property_[coarse_level_num_].type() == CV_32FC1);
+   CV_Assert(seeds_property_[coarse_level_num_].cols == m_num_properties);
 
    CV_Assert(pyramid_ratio_ > 1e-3);
    float inverse_ratio = 1.0f/pyramid_ratio_; // assume the ratio is not 0!
@@ -359,138 +884,42 @@ CpmImpl::property_init_from_coarser_level(
    int nx = image1_[fine_level_num_].cols;
    int ny = image1_[fine_level_num_].rows;
 
-   seeds_property_[fine_level_num_].create(ny, nx, CV_32FC(m_num_properties));
-   flows_cost_[fine_level_num_].create(ny, nx, CV_32FC1);
+   int num_seeds = seeds_[fine_level_num_].rows;
+
+   flows_cost_[fine_level_num_].create(num_seeds, 1, CV_32FC1);
 
-   seeds_property_[fine_level_num_] = 0;
    flows_cost_[fine_level_num_] = 1e10;
 
-   int num_seeds = seeds_[0].rows;
+   MatchCost::Kernel cost_kernel = cost_func_ptr_->get_kernel(image1_[fine_level_num_].type());
+
+   cv::Mat& fine_u = m_fine_u;
+   cv::Mat& fine_v = m_fine_v;
+   properties_from_coarser_level(seeds_property_[coarse_level_num_], seeds_coarser_index_[fine_level_num_],
+                                 seeds_[fine_level_num_], inverse_ratio,
+                                 seeds_property_[fine_level_num_], fine_u, fine_v);
 
    for (int n = 0; n < num_seeds; n++)
    {
-      int y_upper = seeds_[coarse_level_num_].at<int>(n, 1);
-      int x_upper = seeds_[coarse_level_num_].at<int>(n, 0);
-      float* p_property_coarse_level = seeds_property_[coarse_level_num_].ptr<float>(y_upper, x_upper);
-
       int y = seeds_[fine_level_num_].at<int>(n,1);
       int x = seeds_[fine_level_num_].at<int>(n,0);
-      float* p_property_fine_level = seeds_property_[fine_level_num_].ptr<float>(y,x);
 
-      init_from_coarser_level(p_property_coarse_level, p_property_fine_level, inverse_ratio);
+      float u = fine_u.at<float>(n);
+      float v = fine_v.at<float>(n);
 
-      float u,v;
-      property_to_uv(p_property_fine_level,u, v, x, y);
+      if (m_subpixel_cost)
+      {
+         compute_subpixel_cost(image1_[fine_level_num_], image2_[fine_level_num_], x, y, x + u, y + v,
+                               cost_kernel, m_bilinear_kernel, half_patch_size, flows_cost_[fine_level_num_].at<float>(n));
+         continue;
+      }
 
-#if 1
       int x2 = cvRound(x + u);
       int y2 = cvRound(y + v);
 
       if (!is_inside(x2, nx) || !is_inside(y2, ny)) continue;
-      float c = (float)cost_func_ptr_->compute_cost(image1_[fine_level_num_],
-                                                    image2_[fine_level_num_],
-                                                    cv::Point(x,y),
-                                                    cv::Point(x2, y2),
-                                                    half_patch_size);
-
-      flows_cost_[fine_level_num_].at<float>(y,x) = c;
-#else
-      if (half_patch_size)
-      {
-         int x2 = cvRound(x + u);
-         int y2 = cvRound(y + v);
+      float c = (float)MatchCost::compute_patch_cost(cost_kernel, image1_[fine_level_num_], image2_[fine_level_num_],
+                                                     x, y, x2, y2, half_patch_size);
 
-         // todo: use bilinear interpolation when half_patch_size is 0
-         if (!is_inside(x2, nx) || !is_inside(y2, ny)) continue;
-         float c = (float)cost_func_ptr_->compute_cost(image1_[fine_level_num_],
-                                                       image2_[fine_level_num_],
-                                                       cv::Point(x,y),
-                                                       cv::Point(x2, y2),
-                                                       half_patch_size);
-
-         flows_cost_[fine_level_num_].at<float>(y,x) = c;
-      }
-      else
-      {
-         // use bilinear interpolation when half_patch_size is 0
-         // half patch size is 0,the cost is computed on the single pixel
-         // assume that x is greater than 0
-         /*
-            (x_left, y_top)            (x_right, y_top)
-               c1                              c2
-               x--------------------------------x
-               |            |                   |
-             dy|            |                   |
-               |------------x-------------------|
-               |    dx      |      1-dx         |
-           1-dy|            |                   |
-               |            |                   |
-               x--------------------------------x
-               c3                               c4
-       (x_left, y_bottom)              (x_right, y_bottom)
-          */
-
-         int x_left = (int)(x + u);
-         int x_right = x_left + 1;
-         float dx = x + u - x_left;
-
-         int y_top = (int)(y+v);
-         int y_bottom = y_top + 1;
-         float dy = y + v - y_top;
-         float c1 = 0, c2 = 0, c3 = 0, c4 = 0;
-
-         bool updated = false;
-         if (is_inside(x_left, nx) && is_inside(y_top, ny))
-         {
-            c1 = (float) cost_func_ptr_->compute_cost(image1_[fine_level_num_],
-                                                      image2_[fine_level_num_],
-                                                      cv::Point(x, y),
-                                                      cv::Point(x_left, y_top),
-                                                      half_patch_size_);
-            updated = true;
-         }
-
-         if (is_inside(x_right, nx) && is_inside(y_top, ny))
-         {
-            c2 = (float) cost_func_ptr_->compute_cost(image1_[fine_level_num_],
-                                                      image2_[fine_level_num_],
-                                                      cv::Point(x, y),
-                                                      cv::Point(x_right, y_top),
-                                                      half_patch_size_);
-            updated = true;
-         }
-
-         if (is_inside(x_left, nx) && is_inside(y_bottom, ny))
-         {
-            c3 = (float) cost_func_ptr_->compute_cost(image1_[fine_level_num_],
-                                                      image2_[fine_level_num_],
-                                                      cv::Point(x, y),
-                                                      cv::Point(x_left, y_bottom),
-                                                      half_patch_size_);
-            updated = true;
-         }
-
-         if (is_inside(x_right, nx) && is_inside(y_bottom, ny))
-         {
-            c4 = (float) cost_func_ptr_->compute_cost(image1_[fine_level_num_],
-                                                      image2_[fine_level_num_],
-                                                      cv::Point(x, y),
-                                                      cv::Point(x_right, y_bottom),
-                                                      half_patch_size_);
-            updated = true;
-         }
-
-         if (updated)
-         {
-            float c;
-            c = c1*(1-dx)*(1-dy) +
-                c2*   dx *(1-dy) +
-                c3*(1-dx)*   dy  +
-                c4*   dx *   dy;
-
-            flows_cost_[fine_level_num_].at<float>(y,x) = c;
-         }
-      }
-#endif
+      flows_cost_[fine_level_num_].at<float>(n) = c;
    }
 }
@@ -16,6 +16,7 @@
     along with this program. If not, see <http://www.gnu.org/licenses/>
     -----------------------------------------------------------------  */
 #include "CpmImplAffineModel.hpp"
+#include "CpmImplKernel.hpp"
 
 /*
 [
@@ -30,7 +31,7 @@
 
 CpmImplAffineModel::CpmImplAffineModel()
 {
-   set_num_properties(6);
+   set_num_properties(E_NUM_PROPERTIES);
 
    set_min_search_value(1e-3f);
 }
@@ -39,62 +40,27 @@ void
 CpmImplAffineModel::property_random_init(
       cv::Mat &property_,
       const cv::Mat &seeds_,
-      float max_property_value_
+      float max_property_value_,
+      int level_
 )
 {
-   CV_Assert(property_.type() == CV_32FC(6));
    CV_Assert(seeds_.type() == CV_32SC1);
    CV_Assert(seeds_.cols == 2);
 
-   property_ = 0;
-
    int num_seeds = seeds_.rows;
+   property_.create(num_seeds, get_num_properties(), CV_32FC1);
 
    for (int i = 0; i < num_seeds; i++)
    {
-      int y = seeds_.at<int>(i, 1);
-      int x = seeds_.at<int>(i, 0);
-      float* p_property = property_.ptr<float>(y,x);
-
-      p_property[0] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-      p_property[1] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-      p_property[2] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-      p_property[3] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-      p_property[4] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-      p_property[5] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-   }
-}
-
-void
-CpmImplAffineModel::property_to_uv(
-      const cv::Mat &property_,
-      const cv::Mat& seeds_,
-      cv::Mat &u_,
-      cv::Mat &v_
-)
-{
-   CV_Assert(property_.type() == CV_32FC(6));
-   u_ = cv::Mat::zeros(property_.size(), CV_32FC1);
-   v_ = cv::Mat::zeros(property_.size(), CV_32FC1);
-
-   int num_seeds = seeds_.rows;
-   for (int i = 0; i < num_seeds; i++)
-   {
-      int y = seeds_.at<int>(i, 1);
-      int x = seeds_.at<int>(i, 0);
-
-      const float* p_property = property_.ptr<float>(y,x);
-      float a1 = p_property[0];
-      float a2 = p_property[1];
-      float a3 = p_property[2];
-      float a4 = p_property[3];
-      float a5 = p_property[4];
-      float a6 = p_property[5];
-
-      float u = a1*x + a2*y + a5;
-      float v = a3*x + a4*y + a6;
-      u_.at<float>(y,x) = u;
-      v_.at<float>(y,x) = v;
+      float* p_property = property_.ptr<float>(i);
+      Philox rng = get_rng(i, level_, E_RNG_INIT_ITERATION);
+
+      p_property[0] = rng.uniform(-max_property_value_, max_property_value_);
+      p_property[1] = rng.uniform(-max_property_value_, max_property_value_);
+      p_property[2] = rng.uniform(-max_property_value_, max_property_value_);
+      p_property[3] = rng.uniform(-max_property_value_, max_property_value_);
+      p_property[4] = rng.uniform(-max_property_value_, max_property_value_);
+      p_property[5] = rng.uniform(-max_property_value_, max_property_value_);
    }
 }
 
@@ -118,22 +84,41 @@ CpmImplAffineModel::property_to_uv(
    v_ = a3*x_ + a4*y_ + a6;
 }
 
+void
+CpmImplAffineModel::property_from_uv(
+      float u_,
+      float v_,
+      int /*x_*/,
+      int /*y_*/,
+      float *p_property_
+)
+{
+   // a pure translation
+   p_property_[0] = 0; // a1
+   p_property_[1] = 0; // a2
+   p_property_[2] = 0; // a3
+   p_property_[3] = 0; // a4
+   p_property_[4] = u_; // a5
+   p_property_[5] = v_; // a6
+}
+
 void
 CpmImplAffineModel::random_search(
       const float *p_old_property_,
       float *p_try_property_,
-      float delta_
+      float delta_,
+      Philox &rng_
 )
 {
    (void)p_old_property_;
 
    float delta_a1, delta_a2, delta_a3, delta_a4, delta_a5, delta_a6;
-   delta_a1 = cv::theRNG().uniform(-delta_, delta_);
-   delta_a2 = cv::theRNG().uniform(-delta_, delta_);
-   delta_a3 = cv::theRNG().uniform(-delta_, delta_);
-   delta_a4 = cv::theRNG().uniform(-delta_, delta_);
-   delta_a5 = cv::theRNG().uniform(-delta_, delta_);
-   delta_a6 = cv::theRNG().uniform(-delta_, delta_);
+   delta_a1 = rng_.uniform(-delta_, delta_);
+   delta_a2 = rng_.uniform(-delta_, delta_);
+   delta_a3 = rng_.uniform(-delta_, delta_);
+   delta_a4 = rng_.uniform(-delta_, delta_);
+   delta_a5 = rng_.uniform(-delta_, delta_);
+   delta_a6 = rng_.uniform(-delta_, delta_);
 
    float try_a1, try_a2, try_a3, try_a4, try_a5, try_a6;
 #if 0
@@ -180,3 +165,6 @@ CpmImplAffineModel::init_from_coarser_level(
    p_fine_level_property_[4] = p_coarse_level_property_[4] * scale_; // a5
    p_fine_level_property_[5] = p_coarse_level_property_[5] * scale_; // a6
 }
+
+// specialized propagation kernels, see CpmImplKernel.hpp
+template class CpmImplKernel<CpmImplAffineModel>;
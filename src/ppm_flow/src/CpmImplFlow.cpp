@@ -16,6 +16,7 @@
     along with this program. If not, see <http://www.gnu.org/licenses/>
     -----------------------------------------------------------------  */
 #include "CpmImplFlow.hpp"
+#include "CpmImplKernel.hpp"
 
 /*
 column 0: u
@@ -23,7 +24,7 @@ column 1: v
  */
 CpmImplFlow::CpmImplFlow()
 {
-   set_num_properties(2);
+   set_num_properties(E_NUM_PROPERTIES);
 
    set_min_search_value(0.1f);
 }
@@ -32,44 +33,26 @@ void
 CpmImplFlow::property_random_init(
       cv::Mat &property_,
       const cv::Mat &seeds_,
-      float max_property_value_
+      float max_property_value_,
+      int level_
 )
 {
-   CV_Assert(property_.type() == CV_32FC2);
    CV_Assert(seeds_.type() == CV_32SC1);
    CV_Assert(seeds_.cols == 2);
 
-   property_ = 0;
-
    int num_seeds = seeds_.rows;
+   property_.create(num_seeds, get_num_properties(), CV_32FC1);
 
    for (int i = 0; i < num_seeds; i++)
    {
-      int y = seeds_.at<int>(i, 1);
-      int x = seeds_.at<int>(i, 0);
-      float* p_property = property_.ptr<float>(y,x);
+      float* p_property = property_.ptr<float>(i);
+      Philox rng = get_rng(i, level_, E_RNG_INIT_ITERATION);
 
-      p_property[0] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-      p_property[1] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
+      p_property[0] = rng.uniform(-max_property_value_, max_property_value_);
+      p_property[1] = rng.uniform(-max_property_value_, max_property_value_);
    }
 }
 
-void
-CpmImplFlow::property_to_uv(
-      const cv::Mat &property_,
-      const cv::Mat& /*seeds_*/,
-      cv::Mat &u_,
-      cv::Mat &v_
-)
-{
-   CV_Assert(property_.type() == CV_32FC2);
-
-   cv::Mat mv[2];
-   cv::split(property_, mv);
-   u_ = mv[0];
-   v_ = mv[1];
-}
-
 void
 CpmImplFlow::property_to_uv(
       const float *p_property_,
@@ -83,18 +66,32 @@ CpmImplFlow::property_to_uv(
    v_ = p_property_[1];
 }
 
+void
+CpmImplFlow::property_from_uv(
+      float u_,
+      float v_,
+      int /*x_*/,
+      int /*y_*/,
+      float *p_property_
+)
+{
+   p_property_[0] = u_;
+   p_property_[1] = v_;
+}
+
 void
 CpmImplFlow::random_search(
       const float *p_old_property_,
       float *p_try_property_,
-      float delta_
+      float delta_,
+      Philox &rng_
 )
 {
    (void)p_old_property_;
 
-   float delta_u = cv::theRNG().uniform(-delta_, delta_);
+   float delta_u = rng_.uniform(-delta_, delta_);
    float delta_v;
-   delta_v = cv::theRNG().uniform(-delta_, delta_);
+   delta_v = rng_.uniform(-delta_, delta_);
 #if 0
    p_try_property_[0] =  delta_u;
    p_try_property_[1] =  delta_v;
@@ -114,3 +111,6 @@ CpmImplFlow::init_from_coarser_level(
    p_fine_level_property_[0] = p_coarse_level_property_[0]*scale_;
    p_fine_level_property_[1] = p_coarse_level_property_[1]*scale_;
 }
+
+// specialized propagation kernels, see CpmImplKernel.hpp
+template class CpmImplKernel<CpmImplFlow>;
@@ -16,6 +16,7 @@
     along with this program. If not, see <http://www.gnu.org/licenses/>
     -----------------------------------------------------------------  */
 #include "CpmImplProjectivePlanar.hpp"
+#include "CpmImplKernel.hpp"
 /*
 It needs a higher number of pyramid levels, say 10 with ratio 0.8, grid step 2
  */
@@ -24,7 +25,7 @@ static const float g_min_float = 1e-5f; // avoid dividing by zero
 
 CpmImplProjectivePlanar::CpmImplProjectivePlanar()
 {
-   set_num_properties(9);
+   set_num_properties(E_NUM_PROPERTIES);
 
    set_min_search_value(1e-6f);
 }
@@ -33,97 +34,30 @@ void
 CpmImplProjectivePlanar::property_random_init(
       cv::Mat &property_,
       const cv::Mat &seeds_,
-      float max_property_value_
+      float max_property_value_,
+      int level_
 )
 {
-   CV_Assert(property_.type() == CV_32FC(9));
    CV_Assert(seeds_.type() == CV_32SC1);
    CV_Assert(seeds_.cols == 2);
 
-   property_ = 0;
-
    int num_seeds = seeds_.rows;
+   property_.create(num_seeds, get_num_properties(), CV_32FC1);
 
    for (int i = 0; i < num_seeds; i++)
    {
-      int y = seeds_.at<int>(i, 1);
-      int x = seeds_.at<int>(i, 0);
-      float* p_property = property_.ptr<float>(y,x);
-
-      p_property[0] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-      p_property[1] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-      p_property[2] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-      p_property[3] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-      p_property[4] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-      p_property[5] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-      p_property[6] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-      p_property[7] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-      p_property[8] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-   }
-}
-
-void
-CpmImplProjectivePlanar::property_to_uv(
-      const cv::Mat &property_,
-      const cv::Mat& seeds_,
-      cv::Mat &u_,
-      cv::Mat &v_
-)
-{
-   CV_Assert(property_.type() == CV_32FC(9));
-   u_ = cv::Mat::zeros(property_.size(), CV_32FC1);
-   v_ = cv::Mat::zeros(property_.size(), CV_32FC1);
-
-   int num_seeds = seeds_.rows;
-   for (int k = 0; k < num_seeds; k++)
-   {
-      int y = seeds_.at<int>(k, 1);
-      int x = seeds_.at<int>(k, 0);
-/*
-[
- x1       h1  h2  h3      x
- y1  =    h4  h5  h6   *  y
- z1       h7  h8  h9      1
-]
-
-         x1     h1*x + h2*y + h3
- x'  = ----- = -----------------
-         z1     h7*x + h8*y + h9
-
-         y1     h4*x + h5*y + h6
- y'  = ----- = -----------------
-         z1     h7*x + h8*y + h9
-
-  u = x' - x
-  v = y' - y
-
- */
-      const float* p_property = property_.ptr<float>(y,x);
-      float h1 = p_property[0];
-      float h2 = p_property[1];
-      float h3 = p_property[2];
-      float h4 = p_property[3];
-      float h5 = p_property[4];
-      float h6 = p_property[5];
-      float h7 = p_property[6];
-      float h8 = p_property[7];
-      float h9 = p_property[8];
-
-      float x1 = h1*x + h2*y + h3;
-      float y1 = h4*x + h5*y + h6;
-      float z1 = h7*x + h8*y + h9;
-
-      if (cv::abs(z1) < g_min_float)
-      {
-         if (z1 < 0) z1 = -g_min_float;
-         else z1 = +g_min_float;
-      }
-
-      float u = x1/z1 - x;
-      float v = y1/z1 - y;
-
-      u_.at<float>(y,x) = u;
-      v_.at<float>(y,x) = v;
+      float* p_property = property_.ptr<float>(i);
+      Philox rng = get_rng(i, level_, E_RNG_INIT_ITERATION);
+
+      p_property[0] = rng.uniform(-max_property_value_, max_property_value_);
+      p_property[1] = rng.uniform(-max_property_value_, max_property_value_);
+      p_property[2] = rng.uniform(-max_property_value_, max_property_value_);
+      p_property[3] = rng.uniform(-max_property_value_, max_property_value_);
+      p_property[4] = rng.uniform(-max_property_value_, max_property_value_);
+      p_property[5] = rng.uniform(-max_property_value_, max_property_value_);
+      p_property[6] = rng.uniform(-max_property_value_, max_property_value_);
+      p_property[7] = rng.uniform(-max_property_value_, max_property_value_);
+      p_property[8] = rng.uniform(-max_property_value_, max_property_value_);
    }
 }
 
@@ -146,6 +80,25 @@ CpmImplProjectivePlanar::property_to_uv(
    float h8 = p_property_[7];
    float h9 = p_property_[8];
 
+   /*
+   [
+    x1       h1  h2  h3      x
+    y1  =    h4  h5  h6   *  y
+    z1       h7  h8  h9      1
+   ]
+
+            x1     h1*x + h2*y + h3
+    x'  = ----- = -----------------
+            z1     h7*x + h8*y + h9
+
+            y1     h4*x + h5*y + h6
+    y'  = ----- = -----------------
+            z1     h7*x + h8*y + h9
+
+     u = x' - x
+     v = y' - y
+
+    */
    float x1 = h1*x_ + h2*y_ + h3;
    float y1 = h4*x_ + h5*y_ + h6;
    float z1 = h7*x_ + h8*y_ + h9;
@@ -160,25 +113,47 @@ CpmImplProjectivePlanar::property_to_uv(
    v_ = y1/z1 - y_;
 }
 
+void
+CpmImplProjectivePlanar::property_from_uv(
+      float u_,
+      float v_,
+      int /*x_*/,
+      int /*y_*/,
+      float *p_property_
+)
+{
+   // a pure translation, i.e., x' = x + u, y' = y + v
+   p_property_[0] = 1;  // h1
+   p_property_[1] = 0;  // h2
+   p_property_[2] = u_; // h3
+   p_property_[3] = 0;  // h4
+   p_property_[4] = 1;  // h5
+   p_property_[5] = v_; // h6
+   p_property_[6] = 0;  // h7
+   p_property_[7] = 0;  // h8
+   p_property_[8] = 1;  // h9
+}
+
 void
 CpmImplProjectivePlanar::random_search(
       const float *p_old_property_,
       float *p_try_property_,
-      float delta_
+      float delta_,
+      Philox &rng_
 )
 {
    (void)p_old_property_;
    float delta_h1, delta_h2, delta_h3, delta_h4, delta_h5, delta_h6, delta_h7, delta_h8, delta_h9;
 
-   delta_h1 = cv::theRNG().uniform(-delta_, delta_);
-   delta_h2 = cv::theRNG().uniform(-delta_, delta_);
-   delta_h3 = cv::theRNG().uniform(-delta_, delta_);
-   delta_h4 = cv::theRNG().uniform(-delta_, delta_);
-   delta_h5 = cv::theRNG().uniform(-delta_, delta_);
-   delta_h6 = cv::theRNG().uniform(-delta_, delta_);
-   delta_h7 = cv::theRNG().uniform(-delta_, delta_);
-   delta_h8 = cv::theRNG().uniform(-delta_, delta_);
-   delta_h9 = cv::theRNG().uniform(-delta_, delta_);
+   delta_h1 = rng_.uniform(-delta_, delta_);
+   delta_h2 = rng_.uniform(-delta_, delta_);
+   delta_h3 = rng_.uniform(-delta_, delta_);
+   delta_h4 = rng_.uniform(-delta_, delta_);
+   delta_h5 = rng_.uniform(-delta_, delta_);
+   delta_h6 = rng_.uniform(-delta_, delta_);
+   delta_h7 = rng_.uniform(-delta_, delta_);
+   delta_h8 = rng_.uniform(-delta_, delta_);
+   delta_h9 = rng_.uniform(-delta_, delta_);
 
    float try_h1, try_h2, try_h3, try_h4, try_h5, try_h6, try_h7, try_h8, try_h9;
 
@@ -241,3 +216,6 @@ CpmImplProjectivePlanar::init_from_coarser_level(
    p_fine_level_property_[7] = p_coarse_level_property_[7]/scale_; // h8
    p_fine_level_property_[8] = p_coarse_level_property_[8]; // h9
 }
+
+// specialized propagation kernels, see CpmImplKernel.hpp
+template class CpmImplKernel<CpmImplProjectivePlanar>;
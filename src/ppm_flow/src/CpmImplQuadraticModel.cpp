@@ -16,6 +16,7 @@
     along with this program. If not, see <http://www.gnu.org/licenses/>
     -----------------------------------------------------------------  */
 #include "CpmImplQuadraticModel.hpp"
+#include "CpmImplKernel.hpp"
 
 /*
 Refereneces:
@@ -42,7 +43,7 @@ which can be downloaded from
 
 CpmImplQuadraticModel::CpmImplQuadraticModel()
 {
-   set_num_properties(8);
+   set_num_properties(E_NUM_PROPERTIES);
 
    set_min_search_value(1e-5f);
 }
@@ -51,70 +52,29 @@ void
 CpmImplQuadraticModel::property_random_init(
       cv::Mat &property_,
       const cv::Mat &seeds_,
-      float max_property_value_)
+      float max_property_value_,
+      int level_
+)
 {
-   CV_Assert(property_.type() == CV_32FC(8));
    CV_Assert(seeds_.type() == CV_32SC1);
    CV_Assert(seeds_.cols == 2);
 
-   property_ = 0;
-
    int num_seeds = seeds_.rows;
+   property_.create(num_seeds, get_num_properties(), CV_32FC1);
 
    for (int i = 0; i < num_seeds; i++)
    {
-      int y = seeds_.at<int>(i, 1);
-      int x = seeds_.at<int>(i, 0);
-      float* p_property = property_.ptr<float>(y,x);
-
-      p_property[0] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-      p_property[1] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-      p_property[2] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-      p_property[3] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-      p_property[4] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-      p_property[5] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-      p_property[6] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-      p_property[7] = cv::theRNG().uniform(-max_property_value_, max_property_value_);
-   }
-}
-
-void
-CpmImplQuadraticModel::property_to_uv(
-      const cv::Mat &property_,
-      const cv::Mat& seeds_,
-      cv::Mat &u_,
-      cv::Mat &v_
-)
-{
-   CV_Assert(property_.type() == CV_32FC(8));
-   u_ = cv::Mat::zeros(property_.size(), CV_32FC1);
-   v_ = cv::Mat::zeros(property_.size(), CV_32FC1);
-
-   int num_seeds = seeds_.rows;
-   for (int i = 0; i < num_seeds; i++)
-   {
-      int y = seeds_.at<int>(i, 1);
-      int x = seeds_.at<int>(i, 0);
-
-      const float* p_property = property_.ptr<float>(y,x);
-      float a1 = p_property[0];
-      float a2 = p_property[1];
-      float a3 = p_property[2];
-      float a4 = p_property[3];
-      float a5 = p_property[4];
-      float a6 = p_property[5];
-      float a7 = p_property[6];
-      float a8 = p_property[7];
-
-      float xx = x*x;
-      float xy = x*y;
-      float yy = y*y;
-
-      float u = a1 + a2*x + a3*y + a7*xx + a8*xy;
-      float v = a4 + a5*x + a6*y + a7*xy + a8*yy;
-
-      u_.at<float>(y,x) = u;
-      v_.at<float>(y,x) = v;
+      float* p_property = property_.ptr<float>(i);
+      Philox rng = get_rng(i, level_, E_RNG_INIT_ITERATION);
+
+      p_property[0] = rng.uniform(-max_property_value_, max_property_value_);
+      p_property[1] = rng.uniform(-max_property_value_, max_property_value_);
+      p_property[2] = rng.uniform(-max_property_value_, max_property_value_);
+      p_property[3] = rng.uniform(-max_property_value_, max_property_value_);
+      p_property[4] = rng.uniform(-max_property_value_, max_property_value_);
+      p_property[5] = rng.uniform(-max_property_value_, max_property_value_);
+      p_property[6] = rng.uniform(-max_property_value_, max_property_value_);
+      p_property[7] = rng.uniform(-max_property_value_, max_property_value_);
    }
 }
 
@@ -144,25 +104,46 @@ CpmImplQuadraticModel::property_to_uv(
    v_ = a4 + a5*x_ + a6*y_ + a7*xy + a8*yy;
 }
 
+void
+CpmImplQuadraticModel::property_from_uv(
+      float u_,
+      float v_,
+      int /*x_*/,
+      int /*y_*/,
+      float *p_property_
+)
+{
+   // a pure translation
+   p_property_[0] = u_; // a1
+   p_property_[1] = 0;  // a2
+   p_property_[2] = 0;  // a3
+   p_property_[3] = v_; // a4
+   p_property_[4] = 0;  // a5
+   p_property_[5] = 0;  // a6
+   p_property_[6] = 0;  // a7
+   p_property_[7] = 0;  // a8
+}
+
 void
 CpmImplQuadraticModel::random_search(
       const float *p_old_property_,
       float *p_try_property_,
-      float delta_
+      float delta_,
+      Philox &rng_
 )
 {
    (void)p_old_property_;
    float delta_a1, delta_a2, delta_a3, delta_a4;
    float delta_a5, delta_a6, delta_a7, delta_a8;
 
-   delta_a1 = cv::theRNG().uniform(-delta_, delta_);
-   delta_a2 = cv::theRNG().uniform(-delta_, delta_);
-   delta_a3 = cv::theRNG().uniform(-delta_, delta_);
-   delta_a4 = cv::theRNG().uniform(-delta_, delta_);
-   delta_a5 = cv::theRNG().uniform(-delta_, delta_);
-   delta_a6 = cv::theRNG().uniform(-delta_, delta_);
-   delta_a7 = cv::theRNG().uniform(-delta_, delta_);
-   delta_a8 = cv::theRNG().uniform(-delta_, delta_);
+   delta_a1 = rng_.uniform(-delta_, delta_);
+   delta_a2 = rng_.uniform(-delta_, delta_);
+   delta_a3 = rng_.uniform(-delta_, delta_);
+   delta_a4 = rng_.uniform(-delta_, delta_);
+   delta_a5 = rng_.uniform(-delta_, delta_);
+   delta_a6 = rng_.uniform(-delta_, delta_);
+   delta_a7 = rng_.uniform(-delta_, delta_);
+   delta_a8 = rng_.uniform(-delta_, delta_);
 
    float try_a1, try_a2, try_a3, try_a4;
    float try_a5, try_a6, try_a7, try_a8;
@@ -221,3 +202,6 @@ CpmImplQuadraticModel::init_from_coarser_level(
    p_fine_level_property_[6] = p_coarse_level_property_[6]/scale_;   // a7
    p_fine_level_property_[7] = p_coarse_level_property_[7]/scale_;   // a8
 }
+
+// specialized propagation kernels, see CpmImplKernel.hpp
+template class CpmImplKernel<CpmImplQuadraticModel>;
@@ -31,6 +31,40 @@ is_inside(int x, int w)
    return (x >= 0) && (x < w);
 }
 
+/**
+ * Compute the bilinearly interpolated matching cost of a non-integer position in g_.
+ *
+ * @param x2_  [in]  x coordinate in g_
+ * @param y2_  [in]  y coordinate in g_
+ * @param cost_kernel_      [in] Kernel for computing matching cost, see MatchCost::get_kernel()
+ * @param bilinear_kernel_  [in] Fused kernel, see MatchCost::get_bilinear_kernel(). May be nullptr.
+ * @param cost_  [out] The interpolated cost
+ *
+ * @return false if (x2_, y2_) is outside of g_, in which case cost_ is not written.
+ */
+bool
+compute_subpixel_cost(const cv::Mat& f_,
+                      const cv::Mat& g_,
+                      int x_,
+                      int y_,
+                      float x2_,
+                      float y2_,
+                      MatchCost::Kernel cost_kernel_,
+                      MatchCost::BilinearKernel bilinear_kernel_,
+                      int half_patch_size_,
+                      float& cost_
+)
+{
+   if (!(x2_ >= 0) || (x2_ > (float)(g_.cols - 1)) || !(y2_ >= 0) || (y2_ > (float)(g_.rows - 1)))
+   {
+      return false;
+   }
+
+   cost_ = (float)MatchCost::compute_patch_cost_bilinear(cost_kernel_, bilinear_kernel_, f_, g_,
+                                                         x_, y_, x2_, y2_, half_patch_size_);
+   return true;
+}
+
 /**
  * Compute the cost of the new flow field and
  * update the old flow field if necessary.
@@ -44,8 +78,11 @@ is_inside(int x, int w)
  * @param cost_old_     [in]     The old match cost for the flow field (u_old_,v_old_) at position (x_,y_)
  * @param u_new_        [in]     The new flow field in x-direction
  * @param v_new_        [in]     The new flow field in y-direction
- * @param cost_func_ptr_    [in] Pointer to the function for computing matching cost
+ * @param cost_kernel_      [in] Kernel for computing matching cost, see MatchCost::get_kernel()
  * @param half_patch_size_  [in] Half patch size. 0 means to use only a single point
+ * @param subpixel_         [in] true to interpolate the cost at the non-integer position bilinearly,
+ *                               false to use the cost at the rounded position
+ * @param bilinear_kernel_  [in] Fused kernel for the subpixel cost, see MatchCost::get_bilinear_kernel()
  *
  * @return true if the cost is improved. false if the cost is not changed.
  */
@@ -59,8 +96,10 @@ improve_cost(const cv::Mat& f_,
              float& cost_old_,
              float u_new_,
              float v_new_,
-             cv::Ptr<MatchCost> cost_func_ptr_,
-             int half_patch_size_
+             MatchCost::Kernel cost_kernel_,
+             int half_patch_size_,
+             bool subpixel_,
+             MatchCost::BilinearKernel bilinear_kernel_
 )
 {
    bool res = false;
@@ -68,22 +107,15 @@ improve_cost(const cv::Mat& f_,
    int ny = f_.rows;
 
    float cost_new = cost_old_ + 1;
-#if 1
-   int other_x = cvRound(x_ + u_new_);
-   int other_y = cvRound(y_ + v_new_);
-
-   if (!is_inside(other_x, nx) || !is_inside(other_y, ny))
+   if (subpixel_)
    {
-      return res;
+      if (!compute_subpixel_cost(f_, g_, x_, y_, x_ + u_new_, y_ + v_new_,
+                                 cost_kernel_, bilinear_kernel_, half_patch_size_, cost_new))
+      {
+         return res;
+      }
    }
-
-   cost_new = (float)cost_func_ptr_->compute_cost(f_,
-                                                  g_,
-                                                  cv::Point(x_, y_),
-                                                  cv::Point(other_x, other_y),
-                                                  half_patch_size_);
-#else
-   if (half_patch_size_)
+   else
    {
       int other_x = cvRound(x_ + u_new_);
       int other_y = cvRound(y_ + v_new_);
@@ -93,95 +125,10 @@ improve_cost(const cv::Mat& f_,
          return res;
       }
 
-      cost_new = (float)cost_func_ptr_->compute_cost(f_,
-                                                     g_,
-                                                     cv::Point(x_, y_),
-                                                     cv::Point(other_x, other_y),
-                                                     half_patch_size_);
+      // the kernel may stop early once the candidate cannot beat the old cost
+      cost_new = (float)MatchCost::compute_patch_cost(cost_kernel_, f_, g_,
+                                                      x_, y_, other_x, other_y, half_patch_size_, cost_old_);
    }
-   else
-   {
-      // use bilinear interpolation when half_patch_size is 0
-      // half patch size is 0,the cost is computed on the single pixel
-      // assume that x is greater than 0
-      /*
-         (x_left, y_top)            (x_right, y_top)
-            c1                              c2
-            x--------------------------------x
-            |            |                   |
-          dy|            |                   |
-            |------------x-------------------|
-            |    dx      |      1-dx         |
-        1-dy|            |                   |
-            |            |                   |
-            x--------------------------------x
-            c3                               c4
-    (x_left, y_bottom)              (x_right, y_bottom)
-       */
-
-      int x_left = (int)(x_ + u_new_);
-      int x_right = x_left + 1;
-      float dx = x_ + u_new_ - x_left;
-
-      int y_top = (int)(y_+v_new_);
-      int y_bottom = y_top + 1;
-      float dy = y_ + v_new_ - y_top;
-      float c1 = 0, c2 = 0, c3 = 0, c4 = 0;
-
-
-      if (!is_inside(x_left, nx) || !is_inside(x_right, nx) || !is_inside(y_top, ny) || !is_inside(y_bottom, ny)) return false;
-
-      c1 = (float) cost_func_ptr_->compute_cost(f_,
-                                                g_,
-                                                cv::Point(x_, y_),
-                                                cv::Point(x_left, y_top),
-                                                half_patch_size_);
-
-      c2 = (float) cost_func_ptr_->compute_cost(f_,
-                                                g_,
-                                                cv::Point(x_, y_),
-                                                cv::Point(x_right, y_top),
-                                                half_patch_size_);
-
-      c3 = (float) cost_func_ptr_->compute_cost(f_,
-                                                g_,
-                                                cv::Point(x_, y_),
-                                                cv::Point(x_left, y_bottom),
-                                                half_patch_size_);
-
-      c4 = (float) cost_func_ptr_->compute_cost(f_,
-                                                g_,
-                                                cv::Point(x_, y_),
-                                                cv::Point(x_right, y_bottom),
-                                                half_patch_size_);
-
-      cost_new = c1*(1-dx)*(1-dy) +
-                 c2*   dx *(1-dy) +
-                 c3*(1-dx)*   dy  +
-                 c4*   dx *   dy;
-#if 0
-         printf("updated: \n"
-                " c1: %.3f\n"
-                " c2: %.3f\n"
-                " c3: %.3f\n"
-                " c4: %.3f\n"
-                " x_left: %d\n"
-                " x_: %d\n"
-                " u_new_: %.2f\n"
-                " y_top: %d\n"
-                " y_: %d\n"
-                " v_new: %.2f\n"
-                " dx: %.3f\n"
-                " dy: %.3f\n",
-                c1,c2,c3,c4,
-                x_left, x_, u_new_,
-                y_top, y_, v_new_,
-                dx,dy
-         );
-#endif
-
-   }
-#endif
 
    if (cost_new < cost_old_)
    {
@@ -193,6 +140,20 @@ improve_cost(const cv::Mat& f_,
    return res;
 }
 
+/**
+ * Compute the matching cost of every seed.
+ *
+ * @param u_            [in]  Flow of every seed in the x-direction, CV_32FC1, num_seeds x 1
+ * @param v_            [in]  Flow of every seed in the y-direction, CV_32FC1, num_seeds x 1
+ * @param image1_       [in]  Frame 1
+ * @param image2_       [in]  Frame 2
+ * @param cost_         [out] Matching cost of every seed, CV_32FC1, num_seeds x 1.
+ *                            Seeds whose flow points outside of image2_ have a cost of 1e10
+ * @param cost_func_ptr_    [in] Pointer to the function for computing matching cost
+ * @param seeds_            [in] Seed coordinates, CV_32SC1, 2 columns
+ * @param half_patch_size_  [in] Half patch size. 0 means to use only a single point
+ * @param subpixel_         [in] true for bilinearly interpolated costs, see improve_cost()
+ */
 void
 compute_cost(
       const cv::Mat& u_,
@@ -202,131 +163,76 @@ compute_cost(
       cv::Mat& cost_,
       const cv::Ptr<MatchCost> cost_func_ptr_,
       const cv::Mat& seeds_,
-      int half_patch_size_
+      int half_patch_size_,
+      bool subpixel_
 )
 {
-   cost_.create(u_.size(), CV_32FC1);
+   int num_seeds = seeds_.rows;
+   CV_Assert(u_.rows == num_seeds);
+   CV_Assert(v_.rows == num_seeds);
+
+   cost_.create(num_seeds, 1, CV_32FC1);
    cost_ = 1e10; // initialized to a very large cost
    int ny = image1_.rows;
    int nx = image1_.cols;
 
-   int num_seeds = seeds_.rows;
+   MatchCost::Kernel cost_kernel = cost_func_ptr_->get_kernel(image1_.type());
+   MatchCost::BilinearKernel bilinear_kernel = subpixel_ ? cost_func_ptr_->get_bilinear_kernel(image1_.type()) : nullptr;
 
    for (int i = 0; i < num_seeds; i++)
    {
       int y = seeds_.at<int>(i, 1);
       int x = seeds_.at<int>(i, 0);
 
-      float u = u_.at<float>(y, x);
-      float v = v_.at<float>(y, x);
-#if 1
-      int x2 = cvRound(x + u);
-      int y2 = cvRound(y + v);
-
-      if (!is_inside(x2, nx) || !is_inside(y2, ny)) continue; // invalid flows are already penalized with cost 1e10
-
-      float c = (float) cost_func_ptr_->compute_cost(image1_,
-                                                     image2_,
-                                                     cv::Point(x, y),
-                                                     cv::Point(x2, y2),
-                                                     half_patch_size_);
-      cost_.at<float>(y, x) = c;
-#else
-      if (half_patch_size_)
+      float u = u_.at<float>(i);
+      float v = v_.at<float>(i);
+      if (subpixel_)
       {
-         int x2 = cvRound(x + u);
-         int y2 = cvRound(y + v);
-
-         if (!is_inside(x2, nx) || !is_inside(y2, ny)) continue; // invalid flows are already penalized with cost 1e10
-
-         float c = (float) cost_func_ptr_->compute_cost(image1_,
-                                                        image2_,
-                                                        cv::Point(x, y),
-                                                        cv::Point(x2, y2),
-                                                        half_patch_size_);
-         cost_.at<float>(y, x) = c;
+         compute_subpixel_cost(image1_, image2_, x, y, x + u, y + v,
+                               cost_kernel, bilinear_kernel, half_patch_size_, cost_.at<float>(i));
+         continue;
       }
-      else
-      {
-         // use bilinear interpolation when half_patch_size is 0
-         // half patch size is 0,the cost is computed on the single pixel
-         // assume that x is greater than 0
-         /*
-            (x_left, y_top)            (x_right, y_top)
-               c1                              c2
-               x--------------------------------x
-               |            |                   |
-             dy|            |                   |
-               |------------x-------------------|
-               |    dx      |      1-dx         |
-           1-dy|            |                   |
-               |            |                   |
-               x--------------------------------x
-               c3                               c4
-       (x_left, y_bottom)              (x_right, y_bottom)
-          */
-
-         int x_left = (int)(x + u);
-         int x_right = x_left + 1;
-         float dx = x + u - x_left;
 
-         int y_top = (int)(y+v);
-         int y_bottom = y_top + 1;
-         float dy = y + v - y_top;
-         float c1 = 0, c2 = 0, c3 = 0, c4 = 0;
-
-         bool updated = false;
-         if (is_inside(x_left, nx) && is_inside(y_top, ny))
-         {
-            c1 = (float) cost_func_ptr_->compute_cost(image1_,
-                                                      image2_,
-                                                      cv::Point(x, y),
-                                                      cv::Point(x_left, y_top),
-                                                      half_patch_size_);
-            updated = true;
-         }
+      int x2 = cvRound(x + u);
+      int y2 = cvRound(y + v);
 
-         if (is_inside(x_right, nx) && is_inside(y_top, ny))
-         {
-            c2 = (float) cost_func_ptr_->compute_cost(image1_,
-                                                      image2_,
-                                                      cv::Point(x, y),
-                                                      cv::Point(x_right, y_top),
-                                                      half_patch_size_);
-            updated = true;
-         }
+      if (!is_inside(x2, nx) || !is_inside(y2, ny)) continue; // invalid flows are already penalized with cost 1e10
 
-         if (is_inside(x_left, nx) && is_inside(y_bottom, ny))
-         {
-            c3 = (float) cost_func_ptr_->compute_cost(image1_,
-                                                      image2_,
-                                                      cv::Point(x, y),
-                                                      cv::Point(x_left, y_bottom),
-                                                      half_patch_size_);
-            updated = true;
-         }
+      float c = (float) MatchCost::compute_patch_cost(cost_kernel, image1_, image2_,
+                                                      x, y, x2, y2, half_patch_size_);
+      cost_.at<float>(i) = c;
+   }
+}
 
-         if (is_inside(x_right, nx) && is_inside(y_bottom, ny))
-         {
-            c4 = (float) cost_func_ptr_->compute_cost(image1_,
-                                                      image2_,
-                                                      cv::Point(x, y),
-                                                      cv::Point(x_right, y_bottom),
-                                                      half_patch_size_);
-            updated = true;
-         }
+/**
+ * Scatter seed-indexed values into an image-sized map.
+ *
+ * @param values_        [in]  Value of every seed, CV_32FC1, num_seeds x 1
+ * @param seeds_         [in]  Seed coordinates, CV_32SC1, 2 columns
+ * @param size_          [in]  Size of the map
+ * @param map_           [out] CV_32FC1. Pixels that are not seeds are set to default_value_
+ * @param default_value_ [in]  Value for pixels that are not seeds
+ */
+void
+seeds_to_dense_map(
+      const cv::Mat& values_,
+      const cv::Mat& seeds_,
+      const cv::Size& size_,
+      cv::Mat& map_,
+      float default_value_
+)
+{
+   int num_seeds = seeds_.rows;
+   CV_Assert(values_.type() == CV_32FC1);
+   CV_Assert(values_.rows == num_seeds);
 
-         if (updated)
-         {
-            float c;
-            c = c1*(1-dx)*(1-dy) +
-                c2*   dx *(1-dy) +
-                c3*(1-dx)*   dy  +
-                c4*   dx *   dy;
+   map_.create(size_, CV_32FC1);
+   map_ = default_value_;
 
-            cost_.at<float>(y, x) = c;
-         }
-      }
-#endif
+   for (int i = 0; i < num_seeds; i++)
+   {
+      int y = seeds_.at<int>(i, 1);
+      int x = seeds_.at<int>(i, 0);
+      map_.at<float>(y, x) = values_.at<float>(i);
    }
 }
@@ -20,6 +20,7 @@
 
 #include <opencv2/core.hpp>
 #include "PatchMatchStereoSlantedConfig.hpp"
+#include "Philox.hpp"
 
 class PatchMatchStereoImpl
 {
@@ -32,7 +33,8 @@ public:
          float* p_property_,
          float value_range_,
          int x_,
-         int y_
+         int y_,
+         Philox& rng_
    ) = 0;
 
    virtual float compute_disparity(
@@ -58,7 +60,8 @@ public:
          int x_,
          int y_,
          int num_iter_,
-         bool is_left_view_
+         bool is_left_view_,
+         Philox& rng_
    ) = 0;
 
    virtual void copy_properties(
@@ -29,7 +29,8 @@ public:
          float* p_property_,
          float value_range_,
          int x_,
-         int y_
+         int y_,
+         Philox& rng_
    ) override;
 
    virtual float compute_disparity(
@@ -55,7 +56,8 @@ public:
          int x_,
          int y_,
          int num_iter_,
-         bool is_left_view_
+         bool is_left_view_,
+         Philox& rng_
    ) override;
 
    virtual void copy_properties(
@@ -18,6 +18,7 @@
 #ifndef _PATCHMATCHSTEREOSLANTED_HPP_
 #define _PATCHMATCHSTEREOSLANTED_HPP_
 
+#include <cfloat>
 #include <opencv2/core.hpp>
 
 #include "PatchMatchStereoSlantedConfig.hpp"
@@ -77,14 +78,33 @@ public:
 
 private:
    void random_initialization();
-   void propagation(PropagationType type_);
+   void propagation(PropagationType type_, int iteration_);
 
 private:
 
+   /**
+    * Compute the weighted matching cost of a patch for the given property.
+    *
+    * @param bound_ Stop summing up the rows of the patch once the cost
+    *               is not less than bound_; the result is then a lower bound
+    *               of the cost. FLT_MAX computes the complete cost.
+    *               With KFJ_USE_OPENMP, the rows are summed up in parallel
+    *               and the complete cost is always computed.
+    */
    float compute_property_cost(
          const float* p_property_,
          int x_,
          int y_,
+         ViewIndex v_,
+         float bound_ = FLT_MAX
+   );
+
+   //! Cost of the row y_ of the patch centered at (x_, *) with center color p_
+   float compute_property_row_cost(
+         const float* p_property_,
+         const cv::Vec3f& p_,
+         int x_,
+         int y_,
          ViewIndex v_
    );
 
@@ -87,6 +87,9 @@ public:
    void set_verbose(bool val_) {m_verbose = val_;}
    bool get_verbose() const {return m_verbose;}
 
+   void set_random_seed(int val_) {m_random_seed = val_;}
+   int get_random_seed() const {return m_random_seed;}
+
 private:
    int m_iterations;      //!< number of iterations
    int m_half_patch_size; //!< half patch size, the whole patch size is (2*m_half_patch_size+1)x(2*half_patch_size+1)
@@ -119,6 +122,9 @@ private:
    cv::String m_output_directory;
 
    bool m_verbose;
+
+   int m_random_seed;   //!< Key of the random numbers. Every pixel, view and iteration draws from its own
+                        //!< stream, so the result depends only on it and not on the scan order.
 };
 
 #endif //_PATCHMATCHSTEREOSLANTEDCONFIG_HPP_
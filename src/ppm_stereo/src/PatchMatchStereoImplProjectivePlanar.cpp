@@ -37,15 +37,16 @@ PatchMatchStereoImplProjectivePlanar::property_random_init(
       float *p_property_,
       float value_range_,
       int /*x_*/,
-      int /*y_*/)
+      int /*y_*/,
+      Philox &rng_)
 {
-   p_property_[0] = cv::theRNG().uniform(-value_range_, value_range_); // h1
-   p_property_[1] = cv::theRNG().uniform(-value_range_, value_range_); // h2
-   p_property_[2] = cv::theRNG().uniform(-value_range_, value_range_); // h3
+   p_property_[0] = rng_.uniform(-value_range_, value_range_); // h1
+   p_property_[1] = rng_.uniform(-value_range_, value_range_); // h2
+   p_property_[2] = rng_.uniform(-value_range_, value_range_); // h3
 
-   p_property_[3] = cv::theRNG().uniform(-value_range_, value_range_); // h4
-   p_property_[4] = cv::theRNG().uniform(-value_range_, value_range_); // h5
-   p_property_[5] = cv::theRNG().uniform(-value_range_, value_range_); // h6
+   p_property_[3] = rng_.uniform(-value_range_, value_range_); // h4
+   p_property_[4] = rng_.uniform(-value_range_, value_range_); // h5
+   p_property_[5] = rng_.uniform(-value_range_, value_range_); // h6
 }
 
 float
@@ -117,25 +118,26 @@ PatchMatchStereoImplProjectivePlanar::random_search(
       int /*x_*/,
       int /*y_*/,
       int /*num_iter_*/,
-      bool /*is_left_view_*/
+      bool /*is_left_view_*/,
+      Philox &rng_
 )
 {
 #if 1
-   p_try_property_[0] = p_old_property_[0] + cv::theRNG().uniform(-delta_, delta_);
-   p_try_property_[1] = p_old_property_[1] + cv::theRNG().uniform(-delta_, delta_);
-   p_try_property_[2] = p_old_property_[2] + cv::theRNG().uniform(-delta_, delta_);
+   p_try_property_[0] = p_old_property_[0] + rng_.uniform(-delta_, delta_);
+   p_try_property_[1] = p_old_property_[1] + rng_.uniform(-delta_, delta_);
+   p_try_property_[2] = p_old_property_[2] + rng_.uniform(-delta_, delta_);
 
-   p_try_property_[3] = p_old_property_[3] + cv::theRNG().uniform(-delta_, delta_);
-   p_try_property_[4] = p_old_property_[4] + cv::theRNG().uniform(-delta_, delta_);
-   p_try_property_[5] = p_old_property_[5] + cv::theRNG().uniform(-delta_, delta_);
+   p_try_property_[3] = p_old_property_[3] + rng_.uniform(-delta_, delta_);
+   p_try_property_[4] = p_old_property_[4] + rng_.uniform(-delta_, delta_);
+   p_try_property_[5] = p_old_property_[5] + rng_.uniform(-delta_, delta_);
 #else
-   p_try_property_[0] = cv::theRNG().uniform(-delta_, delta_);
-   p_try_property_[1] = cv::theRNG().uniform(-delta_, delta_);
-   p_try_property_[2] = cv::theRNG().uniform(-delta_, delta_);
+   p_try_property_[0] = rng_.uniform(-delta_, delta_);
+   p_try_property_[1] = rng_.uniform(-delta_, delta_);
+   p_try_property_[2] = rng_.uniform(-delta_, delta_);
 
-   p_try_property_[3] = cv::theRNG().uniform(-delta_, delta_);
-   p_try_property_[4] = cv::theRNG().uniform(-delta_, delta_);
-   p_try_property_[5] = cv::theRNG().uniform(-delta_, delta_);
+   p_try_property_[3] = rng_.uniform(-delta_, delta_);
+   p_try_property_[4] = rng_.uniform(-delta_, delta_);
+   p_try_property_[5] = rng_.uniform(-delta_, delta_);
 #endif
 }
 
@@ -87,15 +87,16 @@ PatchMatchStereoImplSlantedPlane::property_random_init(
       float *p_property_,
       float value_range_,
       int x_,
-      int y_
+      int y_,
+      Philox &rng_
 )
 {
 
-   float z = cv::theRNG().uniform(0.0f, value_range_); // disparity is always positive
+   float z = rng_.uniform(0.0f, value_range_); // disparity is always positive
 
-   float nx = cv::theRNG().uniform(-1.0f, 1.0f);
-   float ny = cv::theRNG().uniform(-1.0f, 1.0f);
-   float nz = cv::theRNG().uniform(-1.0f, 1.0f);
+   float nx = rng_.uniform(-1.0f, 1.0f);
+   float ny = rng_.uniform(-1.0f, 1.0f);
+   float nz = rng_.uniform(-1.0f, 1.0f);
 
    init_abc(p_property_, nx, ny, nz, x_, y_, z);
 }
@@ -147,25 +148,26 @@ PatchMatchStereoImplSlantedPlane::random_search(
       int x_,
       int y_,
       int num_iter_,
-      bool is_left_view_
+      bool is_left_view_,
+      Philox &rng_
 )
 {
 #if 1
    float old_z = compute_disparity(p_old_property_, x_, y_, is_left_view_);
-   float new_z = old_z + cv::theRNG().uniform(-delta_, delta_);
+   float new_z = old_z + rng_.uniform(-delta_, delta_);
 #else
-   float new_z = cv::theRNG().uniform(-delta_, delta_);
+   float new_z = rng_.uniform(-delta_, delta_);
 #endif
 
    float delta_n = 1.0f / (1<<num_iter_);
 #if 1
-   float new_nx = p_old_property_[0] + cv::theRNG().uniform(-delta_n, delta_n);
-   float new_ny = p_old_property_[1] + cv::theRNG().uniform(-delta_n, delta_n);
-   float new_nz = p_old_property_[2] + cv::theRNG().uniform(-delta_n, delta_n);
+   float new_nx = p_old_property_[0] + rng_.uniform(-delta_n, delta_n);
+   float new_ny = p_old_property_[1] + rng_.uniform(-delta_n, delta_n);
+   float new_nz = p_old_property_[2] + rng_.uniform(-delta_n, delta_n);
 #else
-   float new_nx = cv::theRNG().uniform(-1.0f, 1.0f);
-   float new_ny = cv::theRNG().uniform(-1.0f, 1.0f);
-   float new_nz = cv::theRNG().uniform(-1.0f, 1.0f);
+   float new_nx = rng_.uniform(-1.0f, 1.0f);
+   float new_ny = rng_.uniform(-1.0f, 1.0f);
+   float new_nz = rng_.uniform(-1.0f, 1.0f);
 #endif
 
    init_abc(p_try_property_, new_nx, new_ny, new_nz, x_, y_, new_z);
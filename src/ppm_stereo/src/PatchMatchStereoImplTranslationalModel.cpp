@@ -29,10 +29,11 @@ PatchMatchStereoImplTranslationalModel::property_random_init(
       float *p_property_,
       float value_range_,
       int /*x_*/,
-      int /*y_*/
+      int /*y_*/,
+      Philox &rng_
 )
 {
-   p_property_[0] = cv::theRNG().uniform(0.0f, value_range_); // disparity is always positive
+   p_property_[0] = rng_.uniform(0.0f, value_range_); // disparity is always positive
 }
 
 float
@@ -67,13 +68,14 @@ PatchMatchStereoImplTranslationalModel::random_search(
       int /*x_*/,
       int /*y_*/,
       int /*num_iter_*/,
-      bool /*is_left_view_*/
+      bool /*is_left_view_*/,
+      Philox &rng_
 )
 {
 #if 1
-   p_try_property_[0] = p_old_property_[0] + cv::theRNG().uniform(-delta_, delta_);
+   p_try_property_[0] = p_old_property_[0] + rng_.uniform(-delta_, delta_);
 #else
-   p_try_property_[0] = cv::theRNG().uniform(-delta_, delta_);
+   p_try_property_[0] = rng_.uniform(-delta_, delta_);
 #endif
 }
 
@@ -19,6 +19,14 @@
 #include <opencv2/imgcodecs.hpp>
 #include "PatchMatchStereoSlanted.hpp"
 #include "MyTimer.hpp"
+#include "Philox.hpp"
+
+/**
+ * Every pixel draws its random numbers from its own stream keyed on
+ * (PatchMatchStereoSlantedConfig::get_random_seed(), view) with the counter (pixel, 0, iteration),
+ * so the result is reproducible and independent of the scan order.
+ */
+static const uint32_t g_init_iteration = 0xFFFFFFFF; //!< iteration of the random initialization
 
 static inline bool
 is_inside(int x, int ncols)
@@ -150,11 +158,11 @@ PatchMatchStereoSlanted::run_PatchMatch_stereo()
 
       if ((i & 1) == 0)
       {
-         propagation(FORWARD_PROPAGATION);
+         propagation(FORWARD_PROPAGATION, i);
       }
       else
       {
-         propagation(BACKWARD_PROPAGATION);
+         propagation(BACKWARD_PROPAGATION, i);
       }
 
       generate_disparity_map_not_scaled();
@@ -194,9 +202,6 @@ PatchMatchStereoSlanted::run_PatchMatch_stereo()
 void
 PatchMatchStereoSlanted::random_initialization()
 {
-   cv::setRNGSeed(100); // make the result reproducible
-   //cv::setRNGSeed((int)cv::getTickCount());
-
    int nx = m_views[LEFT_VIEW].cols;
    int ny = m_views[LEFT_VIEW].rows;
 
@@ -204,6 +209,7 @@ PatchMatchStereoSlanted::random_initialization()
    m_cost[RIGHT_VIEW].create(ny, nx, CV_32FC1);
 
    float max_disparity = m_config.get_max_disparity();
+   uint32_t random_seed = (uint32_t)m_config.get_random_seed();
 
    for (int v = LEFT_VIEW; v < NUM_VIEWS; v++)
    {
@@ -213,7 +219,8 @@ PatchMatchStereoSlanted::random_initialization()
          for (int x = 0; x < nx; x++)
          {
             float* p_property = m_properties[v].ptr<float>(y,x);
-            m_ptr_pmst_impl->property_random_init(p_property, max_disparity, x, y);
+            Philox rng(random_seed, (uint32_t)v, (uint32_t)(y*nx + x), 0, g_init_iteration);
+            m_ptr_pmst_impl->property_random_init(p_property, max_disparity, x, y, rng);
             p_cost[x] = compute_property_cost(p_property, x, y, (ViewIndex)v);
          }
       }
@@ -221,7 +228,7 @@ PatchMatchStereoSlanted::random_initialization()
 }
 
 void
-PatchMatchStereoSlanted::propagation(PropagationType type_)
+PatchMatchStereoSlanted::propagation(PropagationType type_, int iteration_)
 {
    cv::String output_directory = m_config.get_output_directory(); // debug
 
@@ -334,9 +341,10 @@ PatchMatchStereoSlanted::propagation(PropagationType type_)
 
             float* p_try_property = new float[m_ptr_pmst_impl->get_num_properties()];
             int k = 1;
+            Philox rng((uint32_t)m_config.get_random_seed(), (uint32_t)v, (uint32_t)(y*nx + x), 0, (uint32_t)iteration_);
             while(delta > min_search_value)
             {
-               m_ptr_pmst_impl->random_search(p_old_property, p_try_property, delta, x, y, k++, LEFT_VIEW == v);
+               m_ptr_pmst_impl->random_search(p_old_property, p_try_property, delta, x, y, k++, LEFT_VIEW == v, rng);
                // todo: do not call improve_cost if p_old_property and p_try_property are nearly equal
                improve_cost(x, y, best_cost, p_old_property, p_try_property, (ViewIndex)v);
 
@@ -589,8 +597,9 @@ PatchMatchStereoSlanted::weighted_median_filter()
 }
 
 float
-PatchMatchStereoSlanted::compute_property_cost(
+PatchMatchStereoSlanted::compute_property_row_cost(
       const float* p_property_,
+      const cv::Vec3f& p_,
       int x_,
       int y_,
       ViewIndex v_
@@ -599,53 +608,84 @@ PatchMatchStereoSlanted::compute_property_cost(
    float cost = 0;
 
    int nx = m_views[LEFT_VIEW].cols;
-   int ny = m_views[LEFT_VIEW].rows;
 
    int max_disparity = m_config.get_max_disparity();
 
+   int half_patch_sz = m_config.get_half_patch_size();
+
+   const cv::Vec3f* q = m_views[v_].ptr<cv::Vec3f>(y_);
+   for (int dx = -half_patch_sz; dx <= half_patch_sz; dx++)
+   {
+      int x = x_ + dx;
+      if (!is_inside(x, nx)) continue;
+      float w_pq = compute_color_weight(p_, q[x]);
+
+      float disparity = m_ptr_pmst_impl->compute_disparity(p_property_, x, y_, LEFT_VIEW == v_);
+      if ((disparity < 0) || (disparity > max_disparity))
+      {
+         cost += w_pq * m_bad_disparity_cost;
+         continue;
+      }
+
+      int left_d = (int)disparity;
+      int right_d = left_d;
+      if (disparity > left_d)
+      {
+         right_d = left_d + 1;
+      }
+      float left_alpha = right_d - disparity;
+      float right_alpha = 1 - left_alpha;
+
+      float left_cost = m_dissimilarity[v_][left_d][y_][x];
+      float right_cost = m_dissimilarity[v_][right_d][y_][x];
+
+      float cost_dis;
+      cost_dis = left_alpha*left_cost + right_alpha*right_cost;
+
+      cost += w_pq*cost_dis;
+   }
+   return cost;
+}
+
+float
+PatchMatchStereoSlanted::compute_property_cost(
+      const float* p_property_,
+      int x_,
+      int y_,
+      ViewIndex v_,
+      float bound_
+)
+{
+   float cost = 0;
+
+   int ny = m_views[LEFT_VIEW].rows;
+
    const cv::Vec3f& p = m_views[v_].at<cv::Vec3f>(y_, x_);
 
    int half_patch_sz = m_config.get_half_patch_size();
 
 #ifdef KFJ_USE_OPENMP
+   // the rows are reduced in parallel, so the bound is checked only once by the caller
+   (void)bound_;
+
    #pragma omp parallel for num_threads(5) reduction (+:cost)
-#endif
    for (int dy = -half_patch_sz; dy <= half_patch_sz; dy++)
    {
       int y = y_ + dy;
       if (!is_inside(y, ny)) continue;
-      const cv::Vec3f* q = m_views[v_].ptr<cv::Vec3f>(y);
-      for (int dx = -half_patch_sz; dx <= half_patch_sz; dx++)
-      {
-         int x = x_ + dx;
-         if (!is_inside(x, nx)) continue;
-         float w_pq = compute_color_weight(p, q[x]);
-
-         float disparity = m_ptr_pmst_impl->compute_disparity(p_property_, x, y, LEFT_VIEW == v_);
-         if ((disparity < 0) || (disparity > max_disparity))
-         {
-            cost += w_pq * m_bad_disparity_cost;
-            continue;
-         }
-
-         int left_d = (int)disparity;
-         int right_d = left_d;
-         if (disparity > left_d)
-         {
-            right_d = left_d + 1;
-         }
-         float left_alpha = right_d - disparity;
-         float right_alpha = 1 - left_alpha;
-
-         float left_cost = m_dissimilarity[v_][left_d][y][x];
-         float right_cost = m_dissimilarity[v_][right_d][y][x];
-
-         float cost_dis;
-         cost_dis = left_alpha*left_cost + right_alpha*right_cost;
-
-         cost += w_pq*cost_dis;
-      }
+      cost += compute_property_row_cost(p_property_, p, x_, y, v_);
    }
+#else
+   // every term is non-negative, so the cost never decreases
+   // and the remaining rows can be skipped once it reaches the bound
+   for (int dy = -half_patch_sz; dy <= half_patch_sz; dy++)
+   {
+      int y = y_ + dy;
+      if (!is_inside(y, ny)) continue;
+      cost += compute_property_row_cost(p_property_, p, x_, y, v_);
+      if (cost >= bound_) break;
+   }
+#endif
    return cost;
 }
 
@@ -658,7 +698,9 @@ PatchMatchStereoSlanted::improve_cost(
       const float *p_try_property,
       ViewIndex v_)
 {
-   float cost_ = compute_property_cost(p_try_property, x_, y_, v_);
+   // stop early once the try property cannot beat the old one,
+   // the bound is checked here in any case
+   float cost_ = compute_property_cost(p_try_property, x_, y_, v_, old_cost_);
    if (cost_ < old_cost_)
    {
       old_cost_ =  cost_;
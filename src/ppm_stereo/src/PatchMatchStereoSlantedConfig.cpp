@@ -37,7 +37,8 @@ PatchMatchStereoSlantedConfig::PatchMatchStereoSlantedConfig()
 
      m_property_type(PropertyType::E_SLANTED_PLANE),
      m_output_directory("/tmp"),
-     m_verbose(true)
+     m_verbose(true),
+     m_random_seed(100)
 {}
 
 void
@@ -105,6 +106,7 @@ PatchMatchStereoSlantedConfig::to_string() const
       << "Property type: " << property_type_to_string() << "\n"
       << "Output directory: " << m_output_directory << "\n"
       << "Verbose: " << (m_verbose ? "true" : "false") << "\n"
+      << "Random seed: " << m_random_seed << "\n"
      ;
    return ss.str();
 }
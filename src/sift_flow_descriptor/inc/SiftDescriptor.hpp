@@ -28,6 +28,8 @@ public:
     *
     * The default parameters are good enough.
     *
+    * The rows are processed in parallel with cv::parallel_for_().
+    *
     * @param image_                [in]   Any image format supported by OpenCV
     * @param descriptor_           [out]  CV_8UC(128)
     * @param cell_size_            [in]   half cell size
@@ -44,6 +46,61 @@ public:
          int num_bins_ = 8
    );
 
+   /**
+    * Compute SIFT flow descriptor only for the pixels selected by a mask.
+    *
+    * The descriptors of the selected pixels are identical to the ones of
+    * compute_sift_descriptor(). The gradients and the cells are still computed
+    * for the whole image; only the sampling and the normalization are skipped.
+    *
+    * @param image_       [in]  Any image format supported by OpenCV
+    * @param mask_        [in]  CV_8UC1 with the size of the descriptor image. Pixels where it is 0
+    *                           get a descriptor of 0. An empty mask selects every pixel.
+    * @param descriptor_  [out] CV_8UC(128)
+    */
+   static void compute_sift_descriptor_sampled(
+         const cv::Mat& image_,
+         const cv::Mat& mask_,
+         cv::Mat& descriptor_,
+         int cell_size_ = 2,
+         int step_size_ = 1,
+         bool is_boundary_included_ = true,
+         int num_bins_ = 8
+   );
+
+   /**
+    * Load the principal components of the SIFT flow descriptor.
+    *
+    * The file contains the number of rows and the number of columns as floats,
+    * followed by the basis in row major order, e.g., data/sift_flow_descriptor/pcSIFT.bin.
+    *
+    * @param filename_  [in]  File name
+    * @param basis_     [out] CV_32FC1, one principal component per row, in decreasing order of significance
+    * @return false if the file cannot be read
+    */
+   static bool load_pca_basis(
+         const std::string& filename_,
+         cv::Mat& basis_
+   );
+
+   /**
+    * Project SIFT flow descriptors onto their first principal components.
+    *
+    * The projections are scaled by 127/255 and rounded to int8,
+    * so that they are not saturated.
+    *
+    * @param descriptor_      [in]  CV_8UC(128), e.g., from compute_sift_descriptor()
+    * @param basis_           [in]  CV_32FC1 with 128 columns, see load_pca_basis()
+    * @param num_components_  [in]  Number of principal components k, e.g., 16 or 32
+    * @param out_             [out] CV_8SC(k)
+    */
+   static void project_sift_descriptor(
+         const cv::Mat& descriptor_,
+         const cv::Mat& basis_,
+         int num_components_,
+         cv::Mat& out_
+   );
+
    /**
     * Visualize the sift flow descriptor.
     *
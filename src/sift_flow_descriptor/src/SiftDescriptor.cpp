@@ -15,16 +15,256 @@
     You should have received a COPYING file of the GNU General Public License
     along with this program. If not, see <http://www.gnu.org/licenses/>
     -----------------------------------------------------------------  */
+#include <cmath>
+#include <cstring>
 #include <iostream>
 #include <opencv2/imgproc.hpp>
 
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
 #include "SiftDescriptor.hpp"
 
+void
+SiftDescriptor::compute_sift_descriptor(
+      const cv::Mat& image_,
+      cv::Mat& descriptor_,
+      int cell_size_, // = 2
+      int step_size_, // = 1
+      bool is_boundary_included_, // = true,
+      int num_bins_// = 8
+)
+{
+   compute_sift_descriptor_sampled(image_, cv::Mat(), descriptor_, cell_size_, step_size_,
+                                   is_boundary_included_, num_bins_);
+}
+
+/**
+ * Compute x_^9 with multiplications.
+ *
+ * The exponent alpha = 9 controls the decay of the gradient energy that
+ * falls into a bin; run SIFT_weightFunc.m to see why it is the best value.
+ * The products are computed in double. The result is identical to
+ * (float)std::pow((double)x_, 9) for every float in [0, 1.05], which
+ * covers the projection of a normalized gradient onto an orientation.
+ */
+static inline float
+pow9(float x_)
+{
+   double x = x_;
+   double x2 = x*x;
+   double x4 = x2*x2;
+   return (float)(x4*x4*x);
+}
+
+/**
+ * Normalize a SIFT descriptor and convert it to uchar.
+ *
+ * Every element is divided in double as in the scalar loop,
+ * i.e., the SIMD version gives the same result.
+ */
+static inline void
+normalize_sift(const float* p_, int n_, double mag_, uchar* p_out_)
+{
+   double denominator = mag_ + 0.01;
+   int k = 0;
+#if defined(__SSE2__)
+   const __m128d v_denominator = _mm_set1_pd(denominator);
+   const __m128d v_255 = _mm_set1_pd(255.);
+   for (; k <= n_ - 8; k += 8)
+   {
+      __m128 f0 = _mm_loadu_ps(p_ + k);
+      __m128 f1 = _mm_loadu_ps(p_ + k + 4);
+      __m128d d[4] = {_mm_cvtps_pd(f0), _mm_cvtps_pd(_mm_movehl_ps(f0, f0)),
+                      _mm_cvtps_pd(f1), _mm_cvtps_pd(_mm_movehl_ps(f1, f1))};
+      __m128i i[4];
+      for (int h = 0; h < 4; h++)
+      {
+         d[h] = _mm_min_pd(_mm_mul_pd(_mm_div_pd(d[h], v_denominator), v_255), v_255);
+         i[h] = _mm_cvttpd_epi32(d[h]); // truncation, as the cast to uchar
+      }
+      __m128i v16 = _mm_packs_epi32(_mm_unpacklo_epi64(i[0], i[1]), _mm_unpacklo_epi64(i[2], i[3]));
+      _mm_storel_epi64((__m128i*)(p_out_ + k), _mm_packus_epi16(v16, v16));
+   }
+#endif
+   for (; k < n_; k++)
+   {
+      p_out_[k] = (uchar)cv::min(p_[k]/denominator*255, 255.);
+   }
+}
+
+/**
+ * Parallel loop body for the orientation bands.
+ *
+ * It fuses the gradient magnitude, the gradient normalization and the
+ * orientation binning, so that the image is read only once.
+ */
+class SiftBandLoopBody : public cv::ParallelLoopBody
+{
+public:
+   SiftBandLoopBody(const cv::Mat& imdx_,
+                    const cv::Mat& imdy_,
+                    const std::vector<float>& cos_,
+                    const std::vector<float>& sin_,
+                    cv::Mat& imband_)
+      : m_imdx(imdx_),
+        m_imdy(imdy_),
+        m_cos(cos_),
+        m_sin(sin_),
+        m_imband(imband_)
+   {}
+
+   virtual void operator ()(const cv::Range& range) const
+   {
+      int width = m_imdx.cols;
+      int nchannels = m_imdx.channels();
+      int num_bins = (int)m_cos.size();
+
+      // the member of this class is non-modifiable.
+      // thus it needs to get an alias to m_imband
+      cv::Mat imband = m_imband;
+
+      for (int y = range.start; y < range.end; y++)
+      {
+         const float* p_dx = m_imdx.ptr<float>(y);
+         const float* p_dy = m_imdy.ptr<float>(y);
+         float* p_band = imband.ptr<float>(y);
+
+         for (int x = 0; x < width; x++, p_dx += nchannels, p_dy += nchannels, p_band += num_bins)
+         {
+            // the gradient of the channel with the maximum magnitude
+            float max_mag = std::sqrt(p_dx[0]*p_dx[0] + p_dy[0]*p_dy[0]);
+            float gx = 0, gy = 0;
+            if (max_mag > 1e-7)
+            {
+               gx = p_dx[0]/max_mag;
+               gy = p_dy[0]/max_mag;
+            }
+            for (int c = 1; c < nchannels; c++)
+            {
+               float mag = std::sqrt(p_dx[c]*p_dx[c] + p_dy[c]*p_dy[c]);
+               if (mag > max_mag)
+               {
+                  max_mag = mag;
+                  gx = p_dx[c]/max_mag;
+                  gy = p_dy[c]/max_mag;
+               }
+            }
+
+            // the energy of every orientation band, alpha = 9
+            for (int k = 0; k < num_bins; k++)
+            {
+               float temp = cv::max(gx*m_cos[k] + gy*m_sin[k], 0.0f);
+               p_band[k] = pow9(temp)*max_mag;
+            }
+         }
+      }
+   }
+
+private:
+   const cv::Mat& m_imdx;
+   const cv::Mat& m_imdy;
+   const std::vector<float>& m_cos;
+   const std::vector<float>& m_sin;
+   cv::Mat m_imband;
+};
+
+/**
+ * Parallel loop body for sampling the cells into the SIFT image.
+ */
+class SiftSampleLoopBody : public cv::ParallelLoopBody
+{
+public:
+   SiftSampleLoopBody(const cv::Mat& imband_cell_,
+                      const cv::Mat& mask_,
+                      cv::Mat& imsift_,
+                      int cell_size_,
+                      int step_size_,
+                      int x_shift_,
+                      int y_shift_)
+      : m_imband_cell(imband_cell_),
+        m_mask(mask_),
+        m_imsift(imsift_),
+        m_cell_size(cell_size_),
+        m_step_size(step_size_),
+        m_x_shift(x_shift_),
+        m_y_shift(y_shift_)
+   {}
+
+   virtual void operator ()(const cv::Range& range) const
+   {
+      int width = m_imband_cell.cols;
+      int height = m_imband_cell.rows;
+      int num_bins = m_imband_cell.channels();
+      int siftdim = m_imsift.channels();
+      int sift_width = m_imsift.cols;
+      size_t cell_bytes = sizeof(float)*num_bins;
+
+      // the 16 cells of a descriptor are gathered into a stack buffer
+      cv::AutoBuffer<float> buffer((size_t)siftdim);
+      float* p_cell = buffer;
+
+      cv::Mat imsift = m_imsift;
+
+      for (int i = range.start; i < range.end; i++)
+      {
+         const float* p_rows[4];
+         for (int ii = -1; ii <= 2; ii++)
+         {
+            int y = cv::min(cv::max(m_y_shift + i*m_step_size + ii*m_cell_size, 0), height - 1);
+            p_rows[ii + 1] = m_imband_cell.ptr<float>(y);
+         }
+
+         const uchar* p_mask = m_mask.empty() ? nullptr : m_mask.ptr<uchar>(i);
+         uchar* p_sift = imsift.ptr<uchar>(i);
+
+         for (int j = 0; j < sift_width; j++, p_sift += siftdim)
+         {
+            if (p_mask && !p_mask[j])
+            {
+               memset(p_sift, 0, (size_t)siftdim);
+               continue;
+            }
+
+            int xs[4];
+            for (int jj = -1; jj <= 2; jj++)
+            {
+               xs[jj + 1] = cv::min(cv::max(m_x_shift + j*m_step_size + jj*m_cell_size, 0), width - 1);
+            }
+
+            float* p = p_cell;
+            for (int ii = 0; ii < 4; ii++)
+            {
+               for (int jj = 0; jj < 4; jj++, p += num_bins)
+               {
+                  memcpy(p, p_rows[ii] + xs[jj]*num_bins, cell_bytes);
+               }
+            }
+
+            // the same norm as the reference implementation, i.e., cv::norm()
+            double mag = cv::norm(cv::Mat(siftdim, 1, CV_32F, p_cell), cv::NORM_L2);
+            normalize_sift(p_cell, siftdim, mag, p_sift);
+         }
+      }
+   }
+
+private:
+   const cv::Mat& m_imband_cell;
+   const cv::Mat& m_mask;
+   cv::Mat m_imsift;
+   int m_cell_size;
+   int m_step_size;
+   int m_x_shift;
+   int m_y_shift;
+};
+
 // modified from https://people.csail.mit.edu/celiu/SIFTflow/
 // refer to https://github.com/csukuangfj/sift-flow/blob/master/2011/mexDenseSIFT/ImageFeature.h#L26
 void
-SiftDescriptor::compute_sift_descriptor(
+SiftDescriptor::compute_sift_descriptor_sampled(
       const cv::Mat& image_,
+      const cv::Mat& mask_,
       cv::Mat& imsift,
       int cell_size_, // = 2
       int step_size_, // = 1
@@ -34,14 +274,8 @@ SiftDescriptor::compute_sift_descriptor(
 {
    if (cell_size_ <= 0) cell_size_ = 2;
 
-   // this parameter controls decay of the gradient energy falls into a bin
-   // run SIFT_weightFunc.m to see why alpha = 9 is the best value
-   int alpha = 9;
-
    int width = image_.cols;
    int height = image_.rows;
-   int nchannels = image_.channels();
-   int nPixels = width*height;
 
    cv::Mat img;
    image_.convertTo(img, CV_32F);
@@ -57,67 +291,22 @@ SiftDescriptor::compute_sift_descriptor(
    cv::filter2D(img, imdx, CV_32F, kx, cv::Point(2,0));
    cv::filter2D(img, imdy, CV_32F, ky, cv::Point(0,2));
 
-   // get the maximum gradient over the channels and estimate the normalized gradient
-   cv::Mat magsrc(height, width, img.type());
-   cv::Mat mag(height, width, CV_32FC1);
-   cv::Mat gradient(height,width, CV_32FC2);
-
-   float* magsrc_pData = magsrc.ptr<float>(0);
-   float* imdx_pData = imdx.ptr<float>(0);
-   float* imdy_pData = imdy.ptr<float>(0);
-   float* gradient_pData = gradient.ptr<float>(0);
-   float* mag_pData = mag.ptr<float>(0);
-
-#if defined(SIFT_OPENMP)
-#pragma omp parallel for
-#endif
-   for(int i = 0;i < nPixels; i++)
-   {
-      int offset = i * nchannels;
-      for(int j = 0;j < nchannels; j++)
-         magsrc_pData[offset+j] = (float)(sqrt(imdx_pData[offset+j]*imdx_pData[offset+j]+imdy_pData[offset+j]*imdy_pData[offset+j]));
-      float Max = magsrc_pData[offset];
-      if(Max > 1e-7)
-      {
-         gradient_pData[i*2] = imdx_pData[offset]/Max;
-         gradient_pData[i*2+1] = imdy_pData[offset]/Max;
-      }
-      for(int j = 1; j < nchannels; j++)
-      {
-         if(magsrc_pData[offset+j]>Max)
-         {
-            Max = magsrc_pData[offset+j];
-            gradient_pData[i*2] = imdx_pData[offset+j]/Max;
-            gradient_pData[i*2+1] = imdy_pData[offset+j]/Max;
-         }
-      }
-      mag_pData[i] = Max;
-   }
-
    // get the pixel-wise energy for each orientation band
-   cv::Mat imband(height, width, CV_32FC(num_bins_));
-   float* imband_pData = imband.ptr<float>(0);
+   std::vector<float> band_cos((size_t)num_bins_);
+   std::vector<float> band_sin((size_t)num_bins_);
    float theta = (float)M_PI*2/num_bins_;
-
-#if defined(SIFT_OPENMP)
-#pragma omp parallel for
-#endif
    for(int k = 0; k < num_bins_; k++)
    {
-      float _cos, _sin, temp;
-      _sin = (float)sin(theta*k);
-      _cos = (float)cos(theta*k);
-      for(int i = 0; i < nPixels; i++)
-      {
-         temp = cv::max(gradient_pData[i*2]*_cos + gradient_pData[i*2+1]*_sin, 0.0f);
-         //if(alpha>1) // the condition is always true, as alpha is set to a fixed value 9
-            temp = (float)cv::pow(temp,alpha);
-         imband_pData[i*num_bins_+k] = temp*mag_pData[i];
-      }
+      band_sin[k] = (float)sin(theta*k);
+      band_cos[k] = (float)cos(theta*k);
    }
 
+   cv::Mat imband(height, width, CV_32FC(num_bins_));
+   cv::parallel_for_(cv::Range(0, height), SiftBandLoopBody(imdx, imdy, band_cos, band_sin, imband));
+
    // filter out the SIFT feature
-   cv::Mat_<float> filter(cell_size_*2+1,1);
+   // filter[1] is never assigned below, it is 0 as in the original implementation
+   cv::Mat_<float> filter(cell_size_*2+1, 1, 0.0f);
    filter[0][0] = filter[cell_size_+1][0] = 0.25;
    for(int i = 1; i < cell_size_ + 1; i++)
       filter[i+1][0] = 1;
@@ -126,7 +315,6 @@ SiftDescriptor::compute_sift_descriptor(
 
    cv::Mat imband_cell;
    cv::sepFilter2D(imband, imband_cell, CV_32F, filter, filter);
-   float* imband_cell_pData = imband_cell.ptr<float>(0);
 
    // allocate buffer for the sift image
    int siftdim = num_bins_*16;
@@ -144,45 +332,100 @@ SiftDescriptor::compute_sift_descriptor(
    }
 
    imsift.create(sift_height, sift_width, CV_8UC(siftdim));
-   uchar* imsift_pData = imsift.ptr<uchar>(0);
 
-#if defined(SIFT_OPENMP)
-#pragma omp parallel for
-#endif
-   for(int i = 0; i < sift_height; i++)
+   if (!mask_.empty())
+   {
+      CV_Assert(mask_.type() == CV_8UC1);
+      CV_Assert((mask_.rows == sift_height) && (mask_.cols == sift_width));
+   }
+
+   // now sample to get SIFT image
+   cv::parallel_for_(cv::Range(0, sift_height),
+                     SiftSampleLoopBody(imband_cell, mask_, imsift, cell_size_, step_size_, x_shift, y_shift));
+}
+
+bool
+SiftDescriptor::load_pca_basis(
+      const std::string& filename_,
+      cv::Mat& basis_
+)
+{
+   FILE* f = fopen(filename_.c_str(), "rb");
+   if (!f)
+   {
+      return false;
+   }
+
+   float rows, cols;
+   bool res = (fread(&rows, sizeof(float), 1, f) == 1) &&
+              (fread(&cols, sizeof(float), 1, f) == 1) &&
+              (rows >= 1) && (cols >= 1);
+   if (res)
+   {
+      basis_.create((int)rows, (int)cols, CV_32FC1);
+      res = (fread(basis_.data, sizeof(float), basis_.total(), f) == basis_.total());
+   }
+
+   fclose(f);
+   return res;
+}
+
+/**
+ * Parallel loop body for projecting the SIFT descriptors of a row at a time.
+ */
+class SiftProjectionLoopBody : public cv::ParallelLoopBody
+{
+public:
+   SiftProjectionLoopBody(const cv::Mat& descriptor_,
+                          const cv::Mat& basis_,
+                          cv::Mat& out_)
+      : m_descriptor(descriptor_),
+        m_basis(basis_),
+        m_out(out_)
+   {}
+
+   virtual void operator ()(const cv::Range& range) const
    {
-      // now sample to get SIFT image
-      cv::Mat sift_cell(siftdim, 1, CV_32FC1);
-      float* sift_cell_pData = sift_cell.ptr<float>(0);
+      int width = m_descriptor.cols;
+      cv::Mat descriptor_f;
+      cv::Mat projection;
 
-      for(int j = 0; j < sift_width; j++)
+      for (int y = range.start; y < range.end; y++)
       {
-         int count = 0;
-         for(int ii = -1; ii <= 2; ii++)
-            for(int jj = -1; jj <= 2; jj++)
-            {
-               int y = cv::min(cv::max(y_shift+i*step_size_+ii*cell_size_,0), height-1);
-               int x = cv::min(cv::max(x_shift+j*step_size_+jj*cell_size_,0), width-1);
-
-               // the following code is the same as the above two for debugging purposes
-               //int y = y_shift+i*stepSize+ii*cellSize;
-               //int x = x_shift+j*stepSize+jj*cellSize;
-               //if (x<0 || x>=width)
-               //	x = __min(__max(x,0),width-1);
-               //if (y<0 || y>=height)
-               //	y= __min(__max(y,0),height-1);
-
-               memcpy(sift_cell_pData+count*num_bins_,imband_cell_pData+(y*width+x)*num_bins_,sizeof(float)*num_bins_);
-               count++;
-            }
-         // normalize the SIFT descriptor
-         double mag = cv::norm(sift_cell, cv::NORM_L2);
-         int offset = (i*sift_width+j)*siftdim;
-         //memcpy(imsift.pData+offset,sift_cell.pData,sizeof(double)*siftdim);
-         for(int k = 0;k<siftdim;k++)
-            imsift_pData[offset+k] =  (uchar)cv::min(sift_cell_pData[k]/(mag+0.01)*255,255.);//(unsigned char) __min(sift_cell.pData[k]/mag*512,255);
-      }//*/
+         // one descriptor per row
+         cv::Mat descriptor = m_descriptor.row(y).reshape(1, width);
+         cv::Mat out = m_out.row(y).reshape(1, width);
+
+         descriptor.convertTo(descriptor_f, CV_32F);
+         cv::gemm(descriptor_f, m_basis, 1, cv::noArray(), 0, projection, cv::GEMM_2_T);
+
+         // the L2 norm of a descriptor is less than 255, so is every component
+         projection.convertTo(out, CV_8S, 127./255);
+      }
    }
+
+private:
+   const cv::Mat& m_descriptor;
+   cv::Mat m_basis;
+   cv::Mat m_out;
+};
+
+void
+SiftDescriptor::project_sift_descriptor(
+      const cv::Mat& descriptor_,
+      const cv::Mat& basis_,
+      int num_components_,
+      cv::Mat& out_
+)
+{
+   CV_Assert(descriptor_.depth() == CV_8U);
+   CV_Assert(basis_.type() == CV_32FC1);
+   CV_Assert(basis_.cols == descriptor_.channels());
+   CV_Assert((num_components_ >= 1) && (num_components_ <= basis_.rows));
+
+   out_.create(descriptor_.size(), CV_8SC(num_components_));
+   cv::parallel_for_(cv::Range(0, descriptor_.rows),
+                     SiftProjectionLoopBody(descriptor_, basis_.rowRange(0, num_components_), out_));
 }
 
 void
@@ -192,25 +435,15 @@ SiftDescriptor::pca_visualisation(
       const std::string& filename_
 )
 {
-   FILE* f = fopen(filename_.c_str(), "r");
-   if (!f)
+   cv::Mat m;
+   if (!load_pca_basis(filename_, m))
    {
       std::cerr << "File '" << filename_ << "' cannot be opened!"
                 << std::endl;
       return;
    }
 
-   float rows, cols;
-
-   fread(&rows, sizeof(float), 1, f);
-   fread(&cols, sizeof(float), 1, f);
-
-   cv::Mat m;
-   //m.create(rows, 1, CV_32FC((int)cols));
-   m.create(rows, cols, CV_32FC1);
-   fread(m.data, sizeof(float), rows*cols, f);
-
-   fclose(f);
+   float cols = (float)m.cols;
 
    cv::Mat m2(m, cv::Range(0,3));
 
@@ -58,4 +58,29 @@ void census_transform(
       bool color_to_gray_ = true
 );
 
+/**
+ * Census transform with bit-packed output.
+ *
+ * It computes census_transform() and copies the bytes of every pixel
+ * into 32-bit words, four bytes per word in the same order;
+ * unused bytes of the last word are 0. Since no bits are moved, the
+ * Hamming distance between two pixels is the same as for census_transform(),
+ * but it can be computed with one popcount per word.
+ * The padding costs memory: a 3x3 gray census grows from 1 to 4 bytes per pixel,
+ * and a 5x5 gray census from 3 to 4 bytes per pixel.
+ *
+ * @param in_image_     [in] Input image, see census_transform()
+ * @param census_image_ [out] Output image of type CV_32SC1 for a gray image or if color_to_gray_ is true,
+ *                            otherwise CV_32SC1 if wnd_size_ is 3 and CV_32SC3 if wnd_size_ is 5.
+ *                            It has the same size with the input image.
+ * @param wnd_size_     [in] It must be 3 or 5
+ * @param color_to_gray_ [in] see census_transform()
+ */
+void packed_census_transform(
+      const cv::Mat& in_image_,
+      cv::Mat& census_image_,
+      int wnd_size_,
+      bool color_to_gray_ = true
+);
+
 #endif //_CensusTransform_HPP_
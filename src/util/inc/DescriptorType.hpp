@@ -27,6 +27,8 @@ enum DescriptorType
    E_DESC_TYPE_CENSUS_TRANSFORM              = 2, //!< census transform
    E_DESC_TYPE_COMPLETE_RANK_TRANSFORM       = 3, //!< complete rank transform
    E_DESC_TYPE_COMPLETE_CENSUS_TRANSFORM     = 4, //!< complete census transform
+   E_DESC_TYPE_PACKED_CENSUS_TRANSFORM       = 5, //!< census transform packed into 32-bit words
+   E_DESC_TYPE_PCA_SIFT                      = 6, //!< sift flow descriptor projected onto its principal components, int8
 };
 
 /**
@@ -37,4 +39,12 @@ enum DescriptorType
  */
 std::string descriptor_type_to_string(DescriptorType type_);
 
+/**
+ * Check whether the descriptor is a bit string, i.e., a census transform.
+ *
+ * @param type_ Type of the descriptor.
+ * @return true if every bit is a separate comparison, false for histograms and ranks.
+ */
+bool is_binary_descriptor(DescriptorType type_);
+
 #endif //_DescriptorType_HPP_
@@ -169,6 +169,26 @@ public:
          float factor_ = 0.5f
    );
 
+   /**
+    * Downsample a descriptor image to a coarser pyramid level.
+    *
+    * Every output pixel aggregates the descriptors of the input pixels it covers.
+    *
+    * @param descriptor_  [in]  Descriptor image of depth CV_8U, CV_8S or CV_32S
+    * @param size_        [in]  Size of the output, not larger than the input
+    * @param out_         [out] Downsampled descriptors, same type as descriptor_
+    * @param is_binary_   [in]  true for bit strings, e.g., census transforms: a bit is set if
+    *                           it is set in at least half of the covered pixels.
+    *                           false for histograms and ranks, e.g., SIFT: every channel is
+    *                           averaged over the covered area, see cv::INTER_AREA.
+    */
+   static void downsample_descriptor(
+         const cv::Mat& descriptor_,
+         const cv::Size& size_,
+         cv::Mat& out_,
+         bool is_binary_
+   );
+
    static cv::Mat nearest_neighbor_interpolation(
          const cv::Mat& input_,
          float x_,
@@ -213,6 +233,14 @@ public:
          bool color_to_gray_ = true
    );
 
+   //! @sa ::packed_census_transform()
+   static void packed_census_transform(
+         const cv::Mat& in_image_,
+         cv::Mat& census_image_,
+         int wnd_size_,
+         bool color_to_gray_ = true
+   );
+
    //! @sa ::complete_rank_transform()
    static void complete_rank_transform(
          const cv::Mat& in_image_,
@@ -0,0 +1,103 @@
+/*  ---------------------------------------------------------------------
+    Copyright 2017 Fangjun Kuang
+    email: csukuangfj at gmail dot com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a COPYING file of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>
+    -----------------------------------------------------------------  */
+#ifndef _Philox_HPP_
+#define _Philox_HPP_
+
+#include <cstdint>
+
+/**
+ * Counter-based random number generator Philox4x32-10.
+ *
+ * The n-th block of four random numbers is a bijection of the counter
+ * under the key, so any element of the sequence can be computed without
+ * generating its predecessors. A stream is identified by the key and the
+ * first three words of the counter; the last word enumerates the blocks
+ * within the stream.
+ *
+ * Patch match uses one stream per (seed, level, iteration, view), so the
+ * random numbers drawn for a seed do not depend on the number of threads
+ * or on the order in which the seeds are processed.
+ *
+ * See J. K. Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", SC 2011.
+ */
+class Philox
+{
+public:
+   /**
+    * @param key0_ [in] First word of the key, e.g., the global random seed.
+    * @param key1_ [in] Second word of the key, e.g., the view.
+    * @param c0_   [in] First word of the counter, e.g., the seed index.
+    * @param c1_   [in] Second word of the counter, e.g., the pyramid level.
+    * @param c2_   [in] Third word of the counter, e.g., the iteration.
+    */
+   Philox(uint32_t key0_, uint32_t key1_, uint32_t c0_, uint32_t c1_, uint32_t c2_)
+   {
+      m_key[0] = key0_;
+      m_key[1] = key1_;
+      m_counter[0] = c0_;
+      m_counter[1] = c1_;
+      m_counter[2] = c2_;
+      m_counter[3] = 0;
+      m_index = 4; // no block is generated yet
+   }
+
+   /**
+    * Compute the block of a counter with 10 rounds.
+    *
+    * @param counter_ [in]  Counter, 4 words.
+    * @param key_     [in]  Key, 2 words.
+    * @param result_  [out] Random numbers, 4 words.
+    */
+   static void philox4x32(
+         const uint32_t counter_[4],
+         const uint32_t key_[2],
+         uint32_t result_[4]
+   );
+
+   //! @return The next 32-bit random number of the stream.
+   uint32_t next()
+   {
+      if (m_index == 4)
+      {
+         philox4x32(m_counter, m_key, m_block);
+         m_counter[3]++;
+         m_index = 0;
+      }
+      return m_block[m_index++];
+   }
+
+   /**
+    * The same contract as cv::RNG::uniform(float, float).
+    *
+    * @return A random number uniformly distributed in [a_, b_).
+    */
+   float uniform(float a_, float b_)
+   {
+      // the upper 24 bits fit into the mantissa, so the value is strictly less than 1
+      float r = (float)(next() >> 8) * (1.0f / 16777216.0f);
+      return a_ + (b_ - a_) * r;
+   }
+
+private:
+   uint32_t m_key[2];
+   uint32_t m_counter[4];
+   uint32_t m_block[4];    //!< random numbers of the current block
+   int m_index;            //!< index of the next unused number in m_block
+};
+
+#endif //_Philox_HPP_
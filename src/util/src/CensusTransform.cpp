@@ -15,6 +15,8 @@
     You should have received a COPYING file of the GNU General Public License
     along with this program. If not, see <http://www.gnu.org/licenses/>
     -----------------------------------------------------------------  */
+#include <cstring>
+
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
 
@@ -258,3 +260,32 @@ census_transform(
       }
    }
 }
+
+void
+packed_census_transform(
+      const cv::Mat& in_image_,
+      cv::Mat& census_image_,
+      int wnd_size_,
+      bool color_to_gray_
+)
+{
+   cv::Mat census_image;
+   census_transform(in_image_, census_image, wnd_size_, color_to_gray_);
+
+   int num_bytes = census_image.channels();   // 1, 3 or 9
+   int num_words = (num_bytes + 3) / 4;       // 1 or 3
+
+   census_image_.create(census_image.size(), CV_32SC(num_words));
+   census_image_ = cv::Scalar::all(0);
+
+   size_t word_size = sizeof(int) * (size_t)num_words;
+   for (int y = 0; y < census_image.rows; y++)
+   {
+      const uchar* src = census_image.ptr<uchar>(y);
+      uchar* dst = census_image_.ptr<uchar>(y);
+      for (int x = 0; x < census_image.cols; x++)
+      {
+         memcpy(dst + x*word_size, src + x*num_bytes, (size_t)num_bytes);
+      }
+   }
+}
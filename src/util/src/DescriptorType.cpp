@@ -39,9 +39,39 @@ descriptor_type_to_string(DescriptorType type_)
       case DescriptorType::E_DESC_TYPE_COMPLETE_CENSUS_TRANSFORM:
          res = "complete census transform";
          break;
+      case DescriptorType::E_DESC_TYPE_PACKED_CENSUS_TRANSFORM:
+         res = "packed census transform";
+         break;
+      case DescriptorType::E_DESC_TYPE_PCA_SIFT:
+         res = "pca sift";
+         break;
       default:
          res = "unknown descriptor type";
          break;
    }
    return res;
 }
+
+bool
+is_binary_descriptor(DescriptorType type_)
+{
+   bool res = false;
+   switch (type_)
+   {
+      case DescriptorType::E_DESC_TYPE_CENSUS_TRANSFORM:
+      case DescriptorType::E_DESC_TYPE_COMPLETE_CENSUS_TRANSFORM:
+      case DescriptorType::E_DESC_TYPE_PACKED_CENSUS_TRANSFORM:
+         res = true;
+         break;
+      case DescriptorType::E_DESC_TYPE_SIFT:
+      case DescriptorType::E_DESC_TYPE_RANK_TRANSFORM:
+      case DescriptorType::E_DESC_TYPE_COMPLETE_RANK_TRANSFORM:
+      case DescriptorType::E_DESC_TYPE_PCA_SIFT:
+         res = false;
+         break;
+      default:
+         res = false;
+         break;
+   }
+   return res;
+}
@@ -15,6 +15,8 @@
     You should have received a COPYING file of the GNU General Public License
     along with this program. If not, see <http://www.gnu.org/licenses/>
     -----------------------------------------------------------------  */
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/ximgproc.hpp>
@@ -76,8 +78,11 @@ MyImageProcessing::gaussian_filtering(
    int nx,ny;
    nx = ny = cvRound(precision_*sigma_*2 + 1) | 1; // or 1 -> odd number
 
-   cv::Mat image;
-   image_.convertTo(image, CV_32F);
+   cv::Mat image = image_;
+   if (image_.depth() != CV_32F)
+   {
+      image_.convertTo(image, CV_32F);
+   }
 
    cv::GaussianBlur(image, out_,
                     cv::Size(nx, ny),
@@ -142,8 +147,8 @@ MyImageProcessing::get_image_pyramid_by_levels(
    num_levels_ = cv::min(num_levels_, avail_levels);
 
    pyramids_.resize((size_t)num_levels_);
-   pyramids_[0] = raw_image_.clone();
-   gaussian_filtering(pyramids_[0], pyramids_[0], 0.8f, 5); // pre-smooth the finest scale
+   // pre-smooth the finest scale; the existing buffers of pyramids_ are reused
+   gaussian_filtering(raw_image_, pyramids_[0], 0.8f, 5);
 
 #if 0
    for (int i = 1; i < num_levels_; i++)
@@ -258,6 +263,151 @@ MyImageProcessing::bicubic_interpolation(
    return res.clone();
 }
 
+/**
+ * Majority pooling of the bits of every descriptor, see MyImageProcessing::downsample_descriptor().
+ */
+class BitMajorityPoolingLoopBody : public cv::ParallelLoopBody
+{
+public:
+   BitMajorityPoolingLoopBody(const cv::Mat& in_,
+                              cv::Mat& out_)
+   {
+      CV_Assert(in_.type() == out_.type());
+      CV_Assert((out_.cols <= in_.cols) && (out_.rows <= in_.rows));
+
+      m_in = in_;
+      m_out = out_;
+   }
+
+   virtual void operator ()(const cv::Range& range) const
+   {
+      int elem_size = (int)m_in.elemSize();
+      double sx = (double)m_in.cols / m_out.cols;
+      double sy = (double)m_in.rows / m_out.rows;
+
+      std::vector<int> counts((size_t)elem_size*8);
+
+      // the member of this class is non-modifiable.
+      // thus it needs to get an alias to m_out
+      cv::Mat out = m_out;
+
+      for (int y = range.start; y < range.end; y++)
+      {
+         int y0 = (int)(y*sy);
+         int y1 = cv::max(y0 + 1, cv::min(m_in.rows, (int)std::ceil((y + 1)*sy)));
+
+         uchar* p_out = out.ptr<uchar>(y);
+         for (int x = 0; x < out.cols; x++)
+         {
+            int x0 = (int)(x*sx);
+            int x1 = cv::max(x0 + 1, cv::min(m_in.cols, (int)std::ceil((x + 1)*sx)));
+
+            std::fill(counts.begin(), counts.end(), 0);
+            for (int yy = y0; yy < y1; yy++)
+            {
+               const uchar* p_in = m_in.ptr<uchar>(yy);
+               for (int xx = x0; xx < x1; xx++)
+               {
+                  const uchar* d = p_in + xx*elem_size;
+                  for (int k = 0; k < elem_size; k++)
+                  {
+                     for (int b = 0; b < 8; b++)
+                     {
+                        counts[k*8 + b] += (d[k] >> b) & 1;
+                     }
+                  }
+               }
+            }
+
+            int num = (x1 - x0)*(y1 - y0);
+            uchar* d = p_out + x*elem_size;
+            for (int k = 0; k < elem_size; k++)
+            {
+               uchar v = 0;
+               for (int b = 0; b < 8; b++)
+               {
+                  if (2*counts[k*8 + b] >= num) v |= (uchar)(1u << b);
+               }
+               d[k] = v;
+            }
+         }
+      }
+   }
+
+private:
+   cv::Mat m_in;  //!< input descriptors
+   cv::Mat m_out; //!< pooled descriptors
+};
+
+/**
+ * cv::resize() with cv::INTER_AREA for any number of channels.
+ *
+ * cv::resize() accepts at most 4 channels unless the scale is an integer,
+ * so the channels of a larger descriptor are resized one by one.
+ */
+static void
+resize_area(
+      const cv::Mat& in_,
+      const cv::Size& size_,
+      cv::Mat& out_
+)
+{
+   if (in_.channels() <= 4)
+   {
+      cv::resize(in_, out_, size_, 0, 0, cv::INTER_AREA);
+      return;
+   }
+
+   std::vector<cv::Mat> mv;
+   mv.resize((size_t)in_.channels());
+   cv::split(in_, mv.data());
+
+   for (auto& m : mv)
+   {
+      cv::Mat resized;
+      cv::resize(m, resized, size_, 0, 0, cv::INTER_AREA);
+      m = resized;
+   }
+
+   cv::merge(mv, out_);
+}
+
+void
+MyImageProcessing::downsample_descriptor(
+      const cv::Mat& descriptor_,
+      const cv::Size& size_,
+      cv::Mat& out_,
+      bool is_binary_
+)
+{
+   CV_Assert(!descriptor_.empty());
+   CV_Assert((descriptor_.depth() == CV_8U) || (descriptor_.depth() == CV_8S) || (descriptor_.depth() == CV_32S));
+   CV_Assert((size_.width > 0) && (size_.width <= descriptor_.cols));
+   CV_Assert((size_.height > 0) && (size_.height <= descriptor_.rows));
+
+   if (!is_binary_ && (descriptor_.depth() == CV_8S))
+   {
+      // cv::resize() does not support int8
+      cv::Mat wide, resized;
+      descriptor_.convertTo(wide, CV_16S);
+      resize_area(wide, size_, resized);
+      resized.convertTo(out_, CV_8S);
+      return;
+   }
+
+   if (!is_binary_)
+   {
+      resize_area(descriptor_, size_, out_);
+      return;
+   }
+
+   cv::Mat out(size_, descriptor_.type());
+   BitMajorityPoolingLoopBody loop_body(descriptor_, out);
+   cv::parallel_for_(cv::Range(0, out.rows), loop_body);
+
+   out_ = out;
+}
+
 cv::Mat
 MyImageProcessing::downsample(
       const cv::Mat &input_,
@@ -434,6 +584,17 @@ MyImageProcessing::census_transform(
    return ::census_transform(in_image_, census_image_, wnd_size_, color_to_gray_);
 }
 
+void
+MyImageProcessing::packed_census_transform(
+      const cv::Mat &in_image_,
+      cv::Mat &census_image_,
+      int wnd_size_,
+      bool color_to_gray_
+)
+{
+   return ::packed_census_transform(in_image_, census_image_, wnd_size_, color_to_gray_);
+}
+
 void
 MyImageProcessing::complete_rank_transform(
       const cv::Mat &in_image_,
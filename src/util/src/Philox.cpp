@@ -0,0 +1,67 @@
+/*  ---------------------------------------------------------------------
+    Copyright 2017 Fangjun Kuang
+    email: csukuangfj at gmail dot com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a COPYING file of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>
+    -----------------------------------------------------------------  */
+#include "Philox.hpp"
+
+static const uint32_t g_philox_m0 = 0xD2511F53;   //!< multiplier of the first word pair
+static const uint32_t g_philox_m1 = 0xCD9E8D57;   //!< multiplier of the second word pair
+static const uint32_t g_philox_w0 = 0x9E3779B9;   //!< Weyl increment of the first key word, golden ratio
+static const uint32_t g_philox_w1 = 0xBB67AE85;   //!< Weyl increment of the second key word, sqrt(3) - 1
+
+static inline void
+mulhilo(uint32_t a_, uint32_t b_, uint32_t& hi_, uint32_t& lo_)
+{
+   uint64_t product = (uint64_t)a_ * (uint64_t)b_;
+   hi_ = (uint32_t)(product >> 32);
+   lo_ = (uint32_t)product;
+}
+
+void
+Philox::philox4x32(
+      const uint32_t counter_[4],
+      const uint32_t key_[2],
+      uint32_t result_[4]
+)
+{
+   uint32_t c0 = counter_[0];
+   uint32_t c1 = counter_[1];
+   uint32_t c2 = counter_[2];
+   uint32_t c3 = counter_[3];
+
+   uint32_t k0 = key_[0];
+   uint32_t k1 = key_[1];
+
+   for (int r = 0; r < 10; r++)
+   {
+      uint32_t hi0, lo0, hi1, lo1;
+      mulhilo(g_philox_m0, c0, hi0, lo0);
+      mulhilo(g_philox_m1, c2, hi1, lo1);
+
+      c0 = hi1 ^ c1 ^ k0;
+      c1 = lo1;
+      c2 = hi0 ^ c3 ^ k1;
+      c3 = lo0;
+
+      k0 += g_philox_w0;
+      k1 += g_philox_w1;
+   }
+
+   result_[0] = c0;
+   result_[1] = c1;
+   result_[2] = c2;
+   result_[3] = c3;
+}
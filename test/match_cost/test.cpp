@@ -1,8 +1,10 @@
+#include <climits>
 #include <iostream>
 #include <gtest/gtest.h>
 #include <opencv2/core.hpp>
 
 #include "MatchCost.hpp"
+#include "MatchCostSimd.hpp"
 
 class MatchCostTest : public ::testing::Test
 {
@@ -322,3 +324,382 @@ TEST_F(MatchCostTest, test_HammingCost)
    res = m_cost->compute_cost(mc, md, cv::Point(2,3), cv::Point(2,3), 1);
    EXPECT_NEAR(expected, res, 1e-5);
 }
+
+TEST_F(MatchCostTest, test_patch_cost_kernel)
+{
+   const char* names[] = {"ssd", "sad", "hamming"};
+   int norm_types[] = {cv::NORM_L2, cv::NORM_L1, cv::NORM_HAMMING};
+   int types[] = {CV_8UC1, CV_8UC3, CV_8UC(128), CV_8UC(7)};
+
+   for (int t = 0; t < 4; t++)
+   {
+      cv::Mat a(12, 11, types[t]);
+      cv::Mat b(12, 11, types[t]);
+      cv::randu(a, 0, 256);
+      cv::randu(b, 0, 256);
+      int cn = a.channels();
+
+      for (int k = 0; k < 3; k++)
+      {
+         m_cost = MatchCost::create(names[k]);
+         MatchCost::Kernel kernel = m_cost->get_kernel(a.type());
+         ASSERT_TRUE(kernel != nullptr);
+
+         // a single point
+         cv::Point p1(3, 4);
+         cv::Point p2(7, 2);
+         cv::Mat m1 = a(cv::Rect(p1, cv::Size(1, 1))).reshape(1);
+         cv::Mat m2 = b(cv::Rect(p2, cv::Size(1, 1))).reshape(1);
+         double expected = cv::norm(m1, m2, norm_types[k]) / cn;
+         double res = MatchCost::compute_patch_cost(kernel, a, b, p1.x, p1.y, p2.x, p2.y, 0);
+         EXPECT_EQ(expected, res);
+         EXPECT_EQ(expected, m_cost->compute_cost(a, b, p1, p2, 0));
+
+         // a patch inside the image
+         p1 = cv::Point(4, 5);
+         p2 = cv::Point(6, 8);
+         m1 = a(cv::Rect(p1.x - 2, p1.y - 2, 5, 5)).clone().reshape(1);
+         m2 = b(cv::Rect(p2.x - 2, p2.y - 2, 5, 5)).clone().reshape(1);
+         expected = cv::norm(m1, m2, norm_types[k]) / (25 * cn);
+         res = MatchCost::compute_patch_cost(kernel, a, b, p1.x, p1.y, p2.x, p2.y, 2);
+         EXPECT_EQ(expected, res);
+
+         // a patch at the corner is cropped and aligned at the top left corner
+         p1 = cv::Point(10, 11);
+         p2 = cv::Point(0, 5);
+         m1 = a(cv::Rect(8, 9, 3, 3)).clone().reshape(1);
+         m2 = b(cv::Rect(0, 3, 3, 3)).clone().reshape(1);
+         expected = cv::norm(m1, m2, norm_types[k]) / (9 * cn);
+         res = MatchCost::compute_patch_cost(kernel, a, b, p1.x, p1.y, p2.x, p2.y, 2);
+         EXPECT_EQ(expected, res);
+         EXPECT_EQ(expected, m_cost->compute_cost(a, b, p1, p2, 2));
+      }
+   }
+}
+
+TEST_F(MatchCostTest, test_simd_row_kernels)
+{
+   typedef unsigned (*RowKernel)(const uchar*, const uchar*, int);
+
+   MatchCostSimd simds[] = {E_SIMD_NONE, E_SIMD_SSE2, E_SIMD_AVX2, E_SIMD_AVX512};
+   RowKernel sad_kernels[] = {sad_8u_scalar, sad_8u_sse2, sad_8u_avx2, sad_8u_avx512};
+   RowKernel ssd_kernels[] = {ssd_8u_scalar, ssd_8u_sse2, ssd_8u_avx2, ssd_8u_avx512};
+   int lengths[] = {1, 3, 7, 9, 16, 25, 31, 32, 33, 64, 75, 100, 128, 200, 1152};
+
+   for (int s = 0; s < 4; s++)
+   {
+      if (!is_match_cost_simd_supported(simds[s])) continue;
+
+      for (int len : lengths)
+      {
+         // the rows start at an odd offset to test unaligned loads
+         cv::Mat a(1, len + 1, CV_8UC1);
+         cv::Mat b(1, len + 1, CV_8UC1);
+         cv::randu(a, 0, 256);
+         cv::randu(b, 0, 256);
+         a = a.colRange(1, len + 1);
+         b = b.colRange(1, len + 1);
+
+         double expected_sad = cv::norm(a, b, cv::NORM_L1);
+         // with IPP, cv::norm() squares the L2 norm for NORM_L2SQR,
+         // the exact sum of squares is the nearest integer
+         double expected_ssd = cvRound(cv::norm(a, b, cv::NORM_L2SQR));
+         EXPECT_EQ(expected_sad, (double)sad_kernels[s](a.ptr<uchar>(0), b.ptr<uchar>(0), len)) << len;
+         EXPECT_EQ(expected_ssd, (double)ssd_kernels[s](a.ptr<uchar>(0), b.ptr<uchar>(0), len)) << len;
+
+         // the largest differences
+         a.setTo(255);
+         b.setTo(0);
+         EXPECT_EQ(255.0 * len, (double)sad_kernels[s](a.ptr<uchar>(0), b.ptr<uchar>(0), len)) << len;
+         EXPECT_EQ(65025.0 * len, (double)ssd_kernels[s](a.ptr<uchar>(0), b.ptr<uchar>(0), len)) << len;
+      }
+   }
+
+   // the patch kernels give identical results with and without dispatching
+   cv::Mat a(12, 11, CV_8UC(128));
+   cv::Mat b(12, 11, CV_8UC(128));
+   cv::randu(a, 0, 256);
+   cv::randu(b, 0, 256);
+
+   const char* names[] = {"ssd", "sad"};
+   bool use_optimized = cv::useOptimized();
+   for (int k = 0; k < 2; k++)
+   {
+      m_cost = MatchCost::create(names[k]);
+
+      cv::setUseOptimized(true);
+      double res_simd = MatchCost::compute_patch_cost(m_cost->get_kernel(a.type()), a, b, 5, 6, 4, 3, 2);
+
+      cv::setUseOptimized(false);
+      double res_scalar = MatchCost::compute_patch_cost(m_cost->get_kernel(a.type()), a, b, 5, 6, 4, 3, 2);
+
+      EXPECT_EQ(res_scalar, res_simd);
+   }
+   cv::setUseOptimized(use_optimized);
+}
+
+TEST_F(MatchCostTest, test_simd_row_kernels_8s)
+{
+   typedef unsigned (*RowKernel)(const schar*, const schar*, int);
+
+   MatchCostSimd simds[] = {E_SIMD_NONE, E_SIMD_SSE2, E_SIMD_AVX2, E_SIMD_AVX512};
+   RowKernel sad_kernels[] = {sad_8s_scalar, sad_8s_sse2, sad_8s_avx2, sad_8s_avx512};
+   RowKernel ssd_kernels[] = {ssd_8s_scalar, ssd_8s_sse2, ssd_8s_avx2, ssd_8s_avx512};
+   int lengths[] = {1, 7, 16, 31, 32, 33, 64, 100, 128, 1152};
+
+   for (int s = 0; s < 4; s++)
+   {
+      if (!is_match_cost_simd_supported(simds[s])) continue;
+
+      for (int len : lengths)
+      {
+         cv::Mat a(1, len + 1, CV_8SC1);
+         cv::Mat b(1, len + 1, CV_8SC1);
+         cv::randu(a, -128, 128);
+         cv::randu(b, -128, 128);
+         a = a.colRange(1, len + 1);
+         b = b.colRange(1, len + 1);
+
+         double expected_sad = cv::norm(a, b, cv::NORM_L1);
+         double expected_ssd = cv::norm(a, b, cv::NORM_L2SQR);
+         EXPECT_EQ(expected_sad, (double)sad_kernels[s](a.ptr<schar>(0), b.ptr<schar>(0), len)) << len;
+         EXPECT_EQ(expected_ssd, (double)ssd_kernels[s](a.ptr<schar>(0), b.ptr<schar>(0), len)) << len;
+
+         // the largest differences
+         a.setTo(127);
+         b.setTo(-128);
+         EXPECT_EQ(255.0 * len, (double)sad_kernels[s](a.ptr<schar>(0), b.ptr<schar>(0), len)) << len;
+         EXPECT_EQ(65025.0 * len, (double)ssd_kernels[s](a.ptr<schar>(0), b.ptr<schar>(0), len)) << len;
+      }
+   }
+
+   // the patch kernels give identical results with and without dispatching
+   cv::Mat a(12, 11, CV_8SC(32));
+   cv::Mat b(12, 11, CV_8SC(32));
+   cv::randu(a, -128, 128);
+   cv::randu(b, -128, 128);
+
+   const char* names[] = {"ssd", "sad"};
+   bool use_optimized = cv::useOptimized();
+   for (int k = 0; k < 2; k++)
+   {
+      m_cost = MatchCost::create(names[k]);
+
+      cv::setUseOptimized(true);
+      double res_simd = MatchCost::compute_patch_cost(m_cost->get_kernel(a.type()), a, b, 5, 6, 4, 3, 2);
+
+      cv::setUseOptimized(false);
+      double res_scalar = MatchCost::compute_patch_cost(m_cost->get_kernel(a.type()), a, b, 5, 6, 4, 3, 2);
+
+      EXPECT_EQ(res_scalar, res_simd);
+   }
+   cv::setUseOptimized(use_optimized);
+}
+
+TEST_F(MatchCostTest, test_PackedHammingCost)
+{
+   typedef unsigned (*RowKernel)(const uint32_t*, const uint32_t*, int);
+
+   MatchCostPopcount popcounts[] = {E_POPCOUNT_NONE, E_POPCOUNT_POPCNT, E_POPCOUNT_AVX512};
+   RowKernel kernels[] = {hamming_32u_scalar, hamming_32u_popcnt, hamming_32u_avx512};
+   int lengths[] = {1, 2, 3, 9, 15, 16, 17, 27, 32, 33, 75};
+
+   for (int s = 0; s < 3; s++)
+   {
+      if (!is_match_cost_popcount_supported(popcounts[s])) continue;
+
+      for (int len : lengths)
+      {
+         cv::Mat a(1, len, CV_32SC1);
+         cv::Mat b(1, len, CV_32SC1);
+         cv::randu(a, cv::Scalar::all(INT_MIN), cv::Scalar::all(INT_MAX));
+         cv::randu(b, cv::Scalar::all(INT_MIN), cv::Scalar::all(INT_MAX));
+
+         // the bytes of the words give the same hamming distance
+         cv::Mat a8(1, len*4, CV_8UC1, a.data);
+         cv::Mat b8(1, len*4, CV_8UC1, b.data);
+         double expected = cv::norm(a8, b8, cv::NORM_HAMMING);
+
+         const uint32_t* pa = a.ptr<uint32_t>(0);
+         const uint32_t* pb = b.ptr<uint32_t>(0);
+         EXPECT_EQ(expected, (double)kernels[s](pa, pb, len)) << len;
+      }
+   }
+
+   // the packed cost is the hamming cost of the bytes of the words
+   cv::Mat a(12, 11, CV_8UC(12));
+   cv::Mat b(12, 11, CV_8UC(12));
+   cv::randu(a, 0, 256);
+   cv::randu(b, 0, 256);
+   cv::Mat packed_a(a.size(), CV_32SC3, a.data, a.step);
+   cv::Mat packed_b(b.size(), CV_32SC3, b.data, b.step);
+
+   cv::Ptr<MatchCost> hamming = MatchCost::create("hamming");
+   m_cost = MatchCost::create("packed_hamming");
+   ASSERT_TRUE(!m_cost.empty());
+   EXPECT_EQ(m_cost->get_name(), MatchCost::create(E_COST_TYPE_PACKED_HAMMING)->get_name());
+
+   cv::Point p1(5, 6);
+   cv::Point p2(10, 0);
+   for (int half_patch_size = 0; half_patch_size < 3; half_patch_size++)
+   {
+      double expected = hamming->compute_cost(a, b, p1, p2, half_patch_size);
+      EXPECT_DOUBLE_EQ(expected, m_cost->compute_cost(packed_a, packed_b, p1, p2, half_patch_size));
+   }
+   // cv::norm() computes the hamming distance only for single channel bytes
+   double expected = cv::norm(a.reshape(1), b.reshape(1), cv::NORM_HAMMING) / (a.total() * a.channels());
+   EXPECT_DOUBLE_EQ(expected, m_cost->compute_cost(packed_a, packed_b));
+}
+
+TEST_F(MatchCostTest, test_compute_cost_batch)
+{
+   cv::Mat a(12, 11, CV_8UC(9));
+   cv::Mat b(12, 11, CV_8UC(9));
+   cv::randu(a, 0, 256);
+   cv::randu(b, 0, 256);
+
+   // inside, at the corners and outside of the second frame
+   std::vector<cv::Point> candidates = {
+         cv::Point(5, 5), cv::Point(0, 0), cv::Point(10, 11), cv::Point(-1, 3),
+         cv::Point(3, 12), cv::Point(9, 2), cv::Point(1, 10),
+   };
+   cv::Point references[] = {cv::Point(4, 6), cv::Point(0, 11), cv::Point(10, 1)};
+
+   const char* names[] = {"ssd", "sad", "hamming"};
+   for (int k = 0; k < 3; k++)
+   {
+      m_cost = MatchCost::create(names[k]);
+      for (const cv::Point& p1 : references)
+      {
+         for (int half_patch_size = 0; half_patch_size < 3; half_patch_size++)
+         {
+            std::vector<float> costs;
+            int n = m_cost->compute_cost_batch(a, b, p1, candidates, costs, half_patch_size);
+            EXPECT_EQ(n, (int)candidates.size());
+
+            for (size_t i = 0; i < candidates.size(); i++)
+            {
+               cv::Rect r(cv::Point(0, 0), b.size());
+               float expected = FLT_MAX;
+               if (r.contains(candidates[i]))
+               {
+                  expected = (float)m_cost->compute_cost(a, b, p1, candidates[i], half_patch_size);
+               }
+               EXPECT_EQ(expected, costs[i]);
+            }
+
+            // it stops after the first candidate that beats the bound
+            float bound = costs[2] + 1e-3f;
+            int expected_n = 0;
+            while (!(costs[expected_n] < bound)) expected_n++;
+            expected_n++;
+
+            std::vector<float> bounded_costs;
+            n = m_cost->compute_cost_batch(a, b, p1, candidates, bounded_costs, half_patch_size, bound);
+            EXPECT_EQ(expected_n, n);
+            for (int i = 0; i < n; i++)
+            {
+               EXPECT_EQ(costs[i], bounded_costs[i]);
+            }
+         }
+      }
+   }
+}
+
+TEST_F(MatchCostTest, test_bounded_patch_cost)
+{
+   int types[] = {CV_8UC1, CV_8UC(9), CV_8UC(128), CV_32FC3};
+   const char* names[] = {"ssd", "sad", "hamming"};
+
+   for (int type : types)
+   {
+      cv::Mat a(12, 11, type);
+      cv::Mat b(12, 11, type);
+      cv::randu(a, 0, 256);
+      cv::randu(b, 0, 256);
+
+      for (int k = 0; k < 3; k++)
+      {
+         if ((CV_MAT_DEPTH(type) != CV_8U) && (k == 2)) continue; // hamming supports only bytes
+
+         m_cost = MatchCost::create(names[k]);
+         MatchCost::Kernel kernel = m_cost->get_kernel(type);
+
+         cv::Point p1(5, 5);
+         cv::Point p2(3, 7);
+         for (int half_patch_size = 0; half_patch_size < 4; half_patch_size++)
+         {
+            double exact = MatchCost::compute_patch_cost(kernel, a, b, p1.x, p1.y, p2.x, p2.y, half_patch_size);
+
+            double bounds[] = {0, exact * 0.1, exact * 0.5, exact, exact * 1.5, DBL_MAX};
+            for (double bound : bounds)
+            {
+               double res = MatchCost::compute_patch_cost(kernel, a, b, p1.x, p1.y, p2.x, p2.y, half_patch_size, bound);
+               if (exact < bound)
+               {
+                  EXPECT_EQ(exact, res);
+               }
+               else
+               {
+                  // the partial cost is enough to reject the candidate
+                  EXPECT_GE(res, bound);
+                  EXPECT_LE(res, exact);
+               }
+            }
+         }
+      }
+   }
+}
+
+TEST_F(MatchCostTest, test_bilinear_patch_cost)
+{
+   int types[] = {CV_8UC1, CV_8UC(9), CV_8UC(128), CV_32FC3};
+   const char* names[] = {"ssd", "sad", "hamming"};
+   cv::Point2f positions[] = {{4.25f, 5.5f}, {3.0f, 7.0f}, {1.75f, 0.5f}, {10.0f, 11.0f}, {9.5f, 10.25f}};
+
+   bool use_optimized = cv::useOptimized();
+   for (int type : types)
+   {
+      cv::Mat a(12, 11, type);
+      cv::Mat b(12, 11, type);
+      cv::randu(a, 0, 256);
+      cv::randu(b, 0, 256);
+
+      for (int k = 0; k < 3; k++)
+      {
+         if ((CV_MAT_DEPTH(type) != CV_8U) && (k == 2)) continue; // hamming supports only bytes
+
+         m_cost = MatchCost::create(names[k]);
+         for (int optimized = 0; optimized < 2; optimized++)
+         {
+            cv::setUseOptimized(optimized != 0);
+            MatchCost::Kernel kernel = m_cost->get_kernel(type);
+            MatchCost::BilinearKernel bilinear_kernel = m_cost->get_bilinear_kernel(type);
+
+            for (const cv::Point2f& p : positions)
+            {
+               for (int half_patch_size = 0; half_patch_size < 3; half_patch_size++)
+               {
+                  int x = cvFloor(p.x);
+                  int y = cvFloor(p.y);
+                  float wx = p.x - x;
+                  float wy = p.y - y;
+                  int x_right = std::min(x + 1, b.cols - 1);
+                  int y_bottom = std::min(y + 1, b.rows - 1);
+
+                  double expected =
+                        (1 - wx)*(1 - wy)*MatchCost::compute_patch_cost(kernel, a, b, 5, 6, x, y, half_patch_size) +
+                        wx*(1 - wy)*MatchCost::compute_patch_cost(kernel, a, b, 5, 6, x_right, y, half_patch_size) +
+                        (1 - wx)*wy*MatchCost::compute_patch_cost(kernel, a, b, 5, 6, x, y_bottom, half_patch_size) +
+                        wx*wy*MatchCost::compute_patch_cost(kernel, a, b, 5, 6, x_right, y_bottom, half_patch_size);
+
+                  double res = MatchCost::compute_patch_cost_bilinear(kernel, bilinear_kernel, a, b,
+                                                                      5, 6, p.x, p.y, half_patch_size);
+                  EXPECT_NEAR(expected, res, 1e-9 * std::max(1.0, expected)) << names[k] << " " << p;
+               }
+            }
+         }
+      }
+   }
+   cv::setUseOptimized(use_optimized);
+}
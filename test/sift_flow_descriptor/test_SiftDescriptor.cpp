@@ -0,0 +1,234 @@
+/*  ---------------------------------------------------------------------
+    Copyright 2017 Fangjun Kuang
+    email: csukuangfj at gmail dot com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a COPYING file of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>
+    -----------------------------------------------------------------  */
+#include <cmath>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "SiftDescriptor.hpp"
+#include "common.hpp"
+
+/**
+ * The SIFT flow descriptor as it was computed before the fused and parallel
+ * implementation, i.e., one pass over the image for every step.
+ */
+static void
+reference_sift_descriptor(
+      const cv::Mat& image_,
+      cv::Mat& imsift,
+      int cell_size_,
+      int step_size_,
+      bool is_boundary_included_,
+      int num_bins_
+)
+{
+   int alpha = 9;
+
+   int width = image_.cols;
+   int height = image_.rows;
+   int nchannels = image_.channels();
+   int nPixels = width*height;
+
+   cv::Mat img;
+   image_.convertTo(img, CV_32F);
+
+   cv::Mat kx = (cv::Mat_<float>(1,5) << 1,-8,0,8,-1); // x-derivative kernel
+   cv::Mat ky = (cv::Mat_<float>(5,1) << 1,-8,0,8,-1); // y-derivative kernel
+   kx /= 12;
+   ky /= 12;
+
+   cv::Mat imdx,imdy;
+   cv::filter2D(img, imdx, CV_32F, kx, cv::Point(2,0));
+   cv::filter2D(img, imdy, CV_32F, ky, cv::Point(0,2));
+
+   // get the maximum gradient over the channels and estimate the normalized gradient
+   cv::Mat magsrc(height, width, img.type());
+   cv::Mat mag(height, width, CV_32FC1);
+   cv::Mat gradient = cv::Mat::zeros(height, width, CV_32FC2);
+
+   float* magsrc_pData = magsrc.ptr<float>(0);
+   float* imdx_pData = imdx.ptr<float>(0);
+   float* imdy_pData = imdy.ptr<float>(0);
+   float* gradient_pData = gradient.ptr<float>(0);
+   float* mag_pData = mag.ptr<float>(0);
+
+   for(int i = 0;i < nPixels; i++)
+   {
+      int offset = i * nchannels;
+      for(int j = 0;j < nchannels; j++)
+         magsrc_pData[offset+j] = (float)(sqrt(imdx_pData[offset+j]*imdx_pData[offset+j]+imdy_pData[offset+j]*imdy_pData[offset+j]));
+      float Max = magsrc_pData[offset];
+      if(Max > 1e-7)
+      {
+         gradient_pData[i*2] = imdx_pData[offset]/Max;
+         gradient_pData[i*2+1] = imdy_pData[offset]/Max;
+      }
+      for(int j = 1; j < nchannels; j++)
+      {
+         if(magsrc_pData[offset+j]>Max)
+         {
+            Max = magsrc_pData[offset+j];
+            gradient_pData[i*2] = imdx_pData[offset+j]/Max;
+            gradient_pData[i*2+1] = imdy_pData[offset+j]/Max;
+         }
+      }
+      mag_pData[i] = Max;
+   }
+
+   // get the pixel-wise energy for each orientation band
+   cv::Mat imband(height, width, CV_32FC(num_bins_));
+   float* imband_pData = imband.ptr<float>(0);
+   float theta = (float)M_PI*2/num_bins_;
+
+   for(int k = 0; k < num_bins_; k++)
+   {
+      float _cos, _sin, temp;
+      _sin = (float)sin(theta*k);
+      _cos = (float)cos(theta*k);
+      for(int i = 0; i < nPixels; i++)
+      {
+         temp = cv::max(gradient_pData[i*2]*_cos + gradient_pData[i*2+1]*_sin, 0.0f);
+         temp = (float)cv::pow(temp,alpha);
+         imband_pData[i*num_bins_+k] = temp*mag_pData[i];
+      }
+   }
+
+   // filter out the SIFT feature
+   // filter[1] is never assigned below, it is 0 as in the original implementation
+   cv::Mat_<float> filter(cell_size_*2+1, 1, 0.0f);
+   filter[0][0] = filter[cell_size_+1][0] = 0.25;
+   for(int i = 1; i < cell_size_ + 1; i++)
+      filter[i+1][0] = 1;
+   for(int i = cell_size_ + 2; i < cell_size_*2 + 1; i++)
+      filter[i][0] = 0;
+
+   cv::Mat imband_cell;
+   cv::sepFilter2D(imband, imband_cell, CV_32F, filter, filter);
+   float* imband_cell_pData = imband_cell.ptr<float>(0);
+
+   int siftdim = num_bins_*16;
+   int sift_width,sift_height,x_shift=0,y_shift=0;
+
+   sift_width = width/step_size_;
+   sift_height = height/step_size_;
+
+   if(!is_boundary_included_)
+   {
+      sift_width = (width-4*cell_size_)/step_size_;
+      sift_height= (height-4*cell_size_)/step_size_;
+      x_shift = 2*cell_size_;
+      y_shift = 2*cell_size_;
+   }
+
+   imsift.create(sift_height, sift_width, CV_8UC(siftdim));
+   uchar* imsift_pData = imsift.ptr<uchar>(0);
+
+   cv::Mat sift_cell(siftdim, 1, CV_32FC1);
+   float* sift_cell_pData = sift_cell.ptr<float>(0);
+   for(int i = 0; i < sift_height; i++)
+   {
+      for(int j = 0; j < sift_width; j++)
+      {
+         int count = 0;
+         for(int ii = -1; ii <= 2; ii++)
+            for(int jj = -1; jj <= 2; jj++)
+            {
+               int y = cv::min(cv::max(y_shift+i*step_size_+ii*cell_size_,0), height-1);
+               int x = cv::min(cv::max(x_shift+j*step_size_+jj*cell_size_,0), width-1);
+               memcpy(sift_cell_pData+count*num_bins_,imband_cell_pData+(y*width+x)*num_bins_,sizeof(float)*num_bins_);
+               count++;
+            }
+         // normalize the SIFT descriptor
+         double mag = cv::norm(sift_cell, cv::NORM_L2);
+         int offset = (i*sift_width+j)*siftdim;
+         for(int k = 0;k<siftdim;k++)
+            imsift_pData[offset+k] =  (uchar)cv::min(sift_cell_pData[k]/(mag+0.01)*255,255.);
+      }
+   }
+}
+
+/**
+ * Compare two descriptor images element by element.
+ */
+static void
+expect_same_descriptor(const cv::Mat& expected_, const cv::Mat& actual_)
+{
+   ASSERT_EQ(expected_.size(), actual_.size());
+   ASSERT_EQ(expected_.type(), actual_.type());
+
+   cv::Mat diff;
+   cv::absdiff(expected_.reshape(1), actual_.reshape(1), diff);
+   EXPECT_EQ(cv::countNonZero(diff), 0);
+}
+
+TEST(test_SiftDescriptor, test_compute_sift_descriptor_color)
+{
+   cv::String filename = cv::String(KFJ_DATA_PATH) + "/middlebury_flow/RubberWhale/frame10.png";
+   cv::Mat image = cv::imread(filename, cv::IMREAD_COLOR);
+   ASSERT_FALSE(image.empty());
+
+   cv::Mat expected, actual;
+   reference_sift_descriptor(image, expected, 2, 1, true, 8);
+   SiftDescriptor::compute_sift_descriptor(image, actual);
+
+   expect_same_descriptor(expected, actual);
+}
+
+TEST(test_SiftDescriptor, test_compute_sift_descriptor_gray)
+{
+   cv::String filename = cv::String(KFJ_DATA_PATH) + "/middlebury_flow/RubberWhale/frame10.png";
+   cv::Mat image = cv::imread(filename, cv::IMREAD_GRAYSCALE);
+   ASSERT_FALSE(image.empty());
+
+   // a larger cell, a step of 2 and no boundary
+   cv::Mat expected, actual;
+   reference_sift_descriptor(image, expected, 3, 2, false, 8);
+   SiftDescriptor::compute_sift_descriptor(image, actual, 3, 2, false, 8);
+
+   expect_same_descriptor(expected, actual);
+}
+
+TEST(test_SiftDescriptor, test_compute_sift_descriptor_sampled)
+{
+   cv::String filename = cv::String(KFJ_DATA_PATH) + "/middlebury_flow/RubberWhale/frame10.png";
+   cv::Mat image = cv::imread(filename, cv::IMREAD_COLOR);
+   ASSERT_FALSE(image.empty());
+
+   cv::Mat mask(image.size(), CV_8UC1, cv::Scalar::all(0));
+   for (int y = 1; y < mask.rows; y += 3)
+   {
+      for (int x = 1; x < mask.cols; x += 3)
+      {
+         mask.at<uchar>(y, x) = 255;
+      }
+   }
+
+   cv::Mat full, sampled;
+   SiftDescriptor::compute_sift_descriptor(image, full);
+   SiftDescriptor::compute_sift_descriptor_sampled(image, mask, sampled);
+
+   // the selected pixels are the same as without the mask, the others are 0
+   cv::Mat expected(full.size(), full.type(), cv::Scalar::all(0));
+   full.copyTo(expected, mask);
+
+   cv::Mat diff;
+   cv::absdiff(expected.reshape(1), sampled.reshape(1), diff);
+   EXPECT_EQ(cv::countNonZero(diff), 0);
+}
@@ -283,3 +283,41 @@ TEST(test_CensusTransform, test_census_transform_image_8u)
    cv::waitKey(0);
 #endif
 }
+
+TEST(test_CensusTransform, test_packed_census_transform)
+{
+   cv::Mat img(17, 19, CV_8UC3);
+   cv::randu(img, cv::Scalar::all(0), cv::Scalar::all(256));
+
+   bool color_to_gray[] = {true, false};
+   int wnd_sizes[] = {3, 5};
+   for (bool to_gray : color_to_gray)
+   {
+      for (int wnd_size : wnd_sizes)
+      {
+         cv::Mat census, packed;
+         census_transform(img, census, wnd_size, to_gray);
+         packed_census_transform(img, packed, wnd_size, to_gray);
+
+         int num_bytes = census.channels();
+         ASSERT_EQ(packed.depth(), CV_32S);
+         ASSERT_EQ(packed.channels(), (num_bytes + 3) / 4);
+         ASSERT_EQ(packed.size(), census.size());
+
+         for (int y = 0; y < census.rows; y++)
+         {
+            for (int x = 0; x < census.cols; x++)
+            {
+               const uchar* p = census.ptr<uchar>(y) + x*num_bytes;
+               const uchar* q = packed.ptr<uchar>(y) + x*packed.elemSize();
+
+               // the bytes are kept in order and the rest is padded with 0
+               for (int k = 0; k < (int)packed.elemSize(); k++)
+               {
+                  EXPECT_EQ((k < num_bytes) ? p[k] : 0, q[k]);
+               }
+            }
+         }
+      }
+   }
+}
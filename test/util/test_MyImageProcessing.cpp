@@ -2,6 +2,7 @@
 #include <gtest/gtest.h>
 
 #include <opencv2/highgui.hpp>
+#include <opencv2/imgproc.hpp>
 
 #include "MyImageProcessing.hpp"
 #include "MyTools.hpp"
@@ -438,3 +439,53 @@ TEST_F(MyImageProcessingTest, test_get_patch_bicubic)
    EXPECT_NEAR(patch.at<cv::Vec3f>(0,0)[1], 71.8f, 1e-5);
    EXPECT_NEAR(patch.at<cv::Vec3f>(0,0)[2], 72.8f, 1e-5);
 }
+
+TEST_F(MyImageProcessingTest, test_downsample_descriptor)
+{
+   // 2x2 blocks are pooled into one pixel
+   cv::Mat census = (cv::Mat_<uchar>(2, 4) << 0x01, 0x03, 0xF0, 0x00,
+                                              0x03, 0x07, 0x10, 0x80);
+   cv::Mat pooled;
+   MyImageProcessing::downsample_descriptor(census, cv::Size(2, 1), pooled, true);
+   ASSERT_EQ(CV_8UC1, pooled.type());
+   EXPECT_EQ(0x03, pooled.at<uchar>(0, 0)); // bit 2 is set in only one of four pixels
+   EXPECT_EQ(0x90, pooled.at<uchar>(0, 1)); // ties are set
+
+   // every byte of a packed descriptor is pooled separately
+   cv::Mat packed(4, 4, CV_32SC1);
+   packed = 0x00FF00FF;
+   packed.at<int>(0, 0) = 0;
+   MyImageProcessing::downsample_descriptor(packed, cv::Size(2, 2), pooled, true);
+   ASSERT_EQ(CV_32SC1, pooled.type());
+   EXPECT_EQ(0x00FF00FF, pooled.at<int>(0, 0));
+   EXPECT_EQ(0x00FF00FF, pooled.at<int>(1, 1));
+
+   // histograms are averaged
+   cv::Mat sift(4, 6, CV_8UC(128));
+   cv::randu(sift, 0, 256);
+   MyImageProcessing::downsample_descriptor(sift, cv::Size(3, 2), pooled, false);
+   ASSERT_EQ(sift.type(), pooled.type());
+   ASSERT_EQ(cv::Size(3, 2), pooled.size());
+   for (int k = 0; k < 128; k += 17)
+   {
+      int sum = sift.ptr<uchar>(2)[4*128 + k] + sift.ptr<uchar>(2)[5*128 + k] +
+                sift.ptr<uchar>(3)[4*128 + k] + sift.ptr<uchar>(3)[5*128 + k];
+      EXPECT_NEAR(sum / 4.0, pooled.ptr<uchar>(1)[2*128 + k], 0.5);
+   }
+
+   // a non-integer scale, as between two pyramid levels, averages every channel as a single channel image
+   cv::Mat level(8, 8, CV_8UC(128));
+   cv::randu(level, 0, 256);
+   MyImageProcessing::downsample_descriptor(level, cv::Size(6, 6), pooled, false);
+   ASSERT_EQ(level.type(), pooled.type());
+   std::vector<cv::Mat> level_mv, pooled_mv;
+   cv::split(level, level_mv);
+   cv::split(pooled, pooled_mv);
+   for (int k = 0; k < 128; k += 17)
+   {
+      cv::Mat expected, diff;
+      cv::resize(level_mv[k], expected, cv::Size(6, 6), 0, 0, cv::INTER_AREA);
+      cv::absdiff(expected, pooled_mv[k], diff);
+      EXPECT_EQ(0, cv::countNonZero(diff));
+   }
+}
@@ -0,0 +1,83 @@
+/*  ---------------------------------------------------------------------
+    Copyright 2017 Fangjun Kuang
+    email: csukuangfj at gmail dot com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a COPYING file of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>
+    -----------------------------------------------------------------  */
+#include <gtest/gtest.h>
+
+#include "Philox.hpp"
+
+// known answer tests of Random123
+TEST(test_Philox, test_known_answers)
+{
+   uint32_t counters[3][4] = {
+         {0, 0, 0, 0},
+         {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff},
+         {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}
+   };
+   uint32_t keys[3][2] = {
+         {0, 0},
+         {0xffffffff, 0xffffffff},
+         {0xa4093822, 0x299f31d0}
+   };
+   uint32_t expected[3][4] = {
+         {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8},
+         {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd},
+         {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}
+   };
+
+   for (int i = 0; i < 3; i++)
+   {
+      uint32_t result[4];
+      Philox::philox4x32(counters[i], keys[i], result);
+      for (int k = 0; k < 4; k++)
+      {
+         EXPECT_EQ(result[k], expected[i][k]);
+      }
+   }
+}
+
+TEST(test_Philox, test_stream)
+{
+   Philox a(100, 1, 7, 2, 3);
+   Philox b(100, 1, 7, 2, 3);
+   Philox c(100, 1, 8, 2, 3);
+
+   int num_equal = 0;
+   for (int i = 0; i < 100; i++)
+   {
+      uint32_t x = a.next();
+      EXPECT_EQ(x, b.next());
+      num_equal += (x == c.next());
+   }
+   EXPECT_LT(num_equal, 2);
+
+   // the fifth number is the first one of the second block
+   uint32_t counter[4] = {7, 2, 3, 1};
+   uint32_t key[2] = {100, 1};
+   uint32_t block[4];
+   Philox::philox4x32(counter, key, block);
+
+   Philox d(100, 1, 7, 2, 3);
+   for (int i = 0; i < 4; i++) d.next();
+   EXPECT_EQ(d.next(), block[0]);
+
+   for (int i = 0; i < 1000; i++)
+   {
+      float r = d.uniform(-2.5f, 2.5f);
+      EXPECT_GE(r, -2.5f);
+      EXPECT_LT(r, 2.5f);
+   }
+}